@@ -0,0 +1,456 @@
+#include "adaptive_rough_path.h"
+#include "height_map_dilation.h"
+#include "map_contours.h"
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <queue>
+#include <thread>
+
+namespace ManualCAD
+{
+	namespace
+	{
+		// calls function(line) for every line, lines are split among hardware threads
+		template <class Function>
+		void for_each_line_parallel(int lines, Function function)
+		{
+			const int workers = std::max(1u, std::thread::hardware_concurrency());
+			std::vector<std::future<void>> futures;
+			for (int w = 0; w < workers; ++w)
+				futures.push_back(std::async(std::launch::async, [&function, w, workers, lines]() {
+					for (int line = w; line < lines; line += workers)
+						function(line);
+				}));
+			for (auto& future : futures)
+				future.get();
+		}
+	}
+
+	AdaptiveRoughPath::AdaptiveRoughPath(const std::list<const ParametricSurfaceObject*>& surfaces, const Vector3& center, const Vector2& min, const Vector2& max, const float bottom_height, const float height, const float scale) : bottom_height(bottom_height), surfaces(surfaces)
+	{
+		box.x_min = min.x;
+		box.x_max = max.x;
+		box.z_min = min.y;
+		box.z_max = max.y;
+		box.y_min = center.y + scale * bottom_height;
+		box.y_max = center.y + scale * height;
+	}
+
+	void AdaptiveRoughPath::distance_transform(double* values, int count, int stride, double spacing)
+	{
+		std::vector<double> line(count), bounds(static_cast<size_t>(count) + 1);
+		std::vector<int> vertices(count);
+		for (int q = 0; q < count; ++q)
+			line[q] = values[static_cast<size_t>(q) * stride];
+
+		// position at which parabola of sample q starts to lie below parabola of sample v
+		auto intersection = [&](int q, int v) {
+			const double xq = q * spacing, xv = v * spacing;
+			return ((line[q] + xq * xq) - (line[v] + xv * xv)) / (2.0 * (xq - xv));
+		};
+		int k = 0;
+		vertices[0] = 0;
+		bounds[0] = -INFINITY;
+		bounds[1] = INFINITY;
+		for (int q = 1; q < count; ++q)
+		{
+			double s = intersection(q, vertices[k]);
+			while (s <= bounds[k])
+				s = intersection(q, vertices[--k]);
+			vertices[++k] = q;
+			bounds[k] = s;
+			bounds[k + 1] = INFINITY;
+		}
+
+		k = 0;
+		for (int q = 0; q < count; ++q)
+		{
+			while (bounds[k + 1] < q * spacing)
+				++k;
+			const double d = (q - vertices[k]) * spacing;
+			values[static_cast<size_t>(q) * stride] = d * d + line[vertices[k]];
+		}
+	}
+
+	HeightMap AdaptiveRoughPath::distance_from_pixels(const HeightMap& map, const std::vector<char>& seeds)
+	{
+		constexpr double FAR = 1e20;
+		const int width = map.width, height = map.height;
+		// as in rendered maps, the first index goes along Z and the second along X
+		const double cell_a = map.size.z / map.height, cell_b = map.size.x / map.width;
+		std::vector<double> squared(static_cast<size_t>(width) * height);
+		for (size_t p = 0; p < squared.size(); ++p)
+			squared[p] = seeds[p] ? 0.0 : FAR;
+
+		// the transform is separable: lines along the first index, then along the second one
+		for_each_line_parallel(height, [&](int j) { distance_transform(squared.data() + static_cast<size_t>(j) * width, width, 1, cell_a); });
+		for_each_line_parallel(width, [&](int i) { distance_transform(squared.data() + i, height, width, cell_b); });
+
+		HeightMap distance(width, height, { map.size.x, 1.0f, map.size.z });
+		float* pixels = distance.data();
+		for (size_t p = 0; p < squared.size(); ++p)
+			pixels[p] = static_cast<float>(sqrt(squared[p]));
+		return distance;
+	}
+
+	void AdaptiveRoughPath::propagate_distance(const HeightMap& map, std::vector<float>& distances, const std::vector<char>& blocked)
+	{
+		const int width = map.width, height = map.height;
+		const float cell_a = map.size.z / map.height, cell_b = map.size.x / map.width;
+		constexpr int NEIGHBOURS = 16;
+		constexpr int OFFSETS[NEIGHBOURS][2] = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 }, { 1, 1 }, { 1, -1 }, { -1, 1 }, { -1, -1 },
+			{ 1, 2 }, { 1, -2 }, { -1, 2 }, { -1, -2 }, { 2, 1 }, { 2, -1 }, { -2, 1 }, { -2, -1 } };
+		float lengths[NEIGHBOURS];
+		for (int n = 0; n < NEIGHBOURS; ++n)
+			lengths[n] = sqrtf(OFFSETS[n][0] * cell_a * OFFSETS[n][0] * cell_a + OFFSETS[n][1] * cell_b * OFFSETS[n][1] * cell_b);
+
+		using Entry = std::pair<float, size_t>;
+		std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+		for (size_t p = 0; p < distances.size(); ++p)
+			if (distances[p] < INFINITY)
+				queue.push({ distances[p], p });
+		while (!queue.empty())
+		{
+			const auto [distance, p] = queue.top();
+			queue.pop();
+			if (distance > distances[p])
+				continue;
+			const int a = static_cast<int>(p % width), b = static_cast<int>(p / width);
+			for (int n = 0; n < NEIGHBOURS; ++n)
+			{
+				const int na = a + OFFSETS[n][0], nb = b + OFFSETS[n][1];
+				if (na < 0 || na >= width || nb < 0 || nb >= height)
+					continue;
+				const size_t q = na + static_cast<size_t>(nb) * width;
+				if (blocked[p] && !blocked[q])
+					continue;
+				if (distance + lengths[n] < distances[q])
+				{
+					distances[q] = distance + lengths[n];
+					queue.push({ distances[q], q });
+				}
+			}
+		}
+	}
+
+	float AdaptiveRoughPath::max_engagement(const std::vector<Vector3>& path, size_t first, const std::vector<std::pair<size_t, size_t>>& ramps, const HeightMap& map, std::vector<char> stock, const std::vector<char>& walls, float radius, float floor, float top)
+	{
+		const float cell_a = map.size.z / map.height, cell_b = map.size.x / map.width, cell = std::min(cell_a, cell_b);
+		const int reach_a = static_cast<int>(radius / cell_a) + 1, reach_b = static_cast<int>(radius / cell_b) + 1;
+		// removes stock under the cutter at position moving in direction, returns width of stock ahead of the cutter apart from walls,
+		// taken from its right or left edge (both for a slot)
+		auto cut = [&](const Vector3& position, const Vector2& direction) {
+			const auto coords = map.position_to_pixel(position);
+			const int a0 = static_cast<int>(coords.y), b0 = static_cast<int>(coords.x);
+			const float direction_length = direction.length();
+			float min_right = INFINITY, max_right = -INFINITY;
+			for (int a = std::max(0, a0 - reach_a); a <= std::min(map.width - 1, a0 + reach_a); ++a)
+				for (int b = std::max(0, b0 - reach_b); b <= std::min(map.height - 1, b0 + reach_b); ++b)
+				{
+					const size_t p = a + static_cast<size_t>(b) * map.width;
+					if (!stock[p])
+						continue;
+					const auto center = map.pixel_to_position({ b + 0.5f, a + 0.5f }); // map is transposed
+					const Vector2 offset = { center.x - position.x, center.y - position.z };
+					if (offset.length() > radius)
+						continue;
+					stock[p] = false;
+					if (!walls[p] && direction_length > 0.0f && dot(offset, direction) >= 0.0f)
+					{
+						const float right = (offset.x * direction.y - offset.y * direction.x) / direction_length;
+						min_right = std::min(min_right, right);
+						max_right = std::max(max_right, right);
+					}
+				}
+			return min_right <= max_right ? std::min(radius - min_right, max_right + radius) : 0.0f;
+		};
+
+		// engagement of a pass (a run of moves at floor) is averaged over its length, so that single pixels left by rasterization
+		// don't count as full width; passes shorter than cutter diameter aren't checked
+		float result = 0.0f, pass_engagement = 0.0f, pass_length = 0.0f;
+		auto end_pass = [&]() {
+			if (pass_length >= 2.0f * radius)
+				result = std::max(result, pass_engagement / pass_length);
+			pass_engagement = pass_length = 0.0f;
+		};
+		size_t ramp = 0;
+		for (size_t p = first; p < path.size(); ++p)
+		{
+			// moves over the model may take more, as they cut less deep
+			const bool at_floor = p + 1 < path.size() && path[p].y <= floor && path[p + 1].y <= floor;
+			if (!at_floor)
+				end_pass();
+			while (ramp < ramps.size() && ramps[ramp].second <= p)
+				++ramp;
+			// ramps leave stock under them to the pass at floor along the same contour
+			if (path[p].y >= top || (ramp < ramps.size() && ramps[ramp].first <= p))
+				continue;
+			if (p + 1 == path.size())
+			{
+				cut(path[p], { 0.0f, 0.0f });
+				continue;
+			}
+			const Vector2 direction = { path[p + 1].x - path[p].x, path[p + 1].z - path[p].z };
+			const float length = direction.length();
+			const int steps = static_cast<int>(length / cell) + 1;
+			for (int s = 0; s < steps; ++s)
+			{
+				const float engagement = cut(lerp(path[p], path[p + 1], static_cast<float>(s) / steps), direction);
+				// stock under the cutter where it comes down to the floor is taken by the move down
+				if (!at_floor || (pass_length == 0.0f && s == 0))
+					continue;
+				pass_engagement += engagement * length / steps;
+				pass_length += length / steps;
+			}
+		}
+		end_pass();
+		return result;
+	}
+
+	std::vector<Vector3> AdaptiveRoughPath::generate_path(int levels, const Vector3& size, const Cutter& cutter, const float stepover, const float h_epsilon, HeightMapRenderer::Backend backend, GenerationProgress* progress)
+	{
+		const float level_height = (size.y - bottom_height) / levels;
+		const float safe_height = size.y + h_epsilon; // above the stock cutter moves freely
+
+		if (progress != nullptr)
+			progress->set_stage(GenerationProgress::Stage::Rendering);
+		const auto height_map = HeightMapRenderer{ surfaces, box }.render_height_map({ size.x, size.y - bottom_height, size.z }, backend);
+
+		// as in rough paths, rendered map is transposed: first index goes along Z, second along X
+		const int factor = std::max(1, height_map.width / MAP_DIM);
+		const auto pooled_map = HeightMapDilation::max_pool(height_map, factor);
+		const auto lowest_map = HeightMapDilation::min_pool(height_map, factor); // where the stock may remain, pooled like pooled_map
+		const auto dilated_map = HeightMapDilation::dilate_by_cutter(pooled_map, cutter, pooled_map.size.z / pooled_map.height, pooled_map.size.x / pooled_map.width);
+		const float cell = std::min(dilated_map.size.x / dilated_map.width, dilated_map.size.z / dilated_map.height);
+		const float cell_a = dilated_map.size.z / dilated_map.height, cell_b = dilated_map.size.x / dilated_map.width;
+		const float radius = cutter.get_radius();
+		// dilated map is pooled map extended by the same number of pixels on every side
+		const int pad = (dilated_map.width - pooled_map.width) / 2;
+
+		// points of contours lie between pixel centers, thus they are kept above all pixels around them
+		auto model_height_around = [&](const Vector2& pixel) {
+			const int i = static_cast<int>(floorf(pixel.x - 0.5f)), j = static_cast<int>(floorf(pixel.y - 0.5f));
+			return bottom_height + std::max({ dilated_map.get_pixel(i, j), dilated_map.get_pixel(i + 1, j), dilated_map.get_pixel(i, j + 1), dilated_map.get_pixel(i + 1, j + 1) });
+		};
+		auto model_height_at = [&](const Vector3& p) {
+			const auto coords = dilated_map.position_to_pixel(p);
+			return bottom_height + dilated_map.get_pixel(coords.y, coords.x);
+		};
+
+		if (progress != nullptr)
+			progress->set_stage(GenerationProgress::Stage::Contouring);
+
+		std::vector<Vector3> path;
+		std::vector<std::pair<size_t, size_t>> ramps; // ranges of points
+		const size_t pixel_count = static_cast<size_t>(dilated_map.width) * dilated_map.height;
+		std::vector<char> stock(pixel_count), blocked(pixel_count);
+		std::vector<float> distances(pixel_count);
+		for (int i = levels - 1; i >= 0; --i)
+		{
+			const float h = bottom_height + i * level_height, previous_h = i == levels - 1 ? size.y : h + level_height;
+			// previous level removed stock down to the level or to the model, so stock is left only over the workpiece where the model is below it,
+			// and the cutter passes only where the model (dilated by cutter) is below it too
+			for (int b = 0; b < dilated_map.height; ++b)
+				for (int a = 0; a < dilated_map.width; ++a)
+				{
+					const size_t p = a + static_cast<size_t>(b) * dilated_map.width;
+					const int pooled_a = a - pad, pooled_b = b - pad;
+					stock[p] = pooled_a >= 0 && pooled_a < pooled_map.width && pooled_b >= 0 && pooled_b < pooled_map.height &&
+						bottom_height + lowest_map.get_pixel(pooled_a, pooled_b) < previous_h - CLEARED_TOLERANCE;
+					blocked[p] = bottom_height + dilated_map.get_pixel(a, b) >= previous_h - CLEARED_TOLERANCE;
+					// around the workpiece air is open (cutter touches nothing) farther than cutter radius from it
+					const float inside = std::min(std::min((a + 0.5f - pad) * cell_a, (dilated_map.width - pad - a - 0.5f) * cell_a),
+						std::min((b + 0.5f - pad) * cell_b, (dilated_map.height - pad - b - 0.5f) * cell_b));
+					distances[p] = inside < 0.0f ? std::max(0.0f, inside + radius) : INFINITY;
+				}
+			propagate_distance(dilated_map, distances, blocked);
+			// pockets which air doesn't reach around the model are entered where they are the widest
+			std::vector<size_t> pockets;
+			const auto distance_from_model = distance_from_pixels(dilated_map, blocked);
+			const float* widths = distance_from_model.data();
+			while (true)
+			{
+				size_t widest = pixel_count;
+				for (size_t p = 0; p < pixel_count; ++p)
+					if (!blocked[p] && distances[p] == INFINITY && (widest == pixel_count || widths[p] > widths[widest]))
+						widest = p;
+				if (widest == pixel_count)
+					break;
+				pockets.push_back(widest);
+				distances[widest] = 0.0f;
+				propagate_distance(dilated_map, distances, blocked);
+			}
+
+			HeightMap distance(dilated_map.width, dilated_map.height, { dilated_map.size.x, 1.0f, dilated_map.size.z });
+			std::copy(distances.begin(), distances.end(), distance.data());
+			auto distance_at = [&](const Vector3& p) {
+				const auto coords = distance.position_to_pixel(p);
+				return distance.get_pixel(coords.y, coords.x);
+			};
+
+			// stays down to the contour (closed, with the first point repeated at the end) if cutter moves only over the stock already cleared by
+			// previous fronts of the level and above the model; otherwise leaves the previous front upwards to the top of the level, moves there
+			// to the contour if cutter stays above the model (otherwise above the stock) and ramps down along the contour; then mills it whole
+			auto mill_contour = [&](const std::vector<Vector3>& contour, float front_distance, float top) {
+				if (!path.empty())
+				{
+					const auto from = path.back(), to = contour.front();
+					const float length = Vector2{ to.x - from.x, to.z - from.z }.length();
+					bool stay_down = true;
+					const int samples = static_cast<int>(length / cell) + 2;
+					for (int s = 0; s < samples && stay_down; ++s)
+					{
+						const auto p = lerp(from, to, static_cast<float>(s) / (samples - 1));
+						stay_down = distance_at(p) <= front_distance + cell && p.y >= model_height_at(p) + h_epsilon;
+					}
+					if (stay_down)
+					{
+						path.insert(path.end(), contour.begin(), contour.end());
+						return;
+					}
+				}
+
+				const Vector3 entry = { contour.front().x, std::max(top, contour.front().y), contour.front().z };
+				if (!path.empty())
+				{
+					const auto from = path.back();
+					const Vector3 lifted = { from.x, std::max(top, from.y), from.z };
+					const float length = Vector2{ entry.x - lifted.x, entry.z - lifted.z }.length();
+					bool straight_clear = true;
+					const int samples = static_cast<int>(length / cell) + 2;
+					for (int s = 0; s < samples && straight_clear; ++s)
+					{
+						const auto p = lerp(lifted, entry, static_cast<float>(s) / (samples - 1));
+						straight_clear = p.y >= model_height_at(p) + h_epsilon;
+					}
+					if (straight_clear)
+						path.push_back(lifted);
+					else
+					{
+						path.push_back({ from.x, safe_height, from.z });
+						path.push_back({ entry.x, safe_height, entry.z });
+					}
+				}
+				path.push_back(entry);
+
+				const int count = static_cast<int>(contour.size()) - 1;
+				float perimeter = 0.0f, lowest = INFINITY;
+				for (int p = 0; p < count; ++p)
+				{
+					perimeter += Vector2{ contour[p + 1].x - contour[p].x, contour[p + 1].z - contour[p].z }.length();
+					lowest = std::min(lowest, contour[p].y);
+				}
+				// ramp descends until it reaches the lowest point of the contour; contours shorter than a cell are entered straight down
+				int end = 0;
+				const size_t ramp_start = path.size() - 1;
+				if (perimeter >= cell)
+				{
+					float ramp_length = 0.0f;
+					while (entry.y - RAMP_SLOPE * ramp_length > lowest)
+					{
+						const int next = (end + 1) % count;
+						ramp_length += Vector2{ contour[next].x - contour[end].x, contour[next].z - contour[end].z }.length();
+						end = next;
+						path.push_back({ contour[end].x, std::max(contour[end].y, entry.y - RAMP_SLOPE * ramp_length), contour[end].z });
+					}
+				}
+				ramps.push_back({ ramp_start, path.size() - 1 });
+				for (int p = 1; p <= count; ++p)
+					path.push_back(contour[(end + p) % count]);
+			};
+
+			float max_distance = 0.0f;
+			for (size_t p = 0; p < pixel_count; ++p)
+				if (!blocked[p])
+					max_distance = std::max(max_distance, distances[p]);
+			// fronts are evenly spaced by at most stepover, the last one within half the spacing from the farthest position of the cutter
+			const int fronts = max_distance > 0.0f ? std::max(1, static_cast<int>(ceilf(max_distance / stepover - 0.5f))) : 0;
+			const float spacing = max_distance / (fronts + 0.5f);
+			const size_t level_start = path.size();
+
+			for (int k = 0; k < fronts; ++k)
+			{
+				if (progress != nullptr)
+					progress->set_progress((levels - 1 - i + static_cast<float>(k) / fronts) / levels);
+
+				std::vector<std::vector<Vector3>> contours;
+				for (const auto& contour : MapContours::trace(distance, (k + 1) * spacing))
+				{
+					std::vector<Vector3> points;
+					points.reserve(contour.size());
+					for (const auto& pixel : contour)
+					{
+						const auto position = dilated_map.pixel_to_position({ pixel.y, pixel.x }); // map is transposed
+						points.push_back({ position.x, std::max(h, model_height_around(pixel)) + h_epsilon, position.y });
+					}
+					// climb milling (with clockwise spindle) keeps the stock, where distance grows, on the right of the cutter viewed from above
+					float stock_on_right = 0.0f;
+					for (size_t p = 0; p + 1 < points.size(); ++p)
+					{
+						const auto middle = 0.5f * (points[p] + points[p + 1]);
+						Vector3 right = { points[p].z - points[p + 1].z, 0.0f, points[p + 1].x - points[p].x };
+						const float right_length = right.length();
+						if (right_length == 0.0f)
+							continue;
+						right = (cell / right_length) * right;
+						stock_on_right += distance_at(middle + right) - distance_at(middle - right);
+					}
+					if (stock_on_right < 0.0f)
+						std::reverse(points.begin(), points.end());
+					contours.push_back(std::move(points));
+				}
+
+				// closed contours of a front are entered at their points nearest to the cutter
+				std::vector<char> milled(contours.size(), false);
+				for (size_t c = 0; c < contours.size(); ++c)
+				{
+					int best_contour = -1;
+					size_t best_point = 0;
+					float best_distance = INFINITY;
+					for (size_t other = 0; other < contours.size(); ++other)
+					{
+						if (milled[other])
+							continue;
+						for (size_t p = 0; p + 1 < contours[other].size(); ++p)
+						{
+							const float d = path.empty() ? 0.0f : Vector2{ contours[other][p].x - path.back().x, contours[other][p].z - path.back().z }.length();
+							if (d < best_distance)
+							{
+								best_distance = d;
+								best_contour = static_cast<int>(other);
+								best_point = p;
+							}
+						}
+					}
+					if (best_contour < 0)
+						break;
+					milled[best_contour] = true;
+					auto& contour = contours[best_contour];
+					contour.pop_back(); // the first point is repeated at the end
+					std::rotate(contour.begin(), contour.begin() + best_point, contour.end());
+					contour.push_back(contour.front());
+
+					mill_contour(contour, (k + 1) * spacing, previous_h + h_epsilon);
+				}
+			}
+			if constexpr (ApplicationSettings::DEBUG)
+			{
+				// the first fronts of pockets bore their entries at full width
+				for (const size_t pocket : pockets)
+					for (size_t p = 0; p < pixel_count; ++p)
+					{
+						const int da = static_cast<int>(p % dilated_map.width) - static_cast<int>(pocket % dilated_map.width);
+						const int db = static_cast<int>(p / dilated_map.width) - static_cast<int>(pocket / dilated_map.width);
+						if (Vector2{ da * cell_a, db * cell_b }.length() <= radius + spacing + cell)
+							stock[p] = false;
+					}
+				assert(max_engagement(path, level_start, ramps, dilated_map, stock, blocked, radius, h + h_epsilon + CLEARED_TOLERANCE, previous_h) <= stepover + ENGAGEMENT_TOLERANCE * cell);
+			}
+		}
+		if (!path.empty())
+			path.push_back({ path.back().x, safe_height, path.back().z });
+
+		return path;
+	}
+}
\ No newline at end of file
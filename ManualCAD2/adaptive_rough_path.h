@@ -0,0 +1,50 @@
+#pragma once
+
+#include "algebra.h"
+#include "object.h"
+#include "height_map.h"
+#include "height_map_renderer.h"
+#include "cutter.h"
+#include "generation_progress.h"
+#include <list>
+#include <vector>
+
+namespace ManualCAD
+{
+	// Rough paths with bounded radial engagement: at every level cutter advances into the remaining stock along fronts, which are contours
+	// of distance (in the space of cutter's center, around the model) from open air, where the cutter touches no stock of the level,
+	// spaced by at most stepover. Air is around the workpiece; pockets closed by the model are opened at their middles. Every front
+	// lies within stepover from the previous one, thus cutter never takes more than stepover of material sideways (unlike full-width
+	// rows of RoughPath) and may mill deeper levels at higher feed. As in RoughPath, cutter rides over the model (dilated by cutter) where it's above a level.
+	class AdaptiveRoughPath {
+		static constexpr int MAP_DIM = 300; // dilated map has about that many pixels along each side
+		static constexpr float CLEARED_TOLERANCE = 1e-3f; // previous level left no stock where the model is at most that much below it
+		static constexpr float RAMP_SLOPE = 0.2f; // descent per length of ramps entering fronts
+		static constexpr float ENGAGEMENT_TOLERANCE = 2.0f; // in cells, checked engagement may exceed stepover by rasterization of the stock
+
+		Box box;
+		float bottom_height;
+
+		const std::list<const ParametricSurfaceObject*>& surfaces;
+
+		// Squared Euclidean distance transform (lower envelope of parabolas) of a line of count values with given stride, which are
+		// squared distances of samples spaced by spacing.
+		static void distance_transform(double* values, int count, int stride, double spacing);
+		// Returns distance (in units of the map) from pixels for which seeds holds, in a map of the same layout.
+		static HeightMap distance_from_pixels(const HeightMap& map, const std::vector<char>& seeds);
+		// Lowers distances of pixels of map to shortest paths (on 16-neighbourhood, within about 1% of Euclidean lengths) from pixels
+		// with finite distances. Paths don't leave blocked pixels, but enter them, so that contours of distance continue over them.
+		static void propagate_distance(const HeightMap& map, std::vector<float>& distances, const std::vector<char>& blocked);
+		// Simulates removal of stock (pixels of map for which stock holds) by path points from the first one on, which lie below top
+		// and outside of ramps (ranges of points), and returns the largest radial engagement of the cutter (width of cut) on moves at floor
+		// or below. Stock at walls (pixels where the cutter can't go down) is left in slivers by fronts ending there and isn't counted.
+		// Used to check the fronts in debug builds.
+		static float max_engagement(const std::vector<Vector3>& path, size_t first, const std::vector<std::pair<size_t, size_t>>& ramps, const HeightMap& map, std::vector<char> stock, const std::vector<char>& walls, float radius, float floor, float top);
+	public:
+		AdaptiveRoughPath(const std::list<const ParametricSurfaceObject*>& surfaces, const Vector3& center, const Vector2& min, const Vector2& max, const float bottom_height, const float height, const float scale);
+
+		// Returns path in workpiece coordinates; fronts are milled in climb direction, from the outside in, and entered from the top of
+		// the level by ramps along them.
+		std::vector<Vector3> generate_path(int levels, const Vector3& size, const Cutter& cutter, const float stepover, const float h_epsilon, HeightMapRenderer::Backend backend = HeightMapRenderer::Backend::GPU, GenerationProgress* progress = nullptr);
+	};
+}
\ No newline at end of file
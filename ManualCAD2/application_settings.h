@@ -58,5 +58,7 @@ namespace ManualCAD
 		static constexpr std::clock_t COMPUTATION_TIMEOUT = CLOCKS_PER_SEC / 10;//3 * CLOCKS_PER_SEC;
 
 		static constexpr bool DEBUG = true;
+
+		static constexpr const char* GENERATION_CACHE_DIRECTORY = "generation_cache";
 	};
 }
\ No newline at end of file
@@ -0,0 +1,55 @@
+#include "corner_smoothing.h"
+#include <algorithm>
+#include <cmath>
+
+namespace ManualCAD
+{
+	std::vector<Vector3> CornerSmoothing::smooth(const std::vector<Vector3>& path, float tolerance, float chord_tolerance)
+	{
+		if (tolerance <= 0.0f || path.size() < 3)
+			return path;
+
+		std::vector<Vector3> result;
+		result.reserve(path.size());
+		result.push_back(path.front());
+		for (size_t i = 1; i + 1 < path.size(); ++i)
+		{
+			const auto& corner = path[i];
+			const auto in = corner - path[i - 1], out = path[i + 1] - corner;
+			const float in_length = in.length(), out_length = out.length();
+			if (in_length == 0.0f || out_length == 0.0f)
+			{
+				result.push_back(corner);
+				continue;
+			}
+			const auto in_direction = (1.0f / in_length) * in, out_direction = (1.0f / out_length) * out;
+			const float turn = acosf(std::clamp(dot(in_direction, out_direction), -1.0f, 1.0f));
+			if (turn < MIN_TURN || turn > MAX_TURN)
+			{
+				result.push_back(corner);
+				continue;
+			}
+
+			// arc of radius r in a corner with half-angle h touches segments r / tan(h) from the vertex and passes r (1 / sin(h) - 1) from it
+			const float half_angle = 0.5f * (PI - turn), sin_half = sinf(half_angle), cos_half = cosf(half_angle);
+			const float tangent = std::min({ tolerance * cos_half / (1.0f - sin_half), 0.5f * in_length, 0.5f * out_length });
+			const float radius = tangent * sin_half / cos_half;
+			const auto arc_center = corner + (radius / sin_half) * normalize(out_direction - in_direction);
+			// arc goes from to_start towards to_end by the turn angle, in their plane
+			const auto to_start = corner - tangent * in_direction - arc_center, to_end = corner + tangent * out_direction - arc_center;
+			const auto ortho = radius * normalize(to_end - (dot(to_end, to_start) / (radius * radius)) * to_start);
+
+			const float max_step = chord_tolerance < radius ? 2.0f * acosf(1.0f - chord_tolerance / radius) : turn;
+			const int segments = std::clamp(static_cast<int>(ceilf(turn / max_step)), 1, MAX_BLEND_SEGMENTS);
+			for (int k = 0; k <= segments; ++k)
+			{
+				const float angle = turn * k / segments;
+				const auto point = arc_center + cosf(angle) * to_start + sinf(angle) * ortho;
+				if (k > 0 || point != result.back()) // blends of corners of short segments meet in their middles
+					result.push_back(point);
+			}
+		}
+		result.push_back(path.back());
+		return result;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "algebra.h"
+#include <vector>
+
+namespace ManualCAD
+{
+	// Rounds sharp corners of contiguous paths with circular blends, sampled as polylines (programs are saved as linear moves only).
+	// Blend is tangent to both segments and lies inside the corner, at most tolerance away from its vertex; it takes at most
+	// half of each segment, so blends of neighbouring corners never overlap and every corner is processed once (linear time).
+	// Machine look-ahead passes blended corners at a speed growing with their radius instead of stopping at them.
+	class CornerSmoothing {
+		static constexpr float MIN_TURN = PI / 36.0f; // gentler turns are passed near feed anyway
+		static constexpr float MAX_TURN = PI - 1e-3f; // reversals along the same line can't be blended
+		static constexpr int MAX_BLEND_SEGMENTS = 32;
+	public:
+		// Polyline deviates from blends at most chord_tolerance; it should not exceed junction deviation of machine's look-ahead,
+		// otherwise vertices of polyline slow the cutter down again.
+		static std::vector<Vector3> smooth(const std::vector<Vector3>& path, float tolerance, float chord_tolerance);
+	};
+}
\ No newline at end of file
@@ -1,10 +1,46 @@
 #include "curve_path.h"
 #include "object.h"
-#include "polynomial_algorithms.h"
 
 namespace ManualCAD
 {
-    std::vector<std::vector<Vector3>> CurvePath::generate_paths() const
+    namespace
+    {
+        constexpr int MAX_SUBDIVISION_DEPTH = 16;
+
+        float distance_to_segment(const Vector3& p, const Vector3& a, const Vector3& b)
+        {
+            const auto ab = b - a;
+            const float length_sq = dot(ab, ab);
+            const float t = length_sq > 0.0f ? std::clamp(dot(p - a, ab) / length_sq, 0.0f, 1.0f) : 0.0f;
+            return (p - (a + t * ab)).length();
+        }
+
+        // appends points of the segment without b0 (which is already appended)
+        void flatten(const Vector3& b0, const Vector3& b1, const Vector3& b2, const Vector3& b3, float chord_tolerance, int depth, std::vector<Vector3>& points)
+        {
+            if (depth >= MAX_SUBDIVISION_DEPTH || std::max(distance_to_segment(b1, b0, b3), distance_to_segment(b2, b0, b3)) <= chord_tolerance)
+            {
+                points.push_back(b3);
+                return;
+            }
+
+            const auto b01 = 0.5f * (b0 + b1), b12 = 0.5f * (b1 + b2), b23 = 0.5f * (b2 + b3);
+            const auto b012 = 0.5f * (b01 + b12), b123 = 0.5f * (b12 + b23);
+            const auto middle = 0.5f * (b012 + b123);
+            flatten(b0, b01, b012, middle, chord_tolerance, depth + 1, points);
+            flatten(middle, b123, b23, b3, chord_tolerance, depth + 1, points);
+        }
+
+        // Wang's formula: number of uniform pieces which keep a cubic segment within tolerance; it bounds the number of adaptive pieces
+        // up to a small factor, so it is used to reserve space
+        size_t estimate_pieces(const Vector3& b0, const Vector3& b1, const Vector3& b2, const Vector3& b3, float chord_tolerance)
+        {
+            const float m = std::max((b0 - 2.0f * b1 + b2).length(), (b1 - 2.0f * b2 + b3).length());
+            return static_cast<size_t>(ceilf(sqrtf(0.75f * m / chord_tolerance))) + 1;
+        }
+    }
+
+    std::vector<std::vector<Vector3>> CurvePath::generate_paths(float chord_tolerance) const
     {
         std::vector<std::vector<Vector3>> result;
         result.reserve(beziers.size());
@@ -15,17 +51,15 @@ namespace ManualCAD
                 assert(bezier.size() % 3 == 1);
 
             size_t curves = bezier.size() / 3;
-            const int steps = 20;
+            size_t pieces = 1;
+            for (int i = 0; i < curves; ++i)
+                pieces += estimate_pieces(bezier[3 * i], bezier[3 * i + 1], bezier[3 * i + 2], bezier[3 * i + 3], chord_tolerance);
             std::vector<Vector3> curve;
-            curve.reserve(steps * curves + 1);
-            const float step = 1.0f / steps;
+            curve.reserve(pieces);
+            curve.push_back(bezier.front());
             for (int i = 0; i < curves; ++i)
-            {
-                for (int t = 0; t < steps; ++t)
-                    curve.push_back(PolynomialAlgorithms::de_casteljau(bezier[3 * i], bezier[3 * i + 1], bezier[3 * i + 2], bezier[3 * i + 3], t * step));
-            }
-            curve.push_back(bezier.back());
-            result.push_back(curve);
+                flatten(bezier[3 * i], bezier[3 * i + 1], bezier[3 * i + 2], bezier[3 * i + 3], chord_tolerance, 0, curve);
+            result.push_back(std::move(curve));
         }
 
         return result;
@@ -12,7 +12,9 @@ namespace ManualCAD
 		void add_curve_bezier_points(const std::vector<Vector3>& points) { beziers.push_back(points); }
 		void add_curve_bezier_points(std::vector<Vector3>&& points) { beziers.push_back(std::move(points)); }
 
-		std::vector<std::vector<Vector3>> generate_paths() const;
+		// Flattens every cubic segment adaptively: it is halved (de Casteljau) until its control points are at most chord_tolerance
+		// away from its chord, which bounds distance of the curve from the path.
+		std::vector<std::vector<Vector3>> generate_paths(float chord_tolerance) const;
 		void project_curves(float y);
 	};
 }
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "cutter.h"
 #include "logger.h"
+#include <algorithm>
 
 namespace ManualCAD
 {
@@ -52,6 +53,20 @@ namespace ManualCAD
 		return radius - sqrtf(radius * radius - distance * distance);
 	}
 
+	float BallCutter::get_lowest_height_on_move(float along, float across_sq, float length, float from_height, float slope) const
+	{
+		// cross-section of the ball over the point is a half circle of radius rho along the move
+		const float rho = sqrtf(radius * radius - across_sq);
+		const float lower = std::max(0.0f, along - rho), upper = std::min(length, along + rho);
+		if (lower > upper)
+			return NAN;
+
+		// height is convex in position along the move, thus its minimum is the stationary point clamped to the feasible range
+		const float t = std::clamp(along - slope * rho / sqrtf(1.0f + slope * slope), lower, upper);
+		const float w = along - t;
+		return from_height + slope * t + radius - sqrtf(std::max(0.0f, rho * rho - w * w));
+	}
+
 	void BallCutter::generate_cutter_mesh(TriangleMesh& mesh) const
 	{
 		mesh.generate_bottom_capsule(radius, 10.0f, 10); // TODO cutter height!!! -> pobawi si z vertex shaderem
@@ -84,6 +99,16 @@ namespace ManualCAD
 		return 0.0f;
 	}
 
+	float FlatCutter::get_lowest_height_on_move(float along, float across_sq, float length, float from_height, float slope) const
+	{
+		const float rho = sqrtf(radius * radius - across_sq);
+		const float lower = std::max(0.0f, along - rho), upper = std::min(length, along + rho);
+		if (lower > upper)
+			return NAN;
+
+		return from_height + slope * (slope > 0.0f ? lower : upper);
+	}
+
 	void FlatCutter::generate_cutter_mesh(TriangleMesh& mesh) const
 	{
 		mesh.generate_cylinder(radius, 10.0f, 10); // TODO cutter height!!! -> pobawi si z vertex shaderem
@@ -20,6 +20,9 @@ namespace ManualCAD
 		void cut_pixel(HeightMap& height_map, int instruction_number, int x, int y, float height, float max_depth) const;
 		virtual void cut_pixel_virtual(HeightMap& height_map, int instruction_number, int x, int y, float height, float max_depth) const = 0;
 		virtual float get_height_offset(const float& distance) const = 0;
+		// Lowest height of cutter surface over a point during a linear move, or NAN if cutter doesn't pass over the point.
+		// Point is given by its offsets along the move and (squared) across the move; move starts at from_height and has given slope.
+		virtual float get_lowest_height_on_move(float along, float across_sq, float length, float from_height, float slope) const = 0;
 		virtual void generate_cutter_mesh(TriangleMesh& mesh) const = 0;
 		virtual const char* get_type() const = 0;
 		char get_type_char() const { return type_char; }
@@ -38,6 +41,7 @@ namespace ManualCAD
 
 		void cut_pixel_virtual(HeightMap& height_map, int instruction_number, int x, int y, float height, float max_depth) const override;
 		float get_height_offset(const float& distance) const override;
+		float get_lowest_height_on_move(float along, float across_sq, float length, float from_height, float slope) const override;
 		void generate_cutter_mesh(TriangleMesh& mesh) const override;
 		const char* get_type() const override { return "Ball"; }
 	};
@@ -48,6 +52,7 @@ namespace ManualCAD
 
 		void cut_pixel_virtual(HeightMap& height_map, int instruction_number, int x, int y, float height, float max_depth) const override;
 		float get_height_offset(const float& distance) const override;
+		float get_lowest_height_on_move(float along, float across_sq, float length, float from_height, float slope) const override;
 		void generate_cutter_mesh(TriangleMesh& mesh) const override;
 		const char* get_type() const override { return "Flat"; }
 	};
@@ -0,0 +1,220 @@
+#include "dexel_map.h"
+#include "logger.h"
+#include <algorithm>
+
+namespace ManualCAD
+{
+	uint32_t DexelMap::allocate(float bottom, float top, uint32_t next)
+	{
+		++segment_count;
+		if (free_list == NO_SEGMENT)
+		{
+			pool.push_back({ bottom, top, next });
+			return static_cast<uint32_t>(pool.size() - 1);
+		}
+		uint32_t idx = free_list;
+		free_list = pool[idx].next;
+		pool[idx] = { bottom, top, next };
+		return idx;
+	}
+
+	void DexelMap::release(uint32_t idx)
+	{
+		--segment_count;
+		pool[idx].next = free_list;
+		free_list = idx;
+	}
+
+	void DexelMap::link(uint32_t dexel_idx, uint32_t previous, uint32_t segment)
+	{
+		if (previous == NO_SEGMENT)
+			heads[dexel_idx] = segment;
+		else
+			pool[previous].next = segment;
+	}
+
+	float DexelMap::subtract(uint32_t dexel_idx, float bottom, float top)
+	{
+		float removed = 0.0f;
+		uint32_t previous = NO_SEGMENT, current = heads[dexel_idx];
+		while (current != NO_SEGMENT && pool[current].bottom < top)
+		{
+			Segment& segment = pool[current];
+			const uint32_t next = segment.next;
+			if (segment.top <= bottom)
+			{
+				previous = current;
+				current = next;
+				continue;
+			}
+
+			if (segment.bottom >= bottom && segment.top <= top) // whole segment removed
+			{
+				removed += segment.top - segment.bottom;
+				release(current);
+				link(dexel_idx, previous, next);
+			}
+			else if (segment.bottom < bottom && segment.top > top) // split in two
+			{
+				removed += top - bottom;
+				const float upper_top = segment.top;
+				segment.top = bottom;
+				const uint32_t upper = allocate(top, upper_top, next); // may reallocate the pool, so segment is not used anymore
+				pool[current].next = upper;
+				return removed;
+			}
+			else if (segment.bottom < bottom) // upper part removed
+			{
+				removed += segment.top - bottom;
+				segment.top = bottom;
+				previous = current;
+			}
+			else // lower part removed
+			{
+				removed += top - segment.bottom;
+				segment.bottom = top;
+				return removed;
+			}
+			current = next;
+		}
+		return removed;
+	}
+
+	float DexelMap::get_top(uint32_t dexel_idx) const
+	{
+		float top = 0.0f;
+		for (uint32_t current = heads[dexel_idx]; current != NO_SEGMENT; current = pool[current].next)
+			top = pool[current].top;
+		return top;
+	}
+
+	void DexelMap::fill(const Vector3& size)
+	{
+		this->size = size;
+		const size_t count = static_cast<size_t>(width) * height;
+		pool.resize(count);
+		heads.resize(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			pool[i] = { 0.0f, size.y, NO_SEGMENT };
+			heads[i] = static_cast<uint32_t>(i);
+		}
+		free_list = NO_SEGMENT;
+		segment_count = count;
+		removed_volume = 0.0;
+	}
+
+	void DexelMap::resize(int size_x, int size_y, const Vector3& size)
+	{
+		width = size_x;
+		height = size_y;
+		fill(size);
+	}
+
+	void DexelMap::add_material(int x, int y, float bottom, float top)
+	{
+		if (x < 0 || x >= width || y < 0 || y >= height || bottom >= top)
+			return;
+
+		const uint32_t dexel_idx = x + y * width;
+		uint32_t previous = NO_SEGMENT, current = heads[dexel_idx];
+		while (current != NO_SEGMENT && pool[current].top < bottom)
+		{
+			previous = current;
+			current = pool[current].next;
+		}
+		while (current != NO_SEGMENT && pool[current].bottom <= top)
+		{
+			bottom = std::min(bottom, pool[current].bottom);
+			top = std::max(top, pool[current].top);
+			const uint32_t next = pool[current].next;
+			release(current);
+			current = next;
+		}
+		link(dexel_idx, previous, allocate(bottom, top, current));
+	}
+
+	float DexelMap::remove_material(int x, int y, float bottom, float top)
+	{
+		if (x < 0 || x >= width || y < 0 || y >= height || bottom >= top)
+			return 0.0f;
+
+		const float removed = subtract(x + y * width, bottom, top) * get_cell_area();
+		removed_volume += removed;
+		return removed;
+	}
+
+	void DexelMap::cut_move(const Cutter& cutter, int instruction_number, const Vector3& from, const Vector3& to, float max_depth)
+	{
+		if (size.y - std::min(from.y, to.y) > max_depth)
+			Logger::log_warning("[WARNING] N%d: Cutter too deep\n", instruction_number);
+
+		const Vector2 from_cell = position_to_cell(from), to_cell = position_to_cell(to);
+		const int from_x = lroundf(from_cell.x), from_y = lroundf(from_cell.y);
+		if (from_x == lroundf(to_cell.x) && from_y == lroundf(to_cell.y) && get_height(from_x, from_y) > to.y)
+			Logger::log_warning("[WARNING] N%d at (%d,%d): Cutting workpiece with cutter's tip (cutter going straight down)\n", instruction_number, from_x, from_y);
+
+		const float radius = cutter.get_radius();
+		const Vector2 origin = { from.x, from.z }, move = Vector2{ to.x, to.z } - origin;
+		const float length = move.length();
+		const Vector2 direction = length > 0.0f ? (1.0f / length) * move : Vector2{ 1.0f, 0.0f };
+		const float slope = length > 0.0f ? (to.y - from.y) / length : 0.0f;
+		const float from_height = length > 0.0f ? from.y : std::min(from.y, to.y);
+
+		const int lbound_x = std::max(0, static_cast<int>(floorf(std::min(from_cell.x, to_cell.x) - radius / size.x * width))),
+			rbound_x = std::min(width - 1, static_cast<int>(ceilf(std::max(from_cell.x, to_cell.x) + radius / size.x * width))),
+			lbound_y = std::max(0, static_cast<int>(floorf(std::min(from_cell.y, to_cell.y) - radius / size.z * height))),
+			rbound_y = std::min(height - 1, static_cast<int>(ceilf(std::max(from_cell.y, to_cell.y) + radius / size.z * height)));
+
+		const float cell_area = get_cell_area();
+		for (int j = lbound_y; j <= rbound_y; ++j)
+			for (int i = lbound_x; i <= rbound_x; ++i)
+			{
+				const Vector2 offset = cell_to_position(i, j) - origin;
+				const float along = dot(offset, direction);
+				const float across_sq = std::max(0.0f, offset.lengthsq() - along * along);
+				if (across_sq > radius * radius)
+					continue;
+
+				const float bottom = cutter.get_lowest_height_on_move(along, across_sq, length, from_height, slope);
+				if (isnan(bottom))
+					continue;
+
+				const uint32_t dexel_idx = i + j * width;
+				if (get_top(dexel_idx) > bottom + cutter.cutting_part_height)
+					Logger::log_warning("[WARNING] N%d at (%d,%d): Using non-cutting part\n", instruction_number, i, j);
+				removed_volume += subtract(dexel_idx, bottom, INFINITY) * cell_area;
+			}
+	}
+
+	void DexelMap::to_height_map(HeightMap& height_map) const
+	{
+		height_map.size = size;
+		float* pixels = height_map.data();
+		for (int y = 0; y < height_map.height; ++y)
+		{
+			const int j = std::min(height - 1, y * height / height_map.height);
+			for (int x = 0; x < height_map.width; ++x)
+			{
+				const int i = std::min(width - 1, x * width / height_map.width);
+				pixels[x + y * height_map.width] = get_top(i + j * width) / size.y;
+			}
+		}
+	}
+
+	float DexelMap::get_height(int x, int y) const
+	{
+		if (x < 0 || x >= width || y < 0 || y >= height)
+			return 0.0f;
+		return get_top(x + y * width);
+	}
+
+	double DexelMap::get_material_volume() const
+	{
+		double length = 0.0;
+		for (uint32_t head : heads)
+			for (uint32_t current = head; current != NO_SEGMENT; current = pool[current].next)
+				length += pool[current].top - pool[current].bottom;
+		return length * get_cell_area();
+	}
+}
\ No newline at end of file
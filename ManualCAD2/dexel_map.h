@@ -0,0 +1,77 @@
+#pragma once
+
+#include "algebra.h"
+#include "height_map.h"
+#include "cutter.h"
+#include <vector>
+#include <cstdint>
+
+namespace ManualCAD
+{
+	// Workpiece represented by vertical rays (dexels) over XZ grid; every dexel stores sorted, disjoint segments of material.
+	// Unlike HeightMap it can hold material below an overhang, and removed volume is exact up to the grid resolution.
+	class DexelMap {
+		static constexpr uint32_t NO_SEGMENT = UINT32_MAX;
+
+		struct Segment {
+			float bottom, top;
+			uint32_t next;
+		};
+
+		// segments of all dexels are kept in one pool; released segments are chained in a free list
+		std::vector<Segment> pool;
+		std::vector<uint32_t> heads; // lowest segment of every dexel
+		uint32_t free_list = NO_SEGMENT;
+		size_t segment_count = 0;
+		double removed_volume = 0.0;
+
+		uint32_t allocate(float bottom, float top, uint32_t next);
+		void release(uint32_t idx);
+		void link(uint32_t dexel_idx, uint32_t previous, uint32_t segment);
+		float subtract(uint32_t dexel_idx, float bottom, float top);
+		float get_top(uint32_t dexel_idx) const;
+	public:
+		int width = 0, height = 0;
+
+		Vector3 size;
+
+		DexelMap() {}
+		DexelMap(int size_x, int size_y, const Vector3& size) { resize(size_x, size_y, size); }
+
+		// Fills every dexel with a single segment of full stock.
+		void fill(const Vector3& size);
+		void resize(int size_x, int size_y, const Vector3& size);
+
+		// Adds material (e.g. a fixture or stock with an overhang) to a dexel, merging with overlapping segments.
+		void add_material(int x, int y, float bottom, float top);
+		// Removes material between given heights from a dexel; returns removed volume.
+		float remove_material(int x, int y, float bottom, float top);
+
+		// Subtracts volume swept by cutter moving linearly between given positions. As with HeightMap, cutter together with its holder
+		// removes everything above its surface, thus material under an overhang is removed only if the cutter reaches it from below.
+		void cut_move(const Cutter& cutter, int instruction_number, const Vector3& from, const Vector3& to, float max_depth);
+
+		// Writes height of the topmost material of every height map pixel (resampled with nearest dexel), keeping height map resolution.
+		void to_height_map(HeightMap& height_map) const;
+
+		float get_height(int x, int y) const;
+		float get_cell_area() const { return size.x / width * size.z / height; }
+		double get_removed_volume() const { return removed_volume; }
+		double get_material_volume() const;
+		size_t get_segment_count() const { return segment_count; }
+
+		inline Vector2 position_to_cell(const Vector3& pos) const {
+			return {
+				(pos.x / size.x + 0.5f) * width,
+				(pos.z / size.z + 0.5f) * height
+			};
+		}
+
+		inline Vector2 cell_to_position(int x, int y) const {
+			return {
+				(static_cast<float>(x) / width - 0.5f) * size.x,
+				(static_cast<float>(y) / height - 0.5f) * size.z
+			};
+		}
+	};
+}
\ No newline at end of file
@@ -21,4 +21,9 @@ namespace ManualCAD
 	public:
 		TimeoutException() : std::exception() {}
 	};
+
+	class GenerationCancelledException : public std::exception {
+	public:
+		GenerationCancelledException() : std::exception("Generation cancelled") {}
+	};
 }
\ No newline at end of file
@@ -0,0 +1,330 @@
+#include "generation_cache.h"
+#include "logger.h"
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace ManualCAD
+{
+	namespace
+	{
+		constexpr uint32_t INTERSECTIONS_MAGIC = 0x43455349, OWNERSHIP_MAP_MAGIC = 0x50414d4f; // "ISEC", "OMAP" read as little endian
+		constexpr uint32_t FORMAT_VERSION = 2; // files of other versions are ignored (and overwritten when results are stored again)
+
+		template <class T>
+		void write_value(std::ofstream& s, const T& value)
+		{
+			s.write(reinterpret_cast<const char*>(&value), sizeof(T));
+		}
+
+		template <class T>
+		bool read_value(std::ifstream& s, T& value)
+		{
+			return static_cast<bool>(s.read(reinterpret_cast<char*>(&value), sizeof(T)));
+		}
+
+		// Counts read from files are checked against it before anything is allocated, since files may be truncated or damaged.
+		uint64_t remaining_bytes(std::ifstream& s)
+		{
+			const auto position = s.tellg();
+			s.seekg(0, std::ios::end);
+			const auto end = s.tellg();
+			s.seekg(position);
+			return position < 0 || end < position ? 0 : static_cast<uint64_t>(end - position);
+		}
+
+		// Files are written under temporary names and then renamed, so threads storing or reading the same key never see a partial file.
+		std::filesystem::path temporary_path(const std::filesystem::path& path)
+		{
+			static std::atomic<uint64_t> counter{ 0 };
+			auto result = path;
+			result += ".tmp" + std::to_string(counter++);
+			return result;
+		}
+
+		void replace_file(std::ofstream& s, const std::filesystem::path& temporary, const std::filesystem::path& path)
+		{
+			s.close();
+			std::error_code error;
+			if (s)
+				std::filesystem::rename(temporary, path, error);
+			if (!s || error)
+			{
+				Logger::log_warning("[WARNING] Cannot write cache file %s\n", path.string().c_str());
+				std::filesystem::remove(temporary, error);
+			}
+		}
+
+		void write_points(std::ofstream& s, const std::vector<Vector2>& points)
+		{
+			write_value(s, static_cast<uint64_t>(points.size()));
+			s.write(reinterpret_cast<const char*>(points.data()), points.size() * sizeof(Vector2));
+		}
+
+		bool read_points(std::ifstream& s, std::vector<Vector2>& points)
+		{
+			uint64_t count;
+			if (!read_value(s, count) || count > remaining_bytes(s) / sizeof(Vector2))
+				return false;
+			points.resize(count);
+			return static_cast<bool>(s.read(reinterpret_cast<char*>(points.data()), count * sizeof(Vector2)));
+		}
+	}
+
+	GenerationCache::Key& GenerationCache::Key::add(uint64_t x)
+	{
+		for (int i = 0; i < 8; ++i)
+		{
+			value ^= (x >> (8 * i)) & 0xff;
+			value *= 1099511628211ull;
+		}
+		return *this;
+	}
+
+	GenerationCache::Key& GenerationCache::Key::add(float x)
+	{
+		uint32_t bits;
+		std::memcpy(&bits, &x, sizeof(bits));
+		return add(static_cast<uint64_t>(bits));
+	}
+
+	GenerationCache::Key& GenerationCache::Key::add(const ParametricSurface& surface)
+	{
+		constexpr int SAMPLES = 4;
+		const auto u_range = surface.get_u_range(), v_range = surface.get_v_range();
+		add(u_range.from).add(u_range.to).add(v_range.from).add(v_range.to);
+		for (const auto& patch : surface.get_patch_bounds())
+			for (int i = 0; i < SAMPLES; ++i)
+				for (int j = 0; j < SAMPLES; ++j)
+					add(surface.evaluate(lerp(patch.us.from, patch.us.to, (i + 0.5f) / SAMPLES), lerp(patch.vs.from, patch.vs.to, (j + 0.5f) / SAMPLES)));
+		return *this;
+	}
+
+	GenerationCache& GenerationCache::session()
+	{
+		static GenerationCache cache;
+		return cache;
+	}
+
+	void GenerationCache::set_directory(const std::filesystem::path& directory)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		this->directory = directory;
+		if (directory.empty())
+			return;
+
+		std::error_code error;
+		std::filesystem::create_directories(directory, error);
+		if (error)
+		{
+			Logger::log_warning("[WARNING] Cannot create cache directory %s: %s\n", directory.string().c_str(), error.message().c_str());
+			this->directory.clear();
+		}
+	}
+
+	std::filesystem::path GenerationCache::get_directory()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return directory;
+	}
+
+	void GenerationCache::clear()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		intersections.clear();
+		ownership_maps.clear();
+		ownership_map_order.clear();
+	}
+
+	std::filesystem::path GenerationCache::get_file_path(uint64_t key, const char* extension) const
+	{
+		char name[32];
+		snprintf(name, sizeof(name), "%016llx.%s", static_cast<unsigned long long>(key), extension);
+		return directory / name;
+	}
+
+	bool GenerationCache::read_intersections(const std::filesystem::path& path, std::vector<StoredIntersection>& stored)
+	{
+		std::ifstream s(path, std::ios::binary);
+		uint32_t magic, version;
+		uint64_t count;
+		// every intersection takes at least two counts of points and flags
+		if (!read_value(s, magic) || magic != INTERSECTIONS_MAGIC || !read_value(s, version) || version != FORMAT_VERSION || !read_value(s, count)
+			|| count > remaining_bytes(s) / (2 * sizeof(uint64_t) + sizeof(uint8_t)))
+			return false;
+
+		stored.resize(count);
+		for (auto& isec : stored)
+		{
+			uint8_t flags;
+			if (!read_points(s, isec.uvs1) || !read_points(s, isec.uvs2) || !read_value(s, flags))
+				return false;
+			isec.looped = flags & 1;
+			isec.singular_crossed = flags & 2;
+			isec.too_short = flags & 4;
+		}
+		return true;
+	}
+
+	void GenerationCache::write_intersections(const std::filesystem::path& path, const std::vector<StoredIntersection>& stored)
+	{
+		const auto temporary = temporary_path(path);
+		std::ofstream s(temporary, std::ios::binary);
+		write_value(s, INTERSECTIONS_MAGIC);
+		write_value(s, FORMAT_VERSION);
+		write_value(s, static_cast<uint64_t>(stored.size()));
+		for (const auto& isec : stored)
+		{
+			write_points(s, isec.uvs1);
+			write_points(s, isec.uvs2);
+			write_value(s, static_cast<uint8_t>((isec.looped ? 1 : 0) | (isec.singular_crossed ? 2 : 0) | (isec.too_short ? 4 : 0)));
+		}
+		replace_file(s, temporary, path);
+	}
+
+	bool GenerationCache::read_ownership_map(const std::filesystem::path& path, OwnershipMap& map)
+	{
+		std::ifstream s(path, std::ios::binary);
+		uint32_t magic, version;
+		int width, height;
+		Vector3 size;
+		uint64_t run_count;
+		if (!read_value(s, magic) || magic != OWNERSHIP_MAP_MAGIC || !read_value(s, version) || version != FORMAT_VERSION || !read_value(s, width) || !read_value(s, height) || !read_value(s, size)
+			|| !read_value(s, run_count) || width <= 0 || width > UINT16_MAX + 1 || height <= 0)
+			return false;
+		const uint64_t offsets_bytes = (static_cast<uint64_t>(height) + 1) * sizeof(uint32_t);
+		const uint64_t bytes = remaining_bytes(s);
+		if (offsets_bytes > bytes || run_count > (bytes - offsets_bytes) / sizeof(OwnershipMap::Run))
+			return false;
+
+		map = OwnershipMap(width, size);
+		map.height = height;
+		map.row_offsets.resize(static_cast<size_t>(height) + 1);
+		map.runs.resize(run_count);
+		if (!s.read(reinterpret_cast<char*>(map.row_offsets.data()), map.row_offsets.size() * sizeof(uint32_t))
+			|| !s.read(reinterpret_cast<char*>(map.runs.data()), run_count * sizeof(OwnershipMap::Run)))
+			return false;
+		// offsets and starts of runs are checked, since queries trust them
+		if (map.row_offsets.front() != 0 || map.row_offsets.back() != run_count)
+			return false;
+		for (int y = 0; y < height; ++y)
+		{
+			const uint32_t first = map.row_offsets[y], last = map.row_offsets[y + 1];
+			if (first >= last || last > run_count || map.runs[first].start != 0)
+				return false;
+			for (uint32_t r = first + 1; r < last; ++r)
+				if (map.runs[r].start <= map.runs[r - 1].start || map.runs[r].start >= width)
+					return false;
+		}
+		return true;
+	}
+
+	void GenerationCache::write_ownership_map(const std::filesystem::path& path, const OwnershipMap& map)
+	{
+		const auto temporary = temporary_path(path);
+		std::ofstream s(temporary, std::ios::binary);
+		write_value(s, OWNERSHIP_MAP_MAGIC);
+		write_value(s, FORMAT_VERSION);
+		write_value(s, map.width);
+		write_value(s, map.height);
+		write_value(s, map.size);
+		write_value(s, static_cast<uint64_t>(map.runs.size()));
+		s.write(reinterpret_cast<const char*>(map.row_offsets.data()), map.row_offsets.size() * sizeof(uint32_t));
+		s.write(reinterpret_cast<const char*>(map.runs.data()), map.runs.size() * sizeof(OwnershipMap::Run));
+		replace_file(s, temporary, path);
+	}
+
+	std::optional<std::list<ParametricSurfaceIntersection>> GenerationCache::find_intersections(uint64_t key, const ParametricSurface& surf1, const ParametricSurface& surf2)
+	{
+		// files are read and written without the lock, thus other threads aren't blocked by disk
+		std::vector<StoredIntersection> stored;
+		std::filesystem::path path;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			auto it = intersections.find(key);
+			if (it != intersections.end())
+				stored = it->second;
+			else if (directory.empty())
+				return std::nullopt;
+			else
+				path = get_file_path(key, "isec");
+		}
+		if (!path.empty())
+		{
+			if (!read_intersections(path, stored))
+				return std::nullopt;
+			std::lock_guard<std::mutex> lock(mutex);
+			intersections.insert({ key, stored });
+		}
+
+		std::list<ParametricSurfaceIntersection> result;
+		for (auto& isec : stored)
+			result.push_back(ParametricSurfaceIntersection(surf1, surf2, std::move(isec.uvs1), std::move(isec.uvs2), isec.looped, isec.singular_crossed, isec.too_short));
+		return result;
+	}
+
+	void GenerationCache::store_intersections(uint64_t key, const std::list<ParametricSurfaceIntersection>& result)
+	{
+		std::vector<StoredIntersection> stored;
+		stored.reserve(result.size());
+		for (const auto& isec : result)
+			stored.push_back({ isec.get_uvs1(), isec.get_uvs2(), isec.is_looped(), isec.is_singular_crossed(), isec.is_too_short() });
+
+		std::filesystem::path path;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!directory.empty())
+				path = get_file_path(key, "isec");
+			intersections[key] = stored;
+		}
+		if (!path.empty())
+			write_intersections(path, stored);
+	}
+
+	void GenerationCache::insert_ownership_map(uint64_t key, const OwnershipMap& map)
+	{
+		if (ownership_maps.count(key) == 0)
+			ownership_map_order.push_back(key);
+		ownership_maps[key] = map;
+		while (ownership_map_order.size() > OWNERSHIP_MAP_CAPACITY)
+		{
+			ownership_maps.erase(ownership_map_order.front());
+			ownership_map_order.pop_front();
+		}
+	}
+
+	std::optional<OwnershipMap> GenerationCache::find_ownership_map(uint64_t key)
+	{
+		std::filesystem::path path;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			auto it = ownership_maps.find(key);
+			if (it != ownership_maps.end())
+				return it->second;
+			if (directory.empty())
+				return std::nullopt;
+			path = get_file_path(key, "omap");
+		}
+
+		OwnershipMap map;
+		if (!read_ownership_map(path, map))
+			return std::nullopt;
+		std::lock_guard<std::mutex> lock(mutex);
+		insert_ownership_map(key, map);
+		return map;
+	}
+
+	void GenerationCache::store_ownership_map(uint64_t key, const OwnershipMap& map)
+	{
+		std::filesystem::path path;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!directory.empty())
+				path = get_file_path(key, "omap");
+			insert_ownership_map(key, map);
+		}
+		if (!path.empty())
+			write_ownership_map(path, map);
+	}
+}
\ No newline at end of file
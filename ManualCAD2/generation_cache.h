@@ -0,0 +1,70 @@
+#pragma once
+
+#include "parametric_surface.h"
+#include "parametric_surface_intersection.h"
+#include "ownership_map.h"
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ManualCAD
+{
+	// Results of expensive steps of path generation (surface intersections and ownership maps), keyed by hashes of surface geometry and
+	// generation parameters. Results live for the whole session and, when a directory is set, are also stored on disk.
+	// All methods may be called from many threads.
+	class GenerationCache {
+		static constexpr size_t OWNERSHIP_MAP_CAPACITY = 16; // only the most recent maps are kept in memory
+
+		struct StoredIntersection {
+			std::vector<Vector2> uvs1, uvs2;
+			bool looped, singular_crossed, too_short;
+		};
+
+		std::mutex mutex;
+		std::unordered_map<uint64_t, std::vector<StoredIntersection>> intersections;
+		std::unordered_map<uint64_t, OwnershipMap> ownership_maps;
+		std::list<uint64_t> ownership_map_order; // from the oldest
+		std::filesystem::path directory;
+
+		std::filesystem::path get_file_path(uint64_t key, const char* extension) const;
+		static bool read_intersections(const std::filesystem::path& path, std::vector<StoredIntersection>& stored);
+		static void write_intersections(const std::filesystem::path& path, const std::vector<StoredIntersection>& stored);
+		static bool read_ownership_map(const std::filesystem::path& path, OwnershipMap& map);
+		static void write_ownership_map(const std::filesystem::path& path, const OwnershipMap& map);
+		void insert_ownership_map(uint64_t key, const OwnershipMap& map);
+	public:
+		// Incremental 64-bit FNV-1a hash of floats (bitwise) and integers.
+		class Key {
+			uint64_t value = 14695981039346656037ull;
+		public:
+			Key& add(uint64_t x);
+			Key& add(int x) { return add(static_cast<uint64_t>(static_cast<uint32_t>(x))); }
+			Key& add(float x);
+			Key& add(const Vector3& v) { return add(v.x).add(v.y).add(v.z); }
+			// Hashes points sampled on a 4x4 grid inside every patch; 16 samples determine a bicubic patch, thus any change of control points changes the hash.
+			Key& add(const ParametricSurface& surface);
+
+			uint64_t get() const { return value; }
+		};
+
+		static GenerationCache& session();
+
+		// Sets directory for files of the cache (created if needed); empty path keeps the cache in memory only.
+		void set_directory(const std::filesystem::path& directory);
+		std::filesystem::path get_directory();
+		// Removes results kept in memory (files on disk are left).
+		void clear();
+
+		// Returns stored intersections rebuilt for given surfaces, if they were stored under given key.
+		std::optional<std::list<ParametricSurfaceIntersection>> find_intersections(uint64_t key, const ParametricSurface& surf1, const ParametricSurface& surf2);
+		void store_intersections(uint64_t key, const std::list<ParametricSurfaceIntersection>& result);
+
+		std::optional<OwnershipMap> find_ownership_map(uint64_t key);
+		void store_ownership_map(uint64_t key, const OwnershipMap& map);
+	};
+}
\ No newline at end of file
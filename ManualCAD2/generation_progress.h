@@ -0,0 +1,52 @@
+#pragma once
+
+#include "exception.h"
+#include <atomic>
+
+namespace ManualCAD
+{
+	// Progress of program generation, reported by a worker thread and read (or cancelled) by the main thread.
+	class GenerationProgress {
+	public:
+		enum class Stage {
+			Waiting, Intersecting, Rendering, ZigZag, Contouring, Linking
+		};
+	private:
+		std::atomic<Stage> stage{ Stage::Waiting };
+		std::atomic<float> stage_progress{ 0.0f };
+		std::atomic<bool> cancelled{ false };
+	public:
+		// Starts new stage with zero progress. Throws GenerationCancelledException if generation was cancelled.
+		void set_stage(Stage stage) {
+			check_cancelled();
+			this->stage = stage;
+			stage_progress = 0.0f;
+		}
+		// Sets progress of current stage (from 0 to 1). Throws GenerationCancelledException if generation was cancelled.
+		void set_progress(float progress) {
+			check_cancelled();
+			stage_progress = progress;
+		}
+		void check_cancelled() const {
+			if (cancelled)
+				throw GenerationCancelledException();
+		}
+
+		void cancel() { cancelled = true; }
+		bool is_cancelled() const { return cancelled; }
+
+		Stage get_stage() const { return stage; }
+		float get_progress() const { return stage_progress; }
+		const char* get_stage_name() const {
+			switch (stage.load())
+			{
+			case Stage::Intersecting: return "Intersecting";
+			case Stage::Rendering: return "Rendering";
+			case Stage::ZigZag: return "Zig-zag";
+			case Stage::Contouring: return "Contouring";
+			case Stage::Linking: return "Linking";
+			default: return "Waiting";
+			}
+		}
+	};
+}
\ No newline at end of file
@@ -0,0 +1,195 @@
+#include "height_map_dilation.h"
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <map>
+#include <thread>
+
+namespace ManualCAD
+{
+	namespace
+	{
+		// calls function(row) for every row, rows are split among hardware threads
+		template <class Function>
+		void for_each_row_parallel(int rows, Function function)
+		{
+			const int workers = std::max(1u, std::thread::hardware_concurrency());
+			std::vector<std::future<void>> futures;
+			for (int w = 0; w < workers; ++w)
+				futures.push_back(std::async(std::launch::async, [&function, w, workers, rows]() {
+					for (int row = w; row < rows; row += workers)
+						function(row);
+				}));
+			for (auto& future : futures)
+				future.get();
+		}
+	}
+
+	void HeightMapDilation::running_max(const float* values, int count, int half_width, float* result, std::vector<float>& buffer)
+	{
+		const int window = 2 * half_width + 1, padded_count = count + 2 * half_width;
+		buffer.assign(3 * static_cast<size_t>(padded_count), 0.0f);
+		float* f = buffer.data(), * prefix = f + padded_count, * suffix = prefix + padded_count;
+		std::copy(values, values + count, f + half_width);
+
+		for (int i = 0; i < padded_count; ++i)
+			prefix[i] = (i % window == 0) ? f[i] : std::max(prefix[i - 1], f[i]);
+		for (int i = padded_count - 1; i >= 0; --i)
+			suffix[i] = (i % window == window - 1 || i == padded_count - 1) ? f[i] : std::max(suffix[i + 1], f[i]);
+
+		for (int i = 0; i < count; ++i)
+			result[i] = std::max(suffix[i], prefix[i + window - 1]);
+	}
+
+	HeightMap HeightMapDilation::max_pool(const HeightMap& map, int factor)
+	{
+		if (factor <= 1)
+			return map;
+
+		// blocks are centered on the map, so that position_to_pixel of the result stays consistent with the map
+		const int width = (map.width + factor - 1) / factor, height = (map.height + factor - 1) / factor;
+		const int shift_a = (width * factor - map.width) / 2, shift_b = (height * factor - map.height) / 2;
+		HeightMap result(width, height, { map.size.x * width * factor / map.width, map.size.y, map.size.z * height * factor / map.height });
+
+		const float* source = map.data();
+		float* pixels = result.data();
+		std::fill(pixels, pixels + static_cast<size_t>(width) * height, 0.0f);
+		for (int b = 0; b < map.height; ++b)
+			for (int a = 0; a < map.width; ++a)
+			{
+				float& pixel = pixels[(a + shift_a) / factor + (b + shift_b) / factor * width];
+				pixel = std::max(pixel, source[a + b * map.width]);
+			}
+		return result;
+	}
+
+	HeightMap HeightMapDilation::min_pool(const HeightMap& map, int factor)
+	{
+		if (factor <= 1)
+			return map;
+
+		const int width = (map.width + factor - 1) / factor, height = (map.height + factor - 1) / factor;
+		const int shift_a = (width * factor - map.width) / 2, shift_b = (height * factor - map.height) / 2;
+		HeightMap result(width, height, { map.size.x * width * factor / map.width, map.size.y, map.size.z * height * factor / map.height });
+
+		const float* source = map.data();
+		float* pixels = result.data();
+		std::fill(pixels, pixels + static_cast<size_t>(width) * height, INFINITY);
+		for (int b = 0; b < map.height; ++b)
+			for (int a = 0; a < map.width; ++a)
+			{
+				float& pixel = pixels[(a + shift_a) / factor + (b + shift_b) / factor * width];
+				pixel = std::min(pixel, source[a + b * map.width]);
+			}
+		// blocks at the edges reach outside the map when its size isn't a multiple of factor
+		for (int b = 0; b < height; ++b)
+			for (int a = 0; a < width; ++a)
+				if (a * factor < shift_a || (a + 1) * factor > shift_a + map.width || b * factor < shift_b || (b + 1) * factor > shift_b + map.height)
+					pixels[a + b * width] = 0.0f;
+		return result;
+	}
+
+	HeightMap HeightMapDilation::dilate_by_cutter(const HeightMap& map, const Cutter& cutter, float cell_a, float cell_b)
+	{
+		const float radius = cutter.get_radius(), inv_height = 1.0f / map.size.y;
+		constexpr float EPS = 1e-4f; // cells lying exactly on the cutter's edge must not be lost to rounding
+		const int radius_a = static_cast<int>(radius / cell_a + EPS), radius_b = static_cast<int>(radius / cell_b + EPS);
+		const int pad = std::max(radius_a, radius_b);
+		const int width = map.width + 2 * pad, height = map.height + 2 * pad;
+
+		std::vector<float> source(static_cast<size_t>(width) * height, 0.0f);
+		for (int b = 0; b < map.height; ++b)
+			std::copy(map.data() + b * map.width, map.data() + (b + 1) * map.width, source.data() + pad + (b + pad) * width);
+
+		// cutter profile (normalized like pixels) for every offset within the disk
+		std::vector<int> half_widths(radius_b + 1);
+		std::vector<std::vector<float>> profile(radius_b + 1);
+		std::vector<bool> flat_row(radius_b + 1);
+		for (int dy = 0; dy <= radius_b; ++dy)
+		{
+			const float ly = dy * cell_b;
+			half_widths[dy] = static_cast<int>(sqrtf(std::max(0.0f, radius * radius - ly * ly)) / cell_a + EPS);
+			for (int dx = 0; dx <= half_widths[dy]; ++dx)
+			{
+				const float lx = dx * cell_a;
+				profile[dy].push_back(cutter.get_height_offset(std::min(radius, sqrtf(lx * lx + ly * ly))) * inv_height);
+			}
+			flat_row[dy] = profile[dy].back() == profile[dy].front();
+		}
+
+		// running maxima of rows for every distinct half width of the disk
+		std::map<int, std::vector<float>> row_maxima;
+		for (int hw : half_widths)
+			row_maxima[hw].resize(source.size());
+		for (auto& [hw, maxima] : row_maxima)
+		{
+			const int half_width = hw;
+			auto& result = maxima;
+			for_each_row_parallel(height, [&source, &result, width, half_width](int b) {
+				thread_local std::vector<float> buffer;
+				running_max(source.data() + b * width, width, half_width, result.data() + b * width, buffer);
+			});
+		}
+		std::vector<const float*> maxima_of_row(radius_b + 1);
+		for (int dy = 0; dy <= radius_b; ++dy)
+			maxima_of_row[dy] = row_maxima[half_widths[dy]].data();
+
+		// rows of the disk are visited from the center, because profile only grows with distance; every row is first bounded by its running maximum
+		std::vector<int> row_order = { 0 };
+		for (int dy = 1; dy <= radius_b; ++dy)
+		{
+			row_order.push_back(dy);
+			row_order.push_back(-dy);
+		}
+
+		HeightMap result(width, height, { map.size.x * width / map.width, map.size.y, map.size.z * height / map.height });
+		float* pixels = result.data();
+		for_each_row_parallel(height, [&](int b) {
+			for (int a = 0; a < width; ++a)
+			{
+				float best = source[a + b * width];
+				for (int dy : row_order)
+				{
+					const int row = b + dy, ady = abs(dy);
+					if (row < 0 || row >= height) // outside there is no material, thus it can't be higher than the center
+						continue;
+
+					const float bound = maxima_of_row[ady][a + row * width] - profile[ady][0];
+					if (bound <= best)
+						continue;
+					if (flat_row[ady])
+					{
+						best = bound;
+						continue;
+					}
+
+					const float* source_row = source.data() + row * width;
+					const int hw = half_widths[ady];
+					for (int dx = std::max(-hw, -a); dx <= std::min(hw, width - 1 - a); ++dx)
+						best = std::max(best, source_row[a + dx] - profile[ady][abs(dx)]);
+				}
+				pixels[a + b * width] = best;
+			}
+		});
+		return result;
+	}
+
+	float HeightMapDilation::dilate_pixel_by_cutter(const HeightMap& map, const Cutter& cutter, float cell_a, float cell_b, int a, int b)
+	{
+		const float radius = cutter.get_radius();
+		constexpr float EPS = 1e-4f; // the same disk as in dilate_by_cutter
+		const int radius_b = static_cast<int>(radius / cell_b + EPS);
+		float best = map.get_pixel(a, b);
+		for (int dy = -radius_b; dy <= radius_b; ++dy)
+		{
+			const float ly = dy * cell_b;
+			const int half_width = static_cast<int>(sqrtf(std::max(0.0f, radius * radius - ly * ly)) / cell_a + EPS);
+			for (int dx = -half_width; dx <= half_width; ++dx)
+			{
+				const float lx = dx * cell_a;
+				best = std::max(best, map.get_pixel(a + dx, b + dy) - cutter.get_height_offset(std::min(radius, sqrtf(lx * lx + ly * ly))));
+			}
+		}
+		return best;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "height_map.h"
+#include "cutter.h"
+#include <vector>
+
+namespace ManualCAD
+{
+	// Morphological operations on height maps used to plan cutter paths. Maps are treated as grids of cells,
+	// where cell_a and cell_b are lengths of a cell along the first and the second index of get_pixel.
+	class HeightMapDilation {
+		// Running maximum of window [i - half_width, i + half_width] (van Herk/Gil-Werman, three comparisons per element); values outside are 0.
+		static void running_max(const float* values, int count, int half_width, float* result, std::vector<float>& buffer);
+	public:
+		// Downsamples map by taking maximum of factor x factor blocks, thus result never underestimates the map.
+		static HeightMap max_pool(const HeightMap& map, int factor);
+		// Downsamples map by taking minimum of the same blocks as max_pool; blocks reaching outside the map are 0, thus result never overestimates the map.
+		static HeightMap min_pool(const HeightMap& map, int factor);
+
+		// Returns map of the lowest cutter tip heights at which the cutter doesn't intersect the map (dilation by cutter's profile).
+		// Result is extended by cutter radius on every side (with metric size extended accordingly), so it can be sampled with
+		// position_to_pixel also around the map. Flat cutter is a flat disk, computed exactly with running maxima of disk's rows;
+		// ball cutter is computed exactly, with rows of the disk pruned by the same running maxima.
+		static HeightMap dilate_by_cutter(const HeightMap& map, const Cutter& cutter, float cell_a, float cell_b);
+		// Returns pixel (a, b) of dilate_by_cutter's result (without its padding, and scaled as by get_pixel); it is computed only for
+		// that pixel, thus it is cheap for a few pixels of a fine map.
+		static float dilate_pixel_by_cutter(const HeightMap& map, const Cutter& cutter, float cell_a, float cell_b, int a, int b);
+	};
+}
\ No newline at end of file
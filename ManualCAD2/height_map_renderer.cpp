@@ -1,16 +1,13 @@
 #include "height_map_renderer.h"
+#include <algorithm>
+#include <future>
+#include <thread>
 
 namespace ManualCAD
 {
-	HeightMapRenderer::HeightMapRenderer(const std::list<const ParametricSurfaceObject*>& surfaces, const Box& box, float offset) : surfaces(surfaces), fbo(), texture(), offset(offset)
+	HeightMapRenderer::HeightMapRenderer(const std::list<const ParametricSurfaceObject*>& surfaces, const Box& box, float offset) : surfaces(surfaces), fbo(), texture(), box(box), offset(offset)
 	{
-		fbo.init();
-		fbo.bind();
-		texture.init();
-		texture.bind();
-		texture.configure();
-		texture.set_size(TEX_DIM, TEX_DIM);
-		fbo.unbind();
+		tessellation_tolerance = 0.5f * std::min(box.x_max - box.x_min, box.z_max - box.z_min) / TEX_DIM; // half of a pixel
 
 		renderer.default_shader_set = ShaderSet::Type::HeightMap;
 		renderer.get_camera().set_rotation(HALF_PI, HALF_PI, 0.0f);
@@ -25,6 +22,182 @@ namespace ManualCAD
 		renderer.polygon_mode = GL_FILL;
 	}
 
+	void HeightMapRenderer::init_gpu()
+	{
+		if (gpu_initialized)
+			return;
+
+		fbo.init();
+		fbo.bind();
+		texture.init();
+		texture.bind();
+		texture.configure();
+		texture.set_size(TEX_DIM, TEX_DIM);
+		fbo.unbind();
+		gpu_initialized = true;
+	}
+
+	void HeightMapRenderer::tessellate(const ParametricSurface& surface, float offset, float value, std::vector<CpuTriangle>& triangles) const
+	{
+		// pixel space is the same as in GPU backend: columns along Z, rows along X, height normalized to box
+		const float col_scale = TEX_DIM / (box.z_max - box.z_min),
+			row_scale = TEX_DIM / (box.x_max - box.x_min),
+			height_scale = 1.0f / (box.y_max - box.y_min);
+		auto to_pixel_space = [&](const Vector3& p) -> Vector3 {
+			return { (p.z - box.z_min) * col_scale, (p.x - box.x_min) * row_scale, (p.y - box.y_min) * height_scale };
+		};
+		auto point = [&](float u, float v) {
+			return surface.evaluate(u, v) - offset * surface.normal(u, v);
+		};
+
+		std::vector<Vector3> grid;
+		for (const auto& patch : surface.get_patch_bounds())
+		{
+			// number of divisions from chord error bound h^2 * max|f''| / 8, with second derivatives estimated on a coarse grid
+			constexpr int SAMPLES = 5;
+			Vector3 samples[SAMPLES][SAMPLES];
+			for (int i = 0; i < SAMPLES; ++i)
+				for (int j = 0; j < SAMPLES; ++j)
+					samples[i][j] = point(lerp(patch.us.from, patch.us.to, static_cast<float>(i) / (SAMPLES - 1)), lerp(patch.vs.from, patch.vs.to, static_cast<float>(j) / (SAMPLES - 1)));
+
+			float second_u = 0.0f, second_v = 0.0f;
+			for (int i = 1; i < SAMPLES - 1; ++i)
+				for (int j = 0; j < SAMPLES; ++j)
+				{
+					second_u = std::max(second_u, (samples[i - 1][j] - 2.0f * samples[i][j] + samples[i + 1][j]).length());
+					second_v = std::max(second_v, (samples[j][i - 1] - 2.0f * samples[j][i] + samples[j][i + 1]).length());
+				}
+			// second differences are already multiplied by step^2, so divisions scale with (SAMPLES - 1) * sqrt(diff / (8 * tolerance))
+			auto divisions = [this](float second_difference) {
+				const float n = (SAMPLES - 1) * sqrtf(second_difference / (8.0f * tessellation_tolerance));
+				return std::clamp(static_cast<int>(ceilf(n)), 1, CPU_MAX_PATCH_DIVISIONS);
+			};
+			const int div_u = divisions(second_u), div_v = divisions(second_v);
+
+			grid.resize((div_u + 1) * (div_v + 1));
+			for (int i = 0; i <= div_u; ++i)
+				for (int j = 0; j <= div_v; ++j)
+					grid[i + j * (div_u + 1)] = to_pixel_space(point(lerp(patch.us.from, patch.us.to, static_cast<float>(i) / div_u), lerp(patch.vs.from, patch.vs.to, static_cast<float>(j) / div_v)));
+
+			for (int i = 0; i < div_u; ++i)
+				for (int j = 0; j < div_v; ++j)
+				{
+					const Vector3& p00 = grid[i + j * (div_u + 1)], & p10 = grid[i + 1 + j * (div_u + 1)],
+						& p01 = grid[i + (j + 1) * (div_u + 1)], & p11 = grid[i + 1 + (j + 1) * (div_u + 1)];
+					if (isnan(p00.z) || isnan(p10.z) || isnan(p01.z) || isnan(p11.z)) // degenerated normal
+						continue;
+					triangles.push_back({ { p00, p10, p11 }, value });
+					triangles.push_back({ { p00, p11, p01 }, value });
+				}
+		}
+	}
+
+	std::vector<HeightMapRenderer::CpuTriangle> HeightMapRenderer::tessellate_all(const std::vector<float>& offsets, bool index_values) const
+	{
+		// surfaces are tessellated concurrently, results are concatenated in order of passes and surfaces (it matters for equal heights)
+		std::vector<std::future<std::vector<CpuTriangle>>> futures;
+		for (float pass_offset : offsets)
+		{
+			int i = 1;
+			for (const auto* surf : surfaces)
+			{
+				const float value = index_values ? static_cast<float>(i) / surfaces.size() : 0.0f;
+				futures.push_back(std::async(std::launch::async, [this, surf, pass_offset, value]() {
+					std::vector<CpuTriangle> result;
+					tessellate(*surf, pass_offset, value, result);
+					return result;
+				}));
+				++i;
+			}
+		}
+
+		std::vector<CpuTriangle> triangles;
+		for (auto& future : futures)
+		{
+			auto part = future.get();
+			triangles.insert(triangles.end(), part.begin(), part.end());
+		}
+		return triangles;
+	}
+
+	void HeightMapRenderer::rasterize_tiles(const std::vector<CpuTriangle>& triangles, bool write_height, const std::function<void(int first_row, int end_row, const std::vector<float>& values)>& write_tile) const
+	{
+		// bin triangles to tiles of rows, keeping their order
+		constexpr int TILES = (TEX_DIM + CPU_TILE_ROWS - 1) / CPU_TILE_ROWS;
+		std::vector<std::vector<uint32_t>> bins(TILES);
+		for (uint32_t t = 0; t < triangles.size(); ++t)
+		{
+			const auto& v = triangles[t].vertices;
+			const float min_row = std::min({ v[0].y, v[1].y, v[2].y }), max_row = std::max({ v[0].y, v[1].y, v[2].y });
+			const int first = std::max(0, static_cast<int>(floorf(min_row)) / CPU_TILE_ROWS),
+				last = std::min(TILES - 1, static_cast<int>(floorf(max_row)) / CPU_TILE_ROWS);
+			for (int tile = first; tile <= last; ++tile)
+				bins[tile].push_back(t);
+		}
+
+		auto rasterize_tile = [&triangles, &bins, write_height, &write_tile](int tile) {
+			const int tile_begin = tile * CPU_TILE_ROWS, tile_end = std::min(TEX_DIM, tile_begin + CPU_TILE_ROWS);
+			std::vector<float> depth(static_cast<size_t>(CPU_TILE_ROWS) * TEX_DIM, -INFINITY);
+			std::vector<float> values(static_cast<size_t>(tile_end - tile_begin) * TEX_DIM, 0.0f);
+
+			for (uint32_t t : bins[tile])
+			{
+				const auto& triangle = triangles[t];
+				const Vector3& a = triangle.vertices[0], & b = triangle.vertices[1], & c = triangle.vertices[2];
+				const float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+				if (area == 0.0f)
+					continue;
+				const float inv_area = 1.0f / area;
+
+				// pixel centers inside triangle bounding box
+				const int col_begin = std::max(0, static_cast<int>(ceilf(std::min({ a.x, b.x, c.x }) - 0.5f))),
+					col_end = std::min(TEX_DIM - 1, static_cast<int>(floorf(std::max({ a.x, b.x, c.x }) - 0.5f))),
+					row_begin = std::max(tile_begin, static_cast<int>(ceilf(std::min({ a.y, b.y, c.y }) - 0.5f))),
+					row_end = std::min(tile_end - 1, static_cast<int>(floorf(std::max({ a.y, b.y, c.y }) - 0.5f)));
+
+				for (int row = row_begin; row <= row_end; ++row)
+				{
+					const float py = row + 0.5f;
+					for (int col = col_begin; col <= col_end; ++col)
+					{
+						const float px = col + 0.5f;
+						const float w0 = ((b.x - px) * (c.y - py) - (b.y - py) * (c.x - px)) * inv_area,
+							w1 = ((c.x - px) * (a.y - py) - (c.y - py) * (a.x - px)) * inv_area,
+							w2 = 1.0f - w0 - w1;
+						if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+							continue;
+
+						const float h = w0 * a.z + w1 * b.z + w2 * c.z;
+						float& d = depth[(row - tile_begin) * TEX_DIM + col];
+						if (h < 0.0f || h > 1.0f || h <= d) // clipped by near and far plane or hidden
+							continue;
+						d = h;
+						values[col + (row - tile_begin) * TEX_DIM] = write_height ? h : triangle.value;
+					}
+				}
+			}
+			write_tile(tile_begin, tile_end, values);
+		};
+
+		const int workers = std::max(1u, std::thread::hardware_concurrency());
+		std::vector<std::future<void>> futures;
+		for (int w = 0; w < workers; ++w)
+			futures.push_back(std::async(std::launch::async, [&rasterize_tile, w, workers]() {
+				for (int tile = w; tile < TILES; tile += workers)
+					rasterize_tile(tile);
+			}));
+		for (auto& future : futures)
+			future.get();
+	}
+
+	void HeightMapRenderer::rasterize(const std::vector<CpuTriangle>& triangles, bool write_height, HeightMap& map) const
+	{
+		float* pixels = map.data();
+		rasterize_tiles(triangles, write_height, [pixels](int first_row, int end_row, const std::vector<float>& values) {
+			std::copy(values.begin(), values.begin() + static_cast<size_t>(end_row - first_row) * TEX_DIM, pixels + first_row * TEX_DIM);
+		});
+	}
+
 	HeightMapRenderer::~HeightMapRenderer()
 	{
 		//texture.dispose();
@@ -32,10 +205,19 @@ namespace ManualCAD
 		// we don't dispose renderer because we don't initialize it
 	}
 
-	HeightMap HeightMapRenderer::render_height_map(const Vector3& size)
+	HeightMap HeightMapRenderer::render_height_map(const Vector3& size, Backend backend)
 	{
 		HeightMap map(TEX_DIM, TEX_DIM, size);
 
+		if (backend == Backend::CPU)
+		{
+			std::fill(map.data(), map.data() + TEX_DIM * TEX_DIM, 0.0f);
+			rasterize(tessellate_all({ offset }, false), true, map);
+			return map;
+		}
+
+		init_gpu();
+
 		GLint old_viewport[4];
 		glGetIntegerv(GL_VIEWPORT, old_viewport);
 		fbo.bind();
@@ -56,11 +238,21 @@ namespace ManualCAD
 
 		return map;
 	}
-	HeightMap HeightMapRenderer::render_index_map(const Vector3& size)
+	HeightMap HeightMapRenderer::render_index_map(const Vector3& size, Backend backend)
 	{
 		Vector3 map_size = { size.x, surfaces.size(), size.z };
 		HeightMap map(TEX_DIM, TEX_DIM, map_size);
 
+		if (backend == Backend::CPU)
+		{
+			// the same passes as on GPU; rasterization is exact, so partial offsets only keep results consistent between backends
+			std::fill(map.data(), map.data() + TEX_DIM * TEX_DIM, 0.0f);
+			rasterize(tessellate_all({ offset, 0.8f * offset, 0.35f * offset, 0.0f }, true), false, map);
+			return map;
+		}
+
+		init_gpu();
+
 		GLint old_viewport[4];
 		glGetIntegerv(GL_VIEWPORT, old_viewport);
 		fbo.bind();
@@ -116,4 +308,30 @@ namespace ManualCAD
 
 		return map;
 	}
+
+	OwnershipMap HeightMapRenderer::render_ownership_map(const Vector3& size, Backend backend)
+	{
+		if (surfaces.size() > OwnershipMap::MAX_OWNERS)
+			throw std::runtime_error("Too many surfaces for ownership map");
+		if (backend == Backend::GPU)
+			return OwnershipMap::from_index_map(render_index_map(size, backend));
+
+		// the same triangles as in index map; rows of a tile are encoded by its worker and appended in order at the end
+		std::vector<std::vector<std::pair<uint16_t, uint8_t>>> rows(TEX_DIM);
+		const float count = static_cast<float>(surfaces.size());
+		rasterize_tiles(tessellate_all({ offset, 0.8f * offset, 0.35f * offset, 0.0f }, true), false, [&rows, count](int first_row, int end_row, const std::vector<float>& values) {
+			std::vector<uint8_t> owners(TEX_DIM);
+			for (int row = first_row; row < end_row; ++row)
+			{
+				for (int col = 0; col < TEX_DIM; ++col)
+					owners[col] = static_cast<uint8_t>(lroundf(values[col + (row - first_row) * TEX_DIM] * count));
+				OwnershipMap::encode_row(owners.data(), TEX_DIM, rows[row]);
+			}
+		});
+
+		OwnershipMap map(TEX_DIM, { size.x, count, size.z });
+		for (const auto& row : rows)
+			map.append_row(row);
+		return map;
+	}
 }
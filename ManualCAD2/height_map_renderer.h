@@ -1,30 +1,58 @@
 #pragma once
 
 #include <list>
+#include <vector>
 #include "algebra.h"
 #include "frame_buffer.h"
 #include "texture.h"
 #include "renderer.h"
 #include "object.h"
 #include "height_map.h"
+#include "ownership_map.h"
 #include "box.h"
+#include <functional>
 
 namespace ManualCAD
 {
 	class HeightMapRenderer {
+	public:
+		// GPU backend needs a live GL context; CPU backend tessellates and rasterizes surfaces itself, so it can run headless
+		enum class Backend { GPU, CPU };
+	private:
 		static constexpr int TEX_DIM = 2000;
+		static constexpr int CPU_TILE_ROWS = 50;
+		static constexpr int CPU_MAX_PATCH_DIVISIONS = 256;
 
 		FrameBuffer fbo;
 		RenderTexMap texture;
 		Renderer renderer; // doesn't have to be initialized
+		bool gpu_initialized = false;
 
+		Box box;
 		float offset;
+		float tessellation_tolerance; // maximal distance of tessellated surface from the real one (CPU backend)
 		const std::list<const ParametricSurfaceObject*>& surfaces;
+
+		struct CpuTriangle {
+			Vector3 vertices[3]; // (column, row, normalized height) in pixel space
+			float value; // written value for index maps; height maps write interpolated height
+		};
+
+		void init_gpu();
+		void tessellate(const ParametricSurface& surface, float offset, float value, std::vector<CpuTriangle>& triangles) const;
+		// Rasterizes triangles in tiles of rows (in parallel); every tile is handed over with its values (rows x TEX_DIM, 0 where empty).
+		void rasterize_tiles(const std::vector<CpuTriangle>& triangles, bool write_height, const std::function<void(int first_row, int end_row, const std::vector<float>& values)>& write_tile) const;
+		void rasterize(const std::vector<CpuTriangle>& triangles, bool write_height, HeightMap& map) const;
+		std::vector<CpuTriangle> tessellate_all(const std::vector<float>& offsets, bool index_values) const;
 	public:
 		HeightMapRenderer(const std::list<const ParametricSurfaceObject*>& surfaces, const Box& box, float offset = 0);
 		~HeightMapRenderer();
-		HeightMap render_height_map(const Vector3& size);
-		HeightMap render_index_map(const Vector3& size);
+		HeightMap render_height_map(const Vector3& size, Backend backend = Backend::GPU);
+		HeightMap render_index_map(const Vector3& size, Backend backend = Backend::GPU);
+		// The same as index map, but compact. CPU backend encodes rows of every tile as soon as it is rasterized, so the full map is never stored.
+		OwnershipMap render_ownership_map(const Vector3& size, Backend backend = Backend::GPU);
+
+		void set_tessellation_tolerance(float tolerance) { tessellation_tolerance = tolerance; }
 
 		const auto& get_texture() const { return texture; }
 	};
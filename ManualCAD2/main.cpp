@@ -1,9 +1,14 @@
 #include "glApplication.h"
+#include "milling_benchmark.h"
+#include <cstring>
 
 using namespace ManualCAD;
 
-int main(int, char**)
+int main(int argc, char** argv)
 {
+	if (argc > 1 && std::strcmp(argv[1], "--benchmark") == 0)
+		return MillingBenchmark::run(argc > 2 ? argv[2] : "benchmark.json");
+
 	//Raycaster raycaster;
 	Renderer renderer;
 	GlApplication app(1280, 720, "ManualCAD 2", ImVec4(0.27f, 0.33f, 0.36f, 1.00f), renderer);
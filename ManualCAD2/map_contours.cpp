@@ -0,0 +1,95 @@
+#include "map_contours.h"
+#include <algorithm>
+
+namespace ManualCAD
+{
+	Vector2 MapContours::edge_crossing(const HeightMap& map, long long edge, float level)
+	{
+		const bool along_second = (edge & 1) == 1;
+		const long long node = edge / 2;
+		const int i = static_cast<int>(node % (map.width + 2)) - 1, j = static_cast<int>(node / (map.width + 2)) - 1;
+		const float from = map.get_pixel(i, j), to = along_second ? map.get_pixel(i, j + 1) : map.get_pixel(i + 1, j);
+		const float t = std::clamp((level - from) / (to - from), 0.0f, 1.0f);
+		// pixel (i, j) is sampled at its center
+		return along_second ? Vector2{ i + 0.5f, j + 0.5f + t } : Vector2{ i + 0.5f + t, j + 0.5f };
+	}
+
+	std::vector<std::vector<Vector2>> MapContours::trace(const HeightMap& map, float level)
+	{
+		// marching squares: every cell of the padded grid gives up to two segments between its crossed edges
+		std::vector<Segment> segments;
+		for (int j = -1; j < map.height; ++j)
+			for (int i = -1; i < map.width; ++i)
+			{
+				// corners in order around the cell, edge k joins corners k and k + 1
+				const float v[4] = { map.get_pixel(i, j), map.get_pixel(i + 1, j), map.get_pixel(i + 1, j + 1), map.get_pixel(i, j + 1) };
+				const bool above[4] = { v[0] > level, v[1] > level, v[2] > level, v[3] > level };
+				if (above[0] == above[1] && above[1] == above[2] && above[2] == above[3])
+					continue;
+				const long long e[4] = { edge_id(map, i, j, false), edge_id(map, i + 1, j, true), edge_id(map, i, j + 1, false), edge_id(map, i, j, true) };
+
+				if (above[0] == above[2] && above[1] == above[3]) // saddle, resolved by value at center of the cell
+				{
+					const bool center_above = 0.25f * (v[0] + v[1] + v[2] + v[3]) > level;
+					if (center_above == above[0]) // corners 0 and 2 are connected
+					{
+						segments.push_back({ { e[0], e[1] } });
+						segments.push_back({ { e[2], e[3] } });
+					}
+					else
+					{
+						segments.push_back({ { e[3], e[0] } });
+						segments.push_back({ { e[1], e[2] } });
+					}
+					continue;
+				}
+
+				Segment segment;
+				int crossed = 0;
+				for (int k = 0; k < 4; ++k)
+					if (above[k] != above[(k + 1) % 4])
+						segment.edges[crossed++] = e[k];
+				segments.push_back(segment);
+			}
+
+		// every edge is crossed by segments of both cells it separates; ends of segments at the same edge are partners
+		std::vector<std::pair<long long, int>> ends;
+		ends.reserve(2 * segments.size());
+		for (size_t s = 0; s < segments.size(); ++s)
+		{
+			ends.push_back({ segments[s].edges[0], static_cast<int>(2 * s) });
+			ends.push_back({ segments[s].edges[1], static_cast<int>(2 * s + 1) });
+		}
+		std::sort(ends.begin(), ends.end());
+		std::vector<int> partner(ends.size(), -1);
+		for (size_t k = 0; k + 1 < ends.size(); ++k)
+			if (ends[k].first == ends[k + 1].first)
+			{
+				partner[ends[k].second] = ends[k + 1].second;
+				partner[ends[k + 1].second] = ends[k].second;
+				++k;
+			}
+
+		std::vector<std::vector<Vector2>> contours;
+		std::vector<char> used(segments.size(), false);
+		for (size_t s = 0; s < segments.size(); ++s)
+		{
+			if (used[s])
+				continue;
+			used[s] = true;
+			std::vector<Vector2> contour = { edge_crossing(map, segments[s].edges[0], level) };
+			int end = static_cast<int>(2 * s + 1);
+			while (true)
+			{
+				contour.push_back(edge_crossing(map, segments[end / 2].edges[end % 2], level));
+				const int next = partner[end];
+				if (next < 0 || used[next / 2])
+					break;
+				used[next / 2] = true;
+				end = next ^ 1; // the other end of the next segment
+			}
+			contours.push_back(std::move(contour));
+		}
+		return contours;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "algebra.h"
+#include "height_map.h"
+#include <vector>
+
+namespace ManualCAD
+{
+	// Contours of a height map at a level, traced with marching squares over centers of pixels (saddles are resolved by value at center
+	// of a cell). Map is padded by one pixel with zeros on every side, thus contours at positive levels are closed.
+	class MapContours {
+		struct Segment {
+			long long edges[2]; // crossed edges of the grid (see edge_id)
+		};
+
+		static long long edge_id(const HeightMap& map, int i, int j, bool along_second) { return 2 * ((i + 1) + static_cast<long long>(j + 1) * (map.width + 2)) + (along_second ? 1 : 0); }
+		static Vector2 edge_crossing(const HeightMap& map, long long edge, float level);
+	public:
+		// Returns closed polylines (with the first point repeated at the end) in pixel coordinates: the first coordinate is the first index
+		// of get_pixel; pixel (i, j) is sampled at (i + 0.5, j + 0.5).
+		static std::vector<std::vector<Vector2>> trace(const HeightMap& map, float level);
+	};
+}
\ No newline at end of file
@@ -0,0 +1,269 @@
+#include "milling_benchmark.h"
+#include "milling_program.h"
+#include "thick_line_rasterizer.h"
+#include "height_map.h"
+#include "cutter.h"
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+
+namespace ManualCAD
+{
+	namespace
+	{
+		const Vector3 WORKPIECE_SIZE = { 15.0f, 5.0f, 15.0f };
+		constexpr float MAX_CUTTER_DEPTH = 10.0f;
+
+		std::unique_ptr<Cutter> make_cutter(char type, float diameter)
+		{
+			if (type == 'k')
+				return std::make_unique<BallCutter>(diameter);
+			return std::make_unique<FlatCutter>(diameter);
+		}
+
+		std::string cutter_name(char type, float diameter)
+		{
+			char buffer[16];
+			std::snprintf(buffer, sizeof(buffer), "%c%02d", type, static_cast<int>(lroundf(10.0f * diameter)));
+			return buffer;
+		}
+
+		float footprint_pixels(const HeightMap& map, float radius)
+		{
+			return PI * map.length_to_pixels_x(radius) * map.length_to_pixels_y(radius);
+		}
+
+		float move_pixels(const HeightMap& map, float radius, const Vector3& from, const Vector3& to)
+		{
+			const float length = sqrtf((to.x - from.x) * (to.x - from.x) + (to.z - from.z) * (to.z - from.z));
+			return 2.0f * footprint_pixels(map, radius) + map.length_to_pixels_x(length) * map.length_to_pixels_x(2.0f * radius);
+		}
+
+		// zig-zag along X axis, row after row, split into moves of given length; heights are given by a function of (x, z)
+		template <class HeightFunction>
+		MillingProgram make_zig_zag_program(const char* name, char cutter_type, float diameter, const std::vector<float>& levels, float row_width, float move_length, HeightFunction height)
+		{
+			MillingProgram program(name);
+			program.set_cutter(make_cutter(cutter_type, diameter));
+
+			const float margin = 0.5f * WORKPIECE_SIZE.x + diameter, safe_height = WORKPIECE_SIZE.y + 1.0f;
+			const int rows = static_cast<int>(WORKPIECE_SIZE.z / row_width) + 1,
+				moves_in_row = static_cast<int>(2.0f * margin / move_length) + 1;
+
+			int instruction = 3;
+			Vector3 current = { -margin, safe_height, -0.5f * WORKPIECE_SIZE.z };
+			auto move_to = [&program, &instruction, &current](const Vector3& destination) {
+				program.add_move({ instruction++, false, current, destination });
+				current = destination;
+			};
+
+			for (float level : levels)
+			{
+				for (int j = 0; j < rows; ++j)
+				{
+					const float z = -0.5f * WORKPIECE_SIZE.z + j * row_width;
+					const float dir = (j & 1) ? -1.0f : 1.0f;
+					for (int i = 0; i <= moves_in_row; ++i)
+					{
+						const float x = dir * (-margin + i * 2.0f * margin / moves_in_row);
+						move_to({ x, std::max(level, height(x, z)), z });
+					}
+				}
+			}
+			move_to({ current.x, safe_height, current.z });
+			return program;
+		}
+
+		MillingProgram make_rough_program()
+		{
+			return make_zig_zag_program("Rough (k16)", 'k', 1.6f, { 3.5f, 2.0f }, 1.2f, 0.5f, [](float, float) { return 2.0f; });
+		}
+
+		MillingProgram make_finish_program()
+		{
+			return make_zig_zag_program("Finish (k08)", 'k', 0.8f, { 1.5f }, 0.2f, 0.1f, [](float x, float z) { return 2.5f + 0.5f * sinf(x) * cosf(z); });
+		}
+	}
+
+	void MillingBenchmark::measure(const std::string& kernel, const std::string& case_name, double pixels_per_iteration, double moves_per_iteration, const std::function<void()>& setup, const std::function<void()>& iteration)
+	{
+		using clock = std::chrono::steady_clock;
+
+		size_t iterations = 0;
+		std::chrono::duration<double> elapsed(0.0);
+		while (iterations < MIN_ITERATIONS || elapsed.count() < MIN_MEASURE_SECONDS)
+		{
+			setup();
+			const auto start = clock::now();
+			iteration();
+			elapsed += clock::now() - start;
+			++iterations;
+		}
+
+		results.push_back({ kernel, case_name, iterations, elapsed.count(), pixels_per_iteration, moves_per_iteration });
+	}
+
+	void MillingBenchmark::benchmark_cut_pixel()
+	{
+		constexpr int CUTS = 256;
+		const char types[] = { 'k', 'f' };
+		const float diameters[] = { 0.2f, 0.8f, 1.6f };
+		const int resolutions[] = { 500, 1000, 2000 };
+
+		for (char type : types)
+			for (float diameter : diameters)
+				for (int resolution : resolutions)
+				{
+					auto cutter = make_cutter(type, diameter);
+					HeightMap map(resolution, resolution, WORKPIECE_SIZE);
+					const float pixels = CUTS * footprint_pixels(map, cutter->get_radius());
+
+					measure("Cutter::cut_pixel", cutter_name(type, diameter) + " " + std::to_string(resolution) + "x" + std::to_string(resolution), pixels, 0.0,
+						[&map]() { map.fill(WORKPIECE_SIZE); },
+						[&map, &cutter, resolution]() {
+							for (int i = 0; i < CUTS; ++i) // cuts spread uniformly on 16x16 grid
+								cutter->cut_pixel(map, i, (2 * (i % 16) + 1) * resolution / 32, (2 * (i / 16) + 1) * resolution / 32, 4.5f, MAX_CUTTER_DEPTH);
+						});
+				}
+	}
+
+	void MillingBenchmark::benchmark_thick_line_rasterizer()
+	{
+		constexpr int RESOLUTION = 1500;
+		constexpr int LINES = 16;
+		const char types[] = { 'k', 'f' };
+		const float diameters[] = { 0.8f, 1.0f };
+		const struct {
+			const char* name;
+			Vector3 from, to;
+		} lines[] = {
+			{ "short", { 0.0f, 4.5f, 0.0f }, { 0.05f, 4.5f, 0.0f } },
+			{ "long", { -6.0f, 4.5f, 0.0f }, { 6.0f, 4.5f, 0.0f } },
+			{ "diagonal", { -4.2f, 4.5f, -4.2f }, { 4.2f, 4.0f, 4.2f } },
+		};
+
+		for (int c = 0; c < 2; ++c)
+			for (const auto& line : lines)
+			{
+				auto cutter = make_cutter(types[c], diameters[c]);
+				HeightMap map(RESOLUTION, RESOLUTION, WORKPIECE_SIZE);
+				const float length = sqrtf((line.to.x - line.from.x) * (line.to.x - line.from.x) + (line.to.z - line.from.z) * (line.to.z - line.from.z));
+				const float pixels = LINES * map.length_to_pixels_x(length) * map.length_to_pixels_x(cutter->get_diameter());
+
+				measure("ThickLineRasterizer::draw", cutter_name(types[c], diameters[c]) + " " + line.name, pixels, LINES,
+					[&map]() { map.fill(WORKPIECE_SIZE); },
+					[&map, &cutter, &line]() {
+						const float max_depth = MAX_CUTTER_DEPTH;
+						for (int i = 0; i < LINES; ++i)
+						{
+							const Vector3 shift = { 0.0f, -0.01f * i, 0.0f };
+							ThickLineRasterizer(map, *cutter, line.from + shift, line.to + shift, i, max_depth).draw();
+						}
+					});
+			}
+	}
+
+	void MillingBenchmark::benchmark_read_from_file()
+	{
+		const auto path = std::filesystem::temp_directory_path() / "manualcad_benchmark.k08";
+		const std::string filename = path.string();
+		const int sizes[] = { 1000, 100000 };
+
+		for (int size : sizes)
+		{
+			MillingProgram program("Synthetic");
+			program.set_cutter(make_cutter('k', 0.8f));
+			for (int i = 0; i < size; ++i)
+			{
+				const float t = static_cast<float>(i) / size;
+				program.add_move({ i + 3, false, { -7.0f + 14.0f * t, 3.0f, 5.0f * sinf(50.0f * t) }, { -7.0f + 14.0f * (t + 1.0f / size), 3.0f, 5.0f * sinf(50.0f * (t + 1.0f / size)) } });
+			}
+			program.save_to_file(filename.c_str());
+
+			measure("MillingProgram::read_from_file", std::to_string(size) + " moves", 0.0, size,
+				[]() {},
+				[&filename]() { MillingProgram::read_from_file(filename.c_str()); });
+		}
+
+		std::filesystem::remove(path);
+	}
+
+	void MillingBenchmark::benchmark_execute_on()
+	{
+		constexpr int RESOLUTION = 1500;
+		MillingProgram programs[] = { make_rough_program(), make_finish_program() };
+
+		for (const auto& program : programs)
+		{
+			HeightMap map(RESOLUTION, RESOLUTION, WORKPIECE_SIZE);
+			const auto positions = program.get_cutter_positions();
+			double pixels = 0.0;
+			for (size_t i = 0; i + 1 < positions.size(); ++i)
+				pixels += move_pixels(map, program.get_cutter().get_radius(), positions[i], positions[i + 1]);
+
+			measure("MillingProgram::execute_on", program.get_name(), pixels, positions.size() - 1,
+				[&map]() { map.fill(WORKPIECE_SIZE); },
+				[&map, &program]() { program.execute_on(map, MAX_CUTTER_DEPTH); });
+		}
+	}
+
+	void MillingBenchmark::run_all()
+	{
+		results.clear();
+		benchmark_cut_pixel();
+		benchmark_thick_line_rasterizer();
+		benchmark_read_from_file();
+		benchmark_execute_on();
+	}
+
+	void MillingBenchmark::print_summary(std::ostream& stream) const
+	{
+		stream << std::left << std::setw(32) << "kernel" << std::setw(24) << "case"
+			<< std::right << std::setw(8) << "iters" << std::setw(16) << "ns/iter" << std::setw(12) << "ns/pixel" << std::setw(16) << "moves/s" << std::endl;
+		for (const auto& r : results)
+		{
+			stream << std::left << std::setw(32) << r.kernel << std::setw(24) << r.case_name
+				<< std::right << std::setw(8) << r.iterations
+				<< std::fixed << std::setprecision(0) << std::setw(16) << r.ns_per_iteration()
+				<< std::setprecision(3) << std::setw(12) << r.ns_per_pixel()
+				<< std::setprecision(0) << std::setw(16) << r.moves_per_second() << std::endl;
+		}
+	}
+
+	void MillingBenchmark::write_json(std::ostream& stream) const
+	{
+		stream << "[" << std::endl;
+		for (size_t i = 0; i < results.size(); ++i)
+		{
+			const auto& r = results[i];
+			stream << "  {\"kernel\": \"" << r.kernel << "\", \"case\": \"" << r.case_name << "\", "
+				<< "\"iterations\": " << r.iterations << ", "
+				<< std::setprecision(6) << std::defaultfloat
+				<< "\"ns_per_iteration\": " << r.ns_per_iteration() << ", "
+				<< "\"ns_per_pixel\": " << r.ns_per_pixel() << ", "
+				<< "\"moves_per_second\": " << r.moves_per_second() << "}"
+				<< (i + 1 < results.size() ? "," : "") << std::endl;
+		}
+		stream << "]" << std::endl;
+	}
+
+	int MillingBenchmark::run(const char* output_filename)
+	{
+		MillingBenchmark benchmark;
+		benchmark.run_all();
+		benchmark.print_summary(std::cout);
+
+		std::ofstream s(output_filename);
+		if (!s.good())
+		{
+			std::cerr << "Error creating file " << output_filename << std::endl;
+			return 1;
+		}
+		benchmark.write_json(s);
+		return 0;
+	}
+}
\ No newline at end of file
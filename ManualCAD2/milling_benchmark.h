@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <functional>
+
+namespace ManualCAD
+{
+	// Micro- and macro-benchmarks of milling simulation kernels. Run by starting the application with --benchmark [output file].
+	class MillingBenchmark {
+		static constexpr double MIN_MEASURE_SECONDS = 0.5;
+		static constexpr int MIN_ITERATIONS = 3;
+
+		struct Result {
+			std::string kernel;
+			std::string case_name;
+			size_t iterations;
+			double seconds;
+			double pixels_per_iteration; // 0 if kernel is not pixel-bound
+			double moves_per_iteration; // 0 if kernel does not process moves
+
+			double ns_per_iteration() const { return 1e9 * seconds / iterations; }
+			double ns_per_pixel() const { return pixels_per_iteration > 0 ? ns_per_iteration() / pixels_per_iteration : 0.0; }
+			double moves_per_second() const { return moves_per_iteration > 0 ? moves_per_iteration * iterations / seconds : 0.0; }
+		};
+
+		std::vector<Result> results;
+
+		// Repeats iteration (with untimed setup before every run) until both minimal time and minimal iteration count are reached.
+		void measure(const std::string& kernel, const std::string& case_name, double pixels_per_iteration, double moves_per_iteration, const std::function<void()>& setup, const std::function<void()>& iteration);
+
+		void benchmark_cut_pixel();
+		void benchmark_thick_line_rasterizer();
+		void benchmark_read_from_file();
+		void benchmark_execute_on();
+	public:
+		void run_all();
+
+		void print_summary(std::ostream& stream) const;
+		void write_json(std::ostream& stream) const;
+
+		// Entry point of benchmark mode; returns process exit code.
+		static int run(const char* output_filename);
+	};
+}
\ No newline at end of file
@@ -0,0 +1,157 @@
+#include "milling_job.h"
+#include <cstring>
+#include <cstdint>
+
+namespace ManualCAD
+{
+	bool MillingSimulationCache::Key::operator==(const Key& other) const
+	{
+		if (hash != other.hash || programs.size() != other.programs.size())
+			return false;
+		for (size_t i = 0; i < programs.size(); ++i)
+			if (programs[i] != other.programs[i] && *programs[i] != *other.programs[i])
+				return false;
+		if (initial_state == other.initial_state)
+			return true;
+		const auto& a = *initial_state, & b = *other.initial_state;
+		return a.width == b.width && a.height == b.height && a.size.x == b.size.x && a.size.y == b.size.y && a.size.z == b.size.z
+			&& std::memcmp(a.data(), b.data(), map_bytes(a)) == 0;
+	}
+
+	std::shared_ptr<const HeightMap> MillingSimulationCache::find(const Key& key)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto [first, last] = index.equal_range(key.hash);
+		for (auto it = first; it != last; ++it)
+			if (it->second->key == key)
+				return it->second->state;
+		return nullptr;
+	}
+
+	void MillingSimulationCache::store(Key key, std::shared_ptr<const HeightMap> state)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto [first, last] = index.equal_range(key.hash);
+		for (auto it = first; it != last; ++it)
+			if (it->second->key == key)
+				return; // computed concurrently by another job; both results are the same
+
+		size_t entry_bytes = map_bytes(*state);
+		for (const auto& program : key.programs)
+			entry_bytes += program->size() * sizeof(float);
+		if (initial_state_uses[key.initial_state.get()]++ == 0)
+			bytes += map_bytes(*key.initial_state);
+		bytes += entry_bytes;
+		const size_t hash = key.hash;
+		entries.push_back({ std::move(key), std::move(state), entry_bytes });
+		index.insert({ hash, std::prev(entries.end()) });
+
+		// the newest state is dropped as well if it doesn't fit alone
+		while (bytes > MAX_CACHED_BYTES && !entries.empty())
+			erase_oldest();
+	}
+
+	void MillingSimulationCache::erase_oldest()
+	{
+		const auto oldest = entries.begin();
+		auto [first, last] = index.equal_range(oldest->key.hash);
+		for (auto it = first; it != last; ++it)
+			if (it->second == oldest)
+			{
+				index.erase(it);
+				break;
+			}
+		const auto* initial_state = oldest->key.initial_state.get();
+		if (--initial_state_uses[initial_state] == 0)
+		{
+			bytes -= map_bytes(*initial_state);
+			initial_state_uses.erase(initial_state);
+		}
+		bytes -= oldest->bytes;
+		entries.pop_front();
+	}
+
+	void MillingSimulationCache::clear()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		entries.clear();
+		index.clear();
+		initial_state_uses.clear();
+		bytes = 0;
+	}
+
+	size_t MillingJob::hash_height_map(const HeightMap& height_map)
+	{
+		// FNV-1a over dimensions and every PIXEL_STRIDE-th pixel value
+		constexpr size_t PIXEL_STRIDE = 61;
+		size_t hash = 14695981039346656037ull;
+		auto combine_word = [&hash](uint32_t word) {
+			hash ^= word;
+			hash *= 1099511628211ull;
+		};
+
+		combine_word(static_cast<uint32_t>(height_map.width));
+		combine_word(static_cast<uint32_t>(height_map.height));
+		const float size[] = { height_map.size.x, height_map.size.y, height_map.size.z };
+		for (int i = 0; i < 3; ++i)
+		{
+			uint32_t word;
+			std::memcpy(&word, &size[i], sizeof(word));
+			combine_word(word);
+		}
+
+		const float* pixels = height_map.data();
+		const size_t count = static_cast<size_t>(height_map.width) * height_map.height;
+		for (size_t i = 0; i < count; i += PIXEL_STRIDE)
+		{
+			uint32_t word;
+			std::memcpy(&word, &pixels[i], sizeof(word));
+			combine_word(word);
+		}
+		return hash;
+	}
+
+	size_t MillingJob::combine_hashes(size_t state_hash, size_t program_hash)
+	{
+		return state_hash ^ (program_hash + 0x9e3779b97f4a7c15ull + (state_hash << 6) + (state_hash >> 2));
+	}
+
+	std::shared_ptr<const HeightMap> MillingJob::simulate(const HeightMap& initial_state, float max_cutter_depth) const
+	{
+		// key of i-th state consists of the initial state and all programs up to i-th
+		const auto initial = std::make_shared<const HeightMap>(initial_state);
+		std::vector<MillingSimulationCache::Key> keys(programs.size());
+		std::vector<std::shared_ptr<const std::vector<float>>> contents;
+		size_t state_hash = hash_height_map(initial_state);
+		for (size_t i = 0; i < programs.size(); ++i)
+		{
+			contents.push_back(std::make_shared<const std::vector<float>>(programs[i].content_key()));
+			state_hash = combine_hashes(state_hash, programs[i].content_hash());
+			keys[i] = { state_hash, initial, contents };
+		}
+
+		// find the latest state which is already simulated
+		std::shared_ptr<const HeightMap> state = nullptr;
+		size_t first_to_simulate = programs.size();
+		while (first_to_simulate > 0)
+		{
+			state = cache->find(keys[first_to_simulate - 1]);
+			if (state != nullptr)
+				break;
+			--first_to_simulate;
+		}
+		if (state == nullptr)
+			state = initial;
+
+		for (size_t i = first_to_simulate; i < programs.size(); ++i)
+		{
+			auto next_state = std::make_shared<HeightMap>(*state);
+			programs[i].execute_on(*next_state, max_cutter_depth);
+			cache->store(std::move(keys[i]), next_state);
+			state = std::move(next_state);
+		}
+
+		return state;
+	}
+
+}
\ No newline at end of file
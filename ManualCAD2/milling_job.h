@@ -0,0 +1,73 @@
+#pragma once
+
+#include "milling_program.h"
+#include "height_map.h"
+#include <vector>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace ManualCAD
+{
+	// Stores workpiece states reached after simulating a chain of programs on an initial state. States are looked up by hash, and
+	// everything they depend on is compared on a hit. May be shared between jobs (e.g. what-if variants of the same job) and used from many threads.
+	class MillingSimulationCache {
+		static constexpr size_t MAX_CACHED_BYTES = static_cast<size_t>(128) << 20; // states are full height maps, so only the most recent ones are kept
+	public:
+		struct Key {
+			size_t hash;
+			std::shared_ptr<const HeightMap> initial_state;
+			std::vector<std::shared_ptr<const std::vector<float>>> programs; // content keys of programs executed on initial state, in order
+
+			bool operator==(const Key& other) const;
+		};
+	private:
+		struct Entry {
+			Key key;
+			std::shared_ptr<const HeightMap> state;
+			size_t bytes; // without initial state, which is usually shared by entries and is counted once
+		};
+
+		std::mutex mutex;
+		std::list<Entry> entries; // from the oldest
+		std::unordered_multimap<size_t, std::list<Entry>::iterator> index;
+		std::unordered_map<const HeightMap*, size_t> initial_state_uses;
+		size_t bytes = 0;
+
+		static size_t map_bytes(const HeightMap& map) { return static_cast<size_t>(map.width) * map.height * sizeof(float); }
+		void erase_oldest();
+	public:
+		std::shared_ptr<const HeightMap> find(const Key& key);
+		void store(Key key, std::shared_ptr<const HeightMap> state);
+		void clear();
+	};
+
+	// Ordered chain of programs executed on one workpiece (e.g. rough, flat, envelope, detailed, signature).
+	// Workpiece state after every program is memoized, so after editing i-th program only programs i, i+1, ... are simulated again.
+	class MillingJob {
+		std::vector<MillingProgram> programs;
+		std::shared_ptr<MillingSimulationCache> cache;
+
+		// Samples pixels sparsely, since cached states are compared exactly on a hit; it only has to tell most states apart quickly.
+		static size_t hash_height_map(const HeightMap& height_map);
+		static size_t combine_hashes(size_t state_hash, size_t program_hash);
+	public:
+		MillingJob() : cache(std::make_shared<MillingSimulationCache>()) {}
+		MillingJob(std::shared_ptr<MillingSimulationCache> cache) : cache(std::move(cache)) {}
+
+		void add_program(MillingProgram&& program) { programs.push_back(std::move(program)); }
+		void replace_program(size_t idx, MillingProgram&& program) { programs[idx] = std::move(program); }
+		void remove_program(size_t idx) { programs.erase(programs.begin() + idx); }
+		void swap_programs(size_t idx1, size_t idx2) { std::swap(programs[idx1], programs[idx2]); }
+		void clear() { programs.clear(); }
+
+		size_t size() const { return programs.size(); }
+		bool empty() const { return programs.empty(); }
+		const MillingProgram& get_program(size_t idx) const { return programs[idx]; }
+		const std::shared_ptr<MillingSimulationCache>& get_cache() const { return cache; }
+
+		// Returns state of the workpiece after all programs of the job, simulating only programs whose results are not cached.
+		std::shared_ptr<const HeightMap> simulate(const HeightMap& initial_state, float max_cutter_depth) const;
+	};
+}
\ No newline at end of file
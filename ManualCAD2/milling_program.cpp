@@ -1,4 +1,6 @@
 #include "milling_program.h"
+#include <algorithm>
+#include <cmath>
 #include <fstream>
 #include <iomanip>
 #include <stdexcept>
@@ -102,9 +104,13 @@ namespace ManualCAD
 			}
 			return;
 		case 'F':
+		{
 			++pos;
-			program.set_cutter_speed(extract_number(line, pos, pos) / 600); // mm/min -> cm/s
+			const float speed = extract_number(line, pos, pos) / 600.0f; // mm/min -> cm/s
+			program.set_feed_rate(speed);
+			program.set_cutter_speed(speed);
 			return;
+		}
 		case 'M':
 			return; // do nothing
 		case 'G':
@@ -167,6 +173,20 @@ namespace ManualCAD
 		}
 	}
 
+	// optimized by noting that it suffices to fully cut pixels on the beginning and the end and then draw lines with cutter profile
+	void cut_line_on_height_map(HeightMap& height_map, const Cutter& cutter, int instruction_number, const Vector3& from, const Vector3& to, const std::pair<int, int>& from_pix, const std::pair<int, int>& to_pix, float max_depth)
+	{
+		cutter.cut_pixel(height_map, instruction_number, from_pix.first, from_pix.second, from.y, max_depth);
+		ThickLineRasterizer(height_map, cutter, from, to, instruction_number, max_depth).draw();
+		cutter.cut_pixel(height_map, instruction_number, to_pix.first, to_pix.second, to.y, max_depth);
+	}
+
+	std::pair<int, int> position_to_rounded_pixel(const HeightMap& height_map, const Vector3& pos)
+	{
+		auto pix = height_map.position_to_pixel(pos);
+		return { lroundf(pix.x), lroundf(pix.y) };
+	}
+
 	class MoveCutterTaskStep : public SingleTaskStep
 	{
 		int instruction_number;
@@ -182,9 +202,7 @@ namespace ManualCAD
 
 	public:
 		MoveCutterTaskStep(Workpiece& workpiece, int instruction_number, const Cutter& cutter, const Vector3& from, const Vector3& to, const float& speed) : workpiece(workpiece), instruction_number(instruction_number), cutter(cutter), from(from), to(to), speed(speed) {
-			auto start = workpiece.height_map.position_to_pixel(from);
-
-			previous_pixel = { lroundf(start.x), lroundf(start.y) };
+			previous_pixel = position_to_rounded_pixel(workpiece.height_map, from);
 			previous_pos = from;
 
 			path_length = (to - from).length();
@@ -238,16 +256,12 @@ namespace ManualCAD
 			workpiece.invalidate();
 		}
 
-		// optimized by noting that it suffices to fully cut pixels on the beginning and the end and then draw lines with cutter profile
 		void cut_line_optimized(const Vector3& from, const Vector3& to, const std::pair<int, int>& from_pix, const std::pair<int, int>& to_pix)
 		{
-			int x0 = from_pix.first, y0 = from_pix.second,
-				x1 = to_pix.first, y1 = to_pix.second;
-
-			cutter.cut_pixel(workpiece.height_map, instruction_number, x0, y0, from.y, workpiece.get_max_cutter_depth());
-			ThickLineRasterizer(workpiece.height_map, cutter, from, to, instruction_number, workpiece.get_max_cutter_depth()).draw();
-			cutter.cut_pixel(workpiece.height_map, instruction_number, x1, y1, to.y, workpiece.get_max_cutter_depth());
-
+			if (workpiece.get_model() == Workpiece::Model::Dexel)
+				workpiece.dexel_map.cut_move(cutter, instruction_number, from, to, workpiece.get_max_cutter_depth());
+			else
+				cut_line_on_height_map(workpiece.height_map, cutter, instruction_number, from, to, from_pix, to_pix, workpiece.get_max_cutter_depth());
 			workpiece.invalidate();
 		}
 
@@ -260,9 +274,9 @@ namespace ManualCAD
 			auto current = workpiece.height_map.position_to_pixel(current_pos);
 			std::pair<int, int> current_pixel = { lroundf(current.x), lroundf(current.y) };
 
-			// check if cutter goes straight down and cuts material with a tip (warning)
+			// check if cutter goes straight down and cuts material with a tip (warning); dexel model checks it by itself
 			// if (previous_pos.x == current_pos.x && previous_pos.y == current_pos.y && workpiece.height_map.get_pixel(current_pixel.first, current_pixel.second) > current_pos.z) -> float-wise comparison (should usually work, but may reject positives)
-			if (previous_pixel == current_pixel && workpiece.height_map.get_pixel(current_pixel.first, current_pixel.second) > current_pos.y)
+			if (workpiece.get_model() == Workpiece::Model::HeightMap && previous_pixel == current_pixel && workpiece.height_map.get_pixel(current_pixel.first, current_pixel.second) > current_pos.y)
 				Logger::log_warning("[WARNING] N%d at (%d,%d): Cutting workpiece with cutter's tip (cutter going straight down)\n", instruction_number, current_pixel.first, current_pixel.second);
 
 			//cut_line_pure_bresenham(previous_pixel, current_pixel, previous_pos.z, current_pos.z);
@@ -301,6 +315,138 @@ namespace ManualCAD
 		}
 	}
 
+	void MillingProgram::execute_on(HeightMap& height_map, float max_cutter_depth) const
+	{
+		// equivalent of executing all task steps immediately, but without a workpiece object (and thus without touching renderables)
+		for (const auto& move : moves)
+		{
+			const auto from_pixel = position_to_rounded_pixel(height_map, move.origin),
+				to_pixel = position_to_rounded_pixel(height_map, move.destination);
+
+			if (from_pixel == to_pixel && height_map.get_pixel(to_pixel.first, to_pixel.second) > move.destination.y)
+				Logger::log_warning("[WARNING] N%d at (%d,%d): Cutting workpiece with cutter's tip (cutter going straight down)\n", move.instruction_number, to_pixel.first, to_pixel.second);
+
+			cut_line_on_height_map(height_map, *cutter, move.instruction_number, move.origin, move.destination, from_pixel, to_pixel, max_cutter_depth);
+		}
+	}
+
+	void MillingProgram::execute_on(DexelMap& dexel_map, float max_cutter_depth) const
+	{
+		for (const auto& move : moves)
+			dexel_map.cut_move(*cutter, move.instruction_number, move.origin, move.destination, max_cutter_depth);
+	}
+
+	size_t MillingProgram::content_hash() const
+	{
+		// FNV-1a over everything that influences the simulation result (name and speed do not)
+		size_t hash = 14695981039346656037ull;
+		auto combine = [&hash](const void* data, size_t size) {
+			const auto* bytes = static_cast<const unsigned char*>(data);
+			for (size_t i = 0; i < size; ++i)
+			{
+				hash ^= bytes[i];
+				hash *= 1099511628211ull;
+			}
+		};
+
+		const char type_char = cutter->get_type_char();
+		const float diameter = cutter->get_diameter();
+		combine(&type_char, sizeof(type_char));
+		combine(&diameter, sizeof(diameter));
+		combine(&cutter->cutting_part_height, sizeof(cutter->cutting_part_height));
+		for (const auto& move : moves)
+		{
+			combine(&move.origin, sizeof(move.origin));
+			combine(&move.destination, sizeof(move.destination));
+		}
+		return hash;
+	}
+
+	std::vector<float> MillingProgram::content_key() const
+	{
+		std::vector<float> key = { static_cast<float>(cutter->get_type_char()), cutter->get_diameter(), cutter->cutting_part_height };
+		key.reserve(key.size() + 6 * moves.size());
+		for (const auto& move : moves)
+			key.insert(key.end(), { move.origin.x, move.origin.y, move.origin.z, move.destination.x, move.destination.y, move.destination.z });
+		return key;
+	}
+
+	MillingProgram::CycleTimeEstimate MillingProgram::estimate_cycle_time(float acceleration, float junction_deviation) const
+	{
+		CycleTimeEstimate estimate;
+		const float feed = feed_rate;
+		std::vector<float> lengths;
+		std::vector<Vector3> directions;
+		std::vector<float> speeds; // speed limits at starts of moves, then planned speeds
+		lengths.reserve(moves.size());
+		directions.reserve(moves.size());
+		speeds.reserve(moves.size() + 1);
+		Vector3 previous_end = get_start_position();
+		for (const auto& move : moves)
+		{
+			const auto d = move.destination - move.origin;
+			const float length = d.length();
+			if (length == 0.0f)
+				continue;
+			const auto direction = (1.0f / length) * d;
+			float limit = 0.0f; // cutter stops at the start, after jumps and at reversals
+			if (!directions.empty() && move.origin == previous_end)
+			{
+				// junction deviation model: speed at which centripetal acceleration on an arc tangent to both moves, which passes
+				// junction_deviation from the corner, equals acceleration
+				const float cos_theta = -dot(directions.back(), direction);
+				const float sin_half = sqrtf(std::max(0.0f, 0.5f * (1.0f - cos_theta)));
+				if (sin_half >= 1.0f - 1e-6f)
+					limit = feed;
+				else if (cos_theta < 1.0f - 1e-6f)
+					limit = std::min(feed, sqrtf(acceleration * junction_deviation * sin_half / (1.0f - sin_half)));
+			}
+			lengths.push_back(length);
+			directions.push_back(direction);
+			speeds.push_back(limit);
+			previous_end = move.destination;
+		}
+		speeds.push_back(0.0f);
+		const size_t n = lengths.size();
+		if (n == 0 || feed <= 0.0f)
+			return estimate;
+
+		// backward pass bounds speeds by stopping distance, forward pass by accelerating distance
+		for (size_t i = n; i-- > 0;)
+			speeds[i] = std::min(speeds[i], sqrtf(speeds[i + 1] * speeds[i + 1] + 2.0f * acceleration * lengths[i]));
+		for (size_t i = 0; i < n; ++i)
+			speeds[i + 1] = std::min(speeds[i + 1], sqrtf(speeds[i] * speeds[i] + 2.0f * acceleration * lengths[i]));
+
+		// every move has trapezoidal (or triangular, when too short to reach feed) speed profile
+		float total_length = 0.0f, at_feed_length = 0.0f;
+		for (size_t i = 0; i < n; ++i)
+		{
+			const float v0 = speeds[i], v1 = speeds[i + 1], length = lengths[i];
+			const float accelerating = (feed * feed - v0 * v0) / (2.0f * acceleration), decelerating = (feed * feed - v1 * v1) / (2.0f * acceleration);
+			if (accelerating + decelerating <= length)
+			{
+				const float cruise = length - accelerating - decelerating;
+				estimate.seconds += (feed - v0) / acceleration + (feed - v1) / acceleration + cruise / feed;
+				at_feed_length += cruise;
+			}
+			else
+			{
+				const float peak = std::max(sqrtf(0.5f * (2.0f * acceleration * length + v0 * v0 + v1 * v1)), std::max(v0, v1));
+				estimate.seconds += (peak - v0) / acceleration + (peak - v1) / acceleration;
+			}
+			total_length += length;
+		}
+		estimate.at_feed_fraction = at_feed_length / total_length;
+		return estimate;
+	}
+
+	const MillingProgram::CycleTimeEstimate& MillingProgram::get_cycle_time_estimate() const
+	{
+		if (!cycle_time_cache.has_value())
+			cycle_time_cache = estimate_cycle_time();
+		return cycle_time_cache.value();
+	}
+
 	std::vector<Vector3> MillingProgram::get_cutter_positions() const
 	{
 		std::vector<Vector3> points;
@@ -5,8 +5,10 @@
 #include <list>
 #include "cutter_move.h"
 #include "cutter.h"
+#include "dexel_map.h"
 #include "logger.h"
 #include <memory>
+#include <optional>
 #include <vector>
 
 namespace ManualCAD
@@ -15,25 +17,52 @@ namespace ManualCAD
 	class MillingProgram {
 		friend class ObjectSettings;
 
+		static constexpr float MACHINE_ACCELERATION = 50.0f; // cm/s^2
+		static constexpr float JUNCTION_DEVIATION = 0.001f; // cm; look-ahead passes corner at speed of an arc deviating that much from it
+		static constexpr float MACHINE_FEED_RATE = 2.0f; // cm/s (1200 mm/min); used by programs without F word
+
 		float ratio_to_centimeters = 0.1f;
 		float cutter_rpm = 10000;
-		float cutter_speed = 25;
+		float cutter_speed = 25; // of animation
+		float feed_rate = MACHINE_FEED_RATE; // cm/s, of the machine
 		std::list<CutterMove> moves;
 		std::unique_ptr<Cutter> cutter;
 		std::string name;
 	public:
+		struct CycleTimeEstimate {
+			float seconds = 0.0f;
+			float at_feed_fraction = 0.0f; // fraction of path length travelled at programmed speed
+		};
+	private:
+		mutable std::optional<CycleTimeEstimate> cycle_time_cache; // valid for default machine parameters
+	public:
 		
 		MillingProgram(const char* name) : name(name) { }
 
 		Task get_task(Workpiece& workpiece, bool& task_ended) const;
 		void execute_on(Workpiece& workpiece) const;
+		// Simulates whole program on a bare height map; does not need a workpiece, thus can be run outside of the main thread.
+		void execute_on(HeightMap& height_map, float max_cutter_depth) const;
+		void execute_on(DexelMap& dexel_map, float max_cutter_depth) const;
+		// Hash of moves and cutter, used to detect if simulation result of this program may change.
+		size_t content_hash() const;
+		// Values hashed by content_hash; programs with equal keys give equal simulation results.
+		std::vector<float> content_key() const;
+
+		// Estimates time of run on a machine which plans speed with look-ahead: every move accelerates and decelerates with bounded
+		// acceleration, and corners limit speed by their angle (sharp reversals stop the cutter). All moves go at feed rate.
+		CycleTimeEstimate estimate_cycle_time(float acceleration = MACHINE_ACCELERATION, float junction_deviation = JUNCTION_DEVIATION) const;
+		// Estimate for default machine parameters, recalculated only after moves or feed rate change (e.g. to be shown every frame).
+		const CycleTimeEstimate& get_cycle_time_estimate() const;
 
 		const std::string& get_name() const { return name; }
 		float get_ratio_to_centimeters() { return ratio_to_centimeters; }
 		void set_ratio_to_centimeters(float ratio) { ratio_to_centimeters = ratio; }
 		void set_cutter_rpm(float rpm) { cutter_rpm = rpm; }
 		void set_cutter_speed(float speed) { cutter_speed = speed; }
-		void add_move(CutterMove&& move) { moves.push_back(std::move(move)); }
+		float get_feed_rate() const { return feed_rate; }
+		void set_feed_rate(float rate) { feed_rate = rate; cycle_time_cache = std::nullopt; }
+		void add_move(CutterMove&& move) { moves.push_back(std::move(move)); cycle_time_cache = std::nullopt; }
 		void set_cutter(std::unique_ptr<Cutter>&& cutter) { this->cutter = std::move(cutter); }
 		const Cutter& get_cutter() const { return *cutter; }
 		Vector3 get_start_position() const {
@@ -4,6 +4,7 @@
 #include "object_controller.h"
 #include "settings_window.h"
 #include "serializer.h"
+#include <array>
 #include <map>
 
 namespace ManualCAD
@@ -32,6 +33,51 @@ namespace ManualCAD
 		return NAN;
 	}
 
+	// Cubic Bernstein polynomials at t (basis[0]) with their first (basis[1]) and second (basis[2]) derivatives.
+	void cubic_bernstein_basis(float t, float basis[3][4])
+	{
+		const float s = 1 - t;
+		basis[0][0] = s * s * s; basis[0][1] = 3.0f * t * s * s; basis[0][2] = 3.0f * t * t * s; basis[0][3] = t * t * t;
+		basis[1][0] = -3.0f * s * s; basis[1][1] = 3.0f * s * s - 6.0f * t * s; basis[1][2] = 6.0f * t * s - 3.0f * t * t; basis[1][3] = 3.0f * t * t;
+		basis[2][0] = 6.0f * s; basis[2][1] = 6.0f * t - 12.0f * s; basis[2][2] = 6.0f * s - 12.0f * t; basis[2][3] = 6.0f * t;
+	}
+
+	// Uniform cubic B-spline (de Boor) basis at t with its derivatives, laid out as in cubic_bernstein_basis.
+	void cubic_bspline_basis(float t, float basis[3][4])
+	{
+		const float n10 = 1 - t, n11 = t;
+		const float n2m1 = n10 * (1 - t) / 2.0f, n20 = n10 * (t + 1) / 2.0f + n11 * (2 - t) / 2.0f, n21 = n11 * t / 2.0f;
+		basis[0][0] = n2m1 * (1 - t) / 3.0f; basis[0][1] = n2m1 * (t + 2) / 3.0f + n20 * (2 - t) / 3.0f; basis[0][2] = n20 * (t + 1) / 3.0f + n21 * (3 - t) / 3.0f; basis[0][3] = n21 * t / 3.0f;
+		basis[1][0] = -n2m1; basis[1][1] = n2m1 - n20; basis[1][2] = n20 - n21; basis[1][3] = n21;
+		basis[2][0] = n10; basis[2][1] = n11 - 2.0f * n10; basis[2][2] = n10 - 2.0f * n11; basis[2][3] = n11;
+	}
+
+	// Point and derivatives up to given order of a bicubic patch with control values point_at(i, j) (i-th row along v, j-th column along u),
+	// summed in a single pass over the control values.
+	template <class T, class PointAt>
+	std::array<T, 6> sum_bicubic_patch(const float basis_u[3][4], const float basis_v[3][4], int order, PointAt point_at)
+	{
+		std::array<T, 6> result{}; // point, du, dv, duu, duv, dvv
+		for (int i = 0; i < 4; ++i)
+			for (int j = 0; j < 4; ++j)
+			{
+				const T p = point_at(i, j);
+				result[0] += (basis_v[0][i] * basis_u[0][j]) * p;
+				if (order >= 1)
+				{
+					result[1] += (basis_v[0][i] * basis_u[1][j]) * p;
+					result[2] += (basis_v[1][i] * basis_u[0][j]) * p;
+				}
+				if (order >= 2)
+				{
+					result[3] += (basis_v[0][i] * basis_u[2][j]) * p;
+					result[4] += (basis_v[1][i] * basis_u[1][j]) * p;
+					result[5] += (basis_v[2][i] * basis_u[0][j]) * p;
+				}
+			}
+		return result;
+	}
+
 	const Renderable& Object::get_renderable()
 	{
 		if (!valid) {
@@ -781,7 +827,8 @@ namespace ManualCAD
 
 	Vector3 BicubicC0BezierSurface::normal(float u, float v) const
 	{
-		return normalize(cross(du(u, v), dv(u, v)));
+		const auto derivatives = evaluate_all(u, v, 1);
+		return normalize(cross(derivatives.du, derivatives.dv));
 	}
 
 	Vector3 BicubicC0BezierSurface::du(float u, float v) const
@@ -972,6 +1019,20 @@ namespace ManualCAD
 		return p[0];
 	}
 
+	SurfaceDerivatives BicubicC0BezierSurface::evaluate_all(float u, float v, int order) const
+	{
+		float uu, vv;
+		int ui, vi;
+		decompose_uv(u, v, uu, vv, ui, vi);
+		const int points_x = 3 * patches_x + 1;
+
+		float basis_u[3][4], basis_v[3][4];
+		cubic_bernstein_basis(uu, basis_u);
+		cubic_bernstein_basis(vv, basis_v);
+		const auto sums = sum_bicubic_patch<Vector3>(basis_u, basis_v, order, [&](int i, int j) { return points[(vi + i) * points_x + ui + j]->transformation.position; });
+		return { sums[0], sums[1], sums[2], sums[3], sums[4], sums[5] };
+	}
+
 	std::vector<RangedBox<float>> BicubicC0BezierSurface::get_patch_bounds() const
 	{
 		const int points_x = 3 * patches_x + 1,
@@ -1301,7 +1362,8 @@ namespace ManualCAD
 
 	Vector3 BicubicC2BezierSurface::normal(float u, float v) const
 	{
-		return normalize(cross(du(u, v), dv(u, v)));
+		const auto derivatives = evaluate_all(u, v, 1);
+		return normalize(cross(derivatives.du, derivatives.dv));
 	}
 
 	Vector3 BicubicC2BezierSurface::du(float u, float v) const
@@ -1505,6 +1567,20 @@ namespace ManualCAD
 		}
 	}
 
+	SurfaceDerivatives BicubicC2BezierSurface::evaluate_all(float u, float v, int order) const
+	{
+		float uu, vv;
+		int ui, vi;
+		decompose_uv(u, v, uu, vv, ui, vi);
+		const int points_x = patches_x + 3;
+
+		float basis_u[3][4], basis_v[3][4];
+		cubic_bspline_basis(uu, basis_u);
+		cubic_bspline_basis(vv, basis_v);
+		const auto sums = sum_bicubic_patch<Vector3>(basis_u, basis_v, order, [&](int i, int j) { return points[(vi + i) * points_x + ui + j]->transformation.position; });
+		return { sums[0], sums[1], sums[2], sums[3], sums[4], sums[5] };
+	}
+
 	std::vector<RangedBox<float>> BicubicC2BezierSurface::get_patch_bounds() const
 	{
 		const int points_x = patches_x + 3,
@@ -1808,7 +1884,8 @@ namespace ManualCAD
 
 	Vector3 BicubicC2NURBSSurface::normal(float u, float v) const
 	{
-		return normalize(cross(du(u, v), dv(u, v)));
+		const auto derivatives = evaluate_all(u, v, 1);
+		return normalize(cross(derivatives.du, derivatives.dv));
 	}
 
 	Vector3 BicubicC2NURBSSurface::du(float u, float v) const
@@ -1922,126 +1999,50 @@ namespace ManualCAD
 
 	Vector3 BicubicC2NURBSSurface::duu(float u, float v) const
 	{
-		// TODO
-		float uu, vv;
-		int ui, vi;
-		decompose_uv(u, v, uu, vv, ui, vi);
-		int points_x = patches_x + 3,
-			points_y = patches_y + 3;
-
-		Vector3 p[4];
-
-		{
-			// de Boor basis for uu
-			const float n01 = 1;
-			const float n10 = n01 * (1 - uu), n11 = n01 * uu;
-			//const float n2m1 = n10 * (1 - uu) / 2.0f, n20 = n10 * (uu + 1) / 2.0f + n11 * (2 - uu) / 2.0f, n21 = n11 * uu / 2.0f;
-			//const float n3m2 = n2m1 * (1 - uu) / 3.0f, n3m1 = n2m1 * (uu + 2) / 3.0f + n20 * (2 - uu) / 3.0f, n30 = n20 * (uu + 1) / 3.0f + n21 * (3 - uu) / 3.0f, n31 = n21 * uu / 3.0f;
-
-			for (int i = 0; i < 4; ++i)
-			{
-				auto b0 = points[(vi + i) * points_x + ui]->transformation.position,
-					b1 = points[(vi + i) * points_x + ui + 1]->transformation.position,
-					b2 = points[(vi + i) * points_x + ui + 2]->transformation.position,
-					b3 = points[(vi + i) * points_x + ui + 3]->transformation.position;
-
-				// second derivative
-				p[i] = n10 * (b2 - 2.0f * b1 + b0) + n11 * (b3 - 2.0f * b2 + b1);
-			}
-		}
-
-		{
-			// de Boor basis for vv
-			const float n01 = 1;
-			const float n10 = n01 * (1 - vv), n11 = n01 * vv;
-			const float n2m1 = n10 * (1 - vv) / 2.0f, n20 = n10 * (vv + 1) / 2.0f + n11 * (2 - vv) / 2.0f, n21 = n11 * vv / 2.0f;
-			const float n3m2 = n2m1 * (1 - vv) / 3.0f, n3m1 = n2m1 * (vv + 2) / 3.0f + n20 * (2 - vv) / 3.0f, n30 = n20 * (vv + 1) / 3.0f + n21 * (3 - vv) / 3.0f, n31 = n21 * vv / 3.0f;
-
-			return n3m2 * p[0] + n3m1 * p[1] + n30 * p[2] + n31 * p[3];
-		}
+		return evaluate_all(u, v, 2).duu;
 	}
 
 	Vector3 BicubicC2NURBSSurface::duv(float u, float v) const
 	{
-		// TODO
-		float uu, vv;
-		int ui, vi;
-		decompose_uv(u, v, uu, vv, ui, vi);
-		int points_x = patches_x + 3,
-			points_y = patches_y + 3;
-
-		Vector3 p[4];
-
-		{
-			// de Boor basis for uu
-			const float n01 = 1;
-			const float n10 = n01 * (1 - uu), n11 = n01 * uu;
-			const float n2m1 = n10 * (1 - uu) / 2.0f, n20 = n10 * (uu + 1) / 2.0f + n11 * (2 - uu) / 2.0f, n21 = n11 * uu / 2.0f;
-			//const float n3m2 = n2m1 * (1 - uu) / 3.0f, n3m1 = n2m1 * (uu + 2) / 3.0f + n20 * (2 - uu) / 3.0f, n30 = n20 * (uu + 1) / 3.0f + n21 * (3 - uu) / 3.0f, n31 = n21 * uu / 3.0f;
-
-			for (int i = 0; i < 4; ++i)
-			{
-				auto b0 = points[(vi + i) * points_x + ui]->transformation.position,
-					b1 = points[(vi + i) * points_x + ui + 1]->transformation.position,
-					b2 = points[(vi + i) * points_x + ui + 2]->transformation.position,
-					b3 = points[(vi + i) * points_x + ui + 3]->transformation.position;
-
-				// derivative
-				p[i] = n2m1 * (b1 - b0) + n20 * (b2 - b1) + n21 * (b3 - b2);
-			}
-		}
-
-		{
-			// de Boor basis for vv
-			const float n01 = 1;
-			const float n10 = n01 * (1 - vv), n11 = n01 * vv;
-			const float n2m1 = n10 * (1 - vv) / 2.0f, n20 = n10 * (vv + 1) / 2.0f + n11 * (2 - vv) / 2.0f, n21 = n11 * vv / 2.0f;
-			//const float n3m2 = n2m1 * (1 - vv) / 3.0f, n3m1 = n2m1 * (vv + 2) / 3.0f + n20 * (2 - vv) / 3.0f, n30 = n20 * (vv + 1) / 3.0f + n21 * (3 - vv) / 3.0f, n31 = n21 * vv / 3.0f;
-
-			// derivative
-			return n2m1 * (p[1] - p[0]) + n20 * (p[2] - p[1]) + n21 * (p[3] - p[2]);
-		}
+		return evaluate_all(u, v, 2).duv;
 	}
 
 	Vector3 BicubicC2NURBSSurface::dvv(float u, float v) const
 	{
-		// TODO
+		return evaluate_all(u, v, 2).dvv;
+	}
+
+	SurfaceDerivatives BicubicC2NURBSSurface::evaluate_all(float u, float v, int order) const
+	{
 		float uu, vv;
 		int ui, vi;
 		decompose_uv(u, v, uu, vv, ui, vi);
-		int points_x = patches_x + 3,
-			points_y = patches_y + 3;
+		const int points_x = patches_x + 3;
 
-		Vector3 p[4];
+		float basis_u[3][4], basis_v[3][4];
+		cubic_bspline_basis(uu, basis_u);
+		cubic_bspline_basis(vv, basis_v);
+		// derivatives of homogeneous coordinates (w * P, w), then quotient rule
+		const auto h = sum_bicubic_patch<Vector4>(basis_u, basis_v, order, [&](int i, int j) {
+			const int idx = (vi + i) * points_x + ui + j;
+			return Vector4::extend(weights[idx] * points[idx]->transformation.position, weights[idx]);
+		});
 
+		const float inv_w = 1.0f / h[0].w;
+		SurfaceDerivatives result;
+		result.point = inv_w * h[0].xyz();
+		if (order >= 1)
 		{
-			// de Boor basis for uu
-			const float n01 = 1;
-			const float n10 = n01 * (1 - uu), n11 = n01 * uu;
-			const float n2m1 = n10 * (1 - uu) / 2.0f, n20 = n10 * (uu + 1) / 2.0f + n11 * (2 - uu) / 2.0f, n21 = n11 * uu / 2.0f;
-			const float n3m2 = n2m1 * (1 - uu) / 3.0f, n3m1 = n2m1 * (uu + 2) / 3.0f + n20 * (2 - uu) / 3.0f, n30 = n20 * (uu + 1) / 3.0f + n21 * (3 - uu) / 3.0f, n31 = n21 * uu / 3.0f;
-
-			for (int i = 0; i < 4; ++i)
-			{
-				auto b0 = points[(vi + i) * points_x + ui]->transformation.position,
-					b1 = points[(vi + i) * points_x + ui + 1]->transformation.position,
-					b2 = points[(vi + i) * points_x + ui + 2]->transformation.position,
-					b3 = points[(vi + i) * points_x + ui + 3]->transformation.position;
-
-				p[i] = n3m2 * b0 + n3m1 * b1 + n30 * b2 + n31 * b3;
-			}
+			result.du = inv_w * (h[1].xyz() - h[1].w * result.point);
+			result.dv = inv_w * (h[2].xyz() - h[2].w * result.point);
 		}
-
+		if (order >= 2)
 		{
-			// de Boor basis for vv
-			const float n01 = 1;
-			const float n10 = n01 * (1 - vv), n11 = n01 * vv;
-			//const float n2m1 = n10 * (1 - vv) / 2.0f, n20 = n10 * (vv + 1) / 2.0f + n11 * (2 - vv) / 2.0f, n21 = n11 * vv / 2.0f;
-			//const float n3m2 = n2m1 * (1 - vv) / 3.0f, n3m1 = n2m1 * (vv + 2) / 3.0f + n20 * (2 - vv) / 3.0f, n30 = n20 * (vv + 1) / 3.0f + n21 * (3 - vv) / 3.0f, n31 = n21 * vv / 3.0f;
-
-			// second derivative
-			return n10 * (p[2] - 2.0f * p[1] + p[0]) + n11 * (p[3] - 2.0f * p[2] + p[1]);
+			result.duu = inv_w * (h[3].xyz() - 2.0f * h[1].w * result.du - h[3].w * result.point);
+			result.duv = inv_w * (h[4].xyz() - h[1].w * result.dv - h[2].w * result.du - h[4].w * result.point);
+			result.dvv = inv_w * (h[5].xyz() - 2.0f * h[2].w * result.dv - h[5].w * result.point);
 		}
+		return result;
 	}
 
 	std::vector<RangedBox<float>> BicubicC2NURBSSurface::get_patch_bounds() const
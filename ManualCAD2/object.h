@@ -365,6 +365,28 @@ namespace ManualCAD
 			return (transformation.get_matrix() * local).xyz();
 		}
 
+		SurfaceDerivatives evaluate_all(float u, float v, int order) const override {
+			const float sinu = sinf(u), cosu = cosf(u), sinv = sinf(v), cosv = cosf(v);
+			const float Rrcos = large_radius + small_radius * cosu;
+			const auto matrix = transformation.get_matrix();
+			auto transform = [&matrix](const Vector4& local) { return (matrix * local).xyz(); };
+
+			SurfaceDerivatives result;
+			result.point = transform({ Rrcos * cosv, small_radius * sinu, Rrcos * sinv, 1.0f });
+			if (order >= 1)
+			{
+				result.du = transform({ -small_radius * cosv * sinu, small_radius * cosu, -small_radius * sinv * sinu, 0.0f });
+				result.dv = transform({ -Rrcos * sinv, 0.0f, Rrcos * cosv, 0.0f });
+			}
+			if (order >= 2)
+			{
+				result.duu = transform({ -small_radius * cosv * cosu, -small_radius * sinu, -small_radius * sinv * cosu, 0.0f });
+				result.duv = transform({ small_radius * sinv * sinu, 0.0f, -small_radius * cosv * sinu, 0.0f });
+				result.dvv = transform({ -Rrcos * cosv, 0.0f, -Rrcos * sinv, 0.0f });
+			}
+			return result;
+		}
+
 		Box get_bounding_box() const override {
 			return Box::degenerate(); // TODO
 		}
@@ -662,6 +684,7 @@ namespace ManualCAD
 		Vector3 duu(float u, float v) const override;
 		Vector3 duv(float u, float v) const override;
 		Vector3 dvv(float u, float v) const override;
+		SurfaceDerivatives evaluate_all(float u, float v, int order) const override;
 
 		Box get_bounding_box() const override {
 			Box box = Box::degenerate();
@@ -770,6 +793,7 @@ namespace ManualCAD
 		Vector3 duu(float u, float v) const override;
 		Vector3 duv(float u, float v) const override;
 		Vector3 dvv(float u, float v) const override;
+		SurfaceDerivatives evaluate_all(float u, float v, int order) const override;
 
 		Box get_bounding_box() const override {
 			Box box = Box::degenerate();
@@ -881,6 +905,7 @@ namespace ManualCAD
 		Vector3 duu(float u, float v) const override;
 		Vector3 duv(float u, float v) const override;
 		Vector3 dvv(float u, float v) const override;
+		SurfaceDerivatives evaluate_all(float u, float v, int order) const override;
 
 		Box get_bounding_box() const override {
 			Box box = Box::degenerate();
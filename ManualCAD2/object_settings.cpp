@@ -600,13 +600,35 @@ namespace ManualCAD
 		}
 		if (ImGui::SliderFloat3("Size", workpiece.size.data(), 1.0f, 25.0f, NULL, ImGuiSliderFlags_NoInput))
 		{
-			workpiece.height_map.fill(workpiece.size);
+			workpiece.reset_material();
 			workpiece.invalidate();
 		}
+		const char* models[] = { "Height map", "Dexel" };
+		int model = static_cast<int>(workpiece.get_model());
+		if (ImGui::Combo("Model", &model, models, IM_ARRAYSIZE(models)))
+			workpiece.set_model(static_cast<Workpiece::Model>(model));
+		if (workpiece.get_model() == Workpiece::Model::Dexel)
+		{
+			ImGui::Text("Dexels");
+			ImGui::SameLine();
+			if (ImGui::SliderInt("X##dexels", &workpiece.dexel_divisions_x, 50, 1000, NULL, ImGuiSliderFlags_NoInput))
+			{
+				workpiece.recreate_height_map();
+				workpiece.invalidate();
+			}
+			ImGui::SameLine();
+			if (ImGui::SliderInt("Y##dexels", &workpiece.dexel_divisions_y, 50, 1000, NULL, ImGuiSliderFlags_NoInput))
+			{
+				workpiece.recreate_height_map();
+				workpiece.invalidate();
+			}
+		}
 		ImGui::SliderFloat("Max cutter depth", &workpiece.max_cutter_depth, 1.0f, 15.0f, NULL, ImGuiSliderFlags_NoInput);
 		ImGui::EndDisabled();
 		if (!workpiece.can_execute_milling_program())
 			ImGui::Text("Parameters can't be edited during a simulation!");
+		if (workpiece.get_model() == Workpiece::Model::Dexel)
+			ImGui::Text("Removed volume: %.3f cm^3 (%zu segments)", workpiece.dexel_map.get_removed_volume(), workpiece.dexel_map.get_segment_count());
 		ImGui::SeparatorText("Milling program");
 		if (ImGui::Button("Load program"))
 		{
@@ -638,6 +660,9 @@ namespace ManualCAD
 			ImGui::Checkbox("Cutter visible", &workpiece.cylinder.visible);
 			ImGui::SeparatorText("Cutter");
 			ImGui::SliderFloat("Speed", &program.cutter_speed, 1.0f, 100.0f, NULL, ImGuiSliderFlags_NoInput);
+			const auto& estimate = program.get_cycle_time_estimate();
+			ImGui::Text("Estimated time: %d:%02d (%.0f%% of path at feed)", static_cast<int>(estimate.seconds) / 60, static_cast<int>(estimate.seconds) % 60, 100.0f * estimate.at_feed_fraction);
+			ImGui::Text("Feed: %.0f mm/min", program.get_feed_rate() * 600.0f);
 			ImGui::SliderFloat("Cutting part height", &program.cutter->cutting_part_height, 1.0f, 10.0f, NULL, ImGuiSliderFlags_NoInput);
 			ImGui::Text("Diameter: %.1f mm", program.cutter->get_diameter() * 10.0f);
 			ImGui::Text("Type: %s", program.cutter->get_type());
@@ -650,30 +675,174 @@ namespace ManualCAD
 			if (ImGui::Button("Immediate"))
 				workpiece.execute_milling_program_immediately();
 		}
+
+		ImGui::SeparatorText("Milling job");
+		auto& job = workpiece.get_milling_job();
+		ImGui::BeginDisabled(workpiece.is_simulating_job()); // job is read by simulation worker
+		if (ImGui::BeginListBox("Programs"))
+		{
+			for (size_t i = 0; i < job.size(); ++i)
+			{
+				ImGui::Text("%s", job.get_program(i).get_name().c_str());
+				std::string tag = "##" + std::to_string(i);
+
+				ImGui::SameLine();
+				std::string reload_label = "R" + tag;
+				if (ImGui::Button(reload_label.c_str()))
+				{
+					try {
+						job.replace_program(i, MillingProgram::read_from_file(job.get_program(i).get_name().c_str()));
+					}
+					catch (std::runtime_error& e)
+					{
+						Logger::log_error("[ERROR] %s\n", e.what());
+					}
+				}
+				ImGui::SameLine();
+				std::string remove_label = "X" + tag;
+				if (ImGui::Button(remove_label.c_str()))
+				{
+					job.remove_program(i);
+					--i;
+				}
+			}
+			ImGui::EndListBox();
+		}
+		if (ImGui::Button("Add program to job"))
+		{
+			std::string filename;
+			try
+			{
+				filename = SystemDialog::open_file_dialog("Open", { {"*.k??,*.f??", nullptr} });
+			}
+			catch (const std::exception& e)
+			{
+				Logger::log_error("[ERROR] Opening program file: %s\n", e.what());
+			}
+			if (!filename.empty())
+			{
+				try {
+					job.add_program(MillingProgram::read_from_file(filename.c_str()));
+				}
+				catch (std::runtime_error& e)
+				{
+					Logger::log_error("[ERROR] %s\n", e.what());
+				}
+			}
+		}
+		ImGui::EndDisabled();
+		ImGui::BeginDisabled(!workpiece.can_execute_milling_program() || job.empty());
+		ImGui::SameLine();
+		if (ImGui::Button("Simulate job"))
+			workpiece.simulate_milling_job();
+		ImGui::EndDisabled();
 	}
 
 	void ObjectSettings::build_prototype_settings(Prototype& prototype, ObjectSettingsWindow& parent)
 	{
 		ImGui::SeparatorText("Prototype");
+		ImGui::BeginDisabled(prototype.is_generating()); // parameters are read by generation worker
 		prototype.invalidate_if(ImGui::SliderFloat3("Size", prototype.size.data(), 1.0f, 25.0f, NULL, ImGuiSliderFlags_NoInput));
 		prototype.invalidate_if(ImGui::SliderFloat("Model height", &prototype.mill_height, 0.0f, prototype.size.y, NULL, ImGuiSliderFlags_NoInput));
 		prototype.invalidate_if(ImGui::SliderFloat("Offset", &prototype.offset, 0.0f, 0.4f * std::min(prototype.size.x, prototype.size.z), NULL, ImGuiSliderFlags_NoInput));
+		ImGui::EndDisabled();
 		build_objects_list<ParametricSurfaceObject, std::list>("Surfaces", prototype, prototype.surfaces);
 
 		ImGui::SeparatorText("Generate program");
-		const char* items[] = {"Rough", "Flat plane", "Envelope", "Detailed", "Signature"};
+		const char* items[] = {"Rough", "Flat plane", "Envelope", "Detailed", "Signature", "Rest", "Waterline", "Adaptive rough"};
 		static int item_current;
 		ImGui::Combo("Program type", &item_current, items, IM_ARRAYSIZE(items));
 		const char* cutters[] = { "K16", "K08", "K01", "F12", "F10" };
 		static int cutter_current;
 		ImGui::Combo("Cutter type", &cutter_current, cutters, IM_ARRAYSIZE(cutters));
+		ImGui::Checkbox("Generate in background", &prototype.generate_in_background);
+		ImGui::BeginDisabled(prototype.generate_in_background); // worker thread always renders on CPU
+		const char* backends[] = { "GPU", "CPU" };
+		ImGui::Combo("Height map rendering", (int*)&prototype.map_backend, backends, IM_ARRAYSIZE(backends));
+		ImGui::EndDisabled();
+		ImGui::BeginDisabled(prototype.is_generating());
+		ImGui::Checkbox("Cache intersections and maps", &prototype.use_generation_cache);
+		ImGui::Checkbox("Stay-down links", &prototype.stay_down_links);
+		ImGui::EndDisabled();
+		ImGui::BeginDisabled(!prototype.use_generation_cache);
+		auto& cache = GenerationCache::session();
+		bool cache_on_disk = !cache.get_directory().empty();
+		if (ImGui::Checkbox("Keep cache on disk", &cache_on_disk))
+			cache.set_directory(cache_on_disk ? ApplicationSettings::GENERATION_CACHE_DIRECTORY : "");
+		ImGui::SameLine();
+		if (ImGui::Button("Clear cache"))
+			cache.clear();
+		ImGui::EndDisabled();
 
 		if (static_cast<Prototype::ProgramType>(item_current) == Prototype::ProgramType::Signature)
 		{
 			build_objects_list<ParametricCurveObject, std::list>("Signature curves", prototype, prototype.signature_curves);
 		}
+		if (static_cast<Prototype::ProgramType>(item_current) == Prototype::ProgramType::Detailed || static_cast<Prototype::ProgramType>(item_current) == Prototype::ProgramType::Rest)
+		{
+			ImGui::BeginDisabled(prototype.is_generating());
+			ImGui::SliderFloat("Scallop height", &prototype.detailed_scallop_height, 0.0f, 0.1f, prototype.detailed_scallop_height > 0.0f ? "%.3f" : "fixed rows", ImGuiSliderFlags_NoInput);
+			ImGui::EndDisabled();
+			if (prototype.stock_workpiece != nullptr)
+			{
+				ImGui::Text("Workpiece: %s", prototype.stock_workpiece->name.c_str());
+				ImGui::SameLine();
+				if (ImGui::Button("X##stock"))
+					prototype.stock_workpiece = nullptr;
+			}
+			else
+				ImGui::Text("Workpiece: none (bind a workpiece to the prototype)");
+		}
+		if (static_cast<Prototype::ProgramType>(item_current) == Prototype::ProgramType::Rest)
+		{
+			ImGui::BeginDisabled(prototype.is_generating());
+			ImGui::SliderFloat("Rest tolerance", &prototype.rest_tolerance, 0.005f, 0.2f, NULL, ImGuiSliderFlags_NoInput);
+			ImGui::EndDisabled();
+		}
+		if (static_cast<Prototype::ProgramType>(item_current) == Prototype::ProgramType::FlatPlane || static_cast<Prototype::ProgramType>(item_current) == Prototype::ProgramType::Envelope || static_cast<Prototype::ProgramType>(item_current) == Prototype::ProgramType::Rough)
+		{
+			ImGui::BeginDisabled(prototype.is_generating());
+			ImGui::SliderFloat("Corner tolerance", &prototype.corner_tolerance, 0.0f, 0.1f, prototype.corner_tolerance > 0.0f ? "%.3f" : "sharp", ImGuiSliderFlags_NoInput);
+			ImGui::EndDisabled();
+		}
+		if (static_cast<Prototype::ProgramType>(item_current) == Prototype::ProgramType::FlatPlane)
+		{
+			ImGui::BeginDisabled(prototype.is_generating());
+			ImGui::Checkbox("Search row direction", &prototype.flat_angle_search);
+			ImGui::BeginDisabled(prototype.flat_angle_search);
+			ImGui::SliderAngle("Row direction", &prototype.flat_zig_zag_angle, 0.0f, 179.0f, "%.0f deg", ImGuiSliderFlags_NoInput);
+			ImGui::EndDisabled();
+			ImGui::EndDisabled();
+		}
+		if (static_cast<Prototype::ProgramType>(item_current) == Prototype::ProgramType::AdaptiveRough)
+		{
+			ImGui::BeginDisabled(prototype.is_generating());
+			ImGui::SliderInt("Levels", &prototype.adaptive_levels, 1, 4, NULL, ImGuiSliderFlags_NoInput);
+			ImGui::SliderFloat("Stepover", &prototype.adaptive_stepover_factor, 0.1f, 0.5f, "%.2f of diameter", ImGuiSliderFlags_NoInput);
+			ImGui::EndDisabled();
+		}
+		if (static_cast<Prototype::ProgramType>(item_current) == Prototype::ProgramType::Waterline)
+		{
+			ImGui::BeginDisabled(prototype.is_generating());
+			ImGui::SliderFloat("Level step", &prototype.waterline_step, 0.02f, 0.5f, NULL, ImGuiSliderFlags_NoInput);
+			ImGui::SliderAngle("Min wall angle", &prototype.waterline_min_wall_angle, 0.0f, 85.0f, "%.0f deg", ImGuiSliderFlags_NoInput);
+			ImGui::EndDisabled();
+		}
 
-		if (ImGui::Button("Generate"))
+		if (prototype.is_generating())
+		{
+			const auto& progress = prototype.get_generation_progress();
+			if (progress.is_cancelled())
+				ImGui::Text("Cancelling...");
+			else
+				ImGui::Text("Generating: %s", progress.get_stage_name());
+			ImGui::ProgressBar(progress.get_progress());
+			ImGui::BeginDisabled(progress.is_cancelled());
+			if (ImGui::Button("Cancel"))
+				prototype.cancel_generation();
+			ImGui::EndDisabled();
+		}
+		else if (ImGui::Button("Generate"))
 		{
 			std::unique_ptr<Cutter> cutter;
 			if (cutter_current > 2)
@@ -681,7 +850,10 @@ namespace ManualCAD
 			else
 				cutter = std::make_unique<BallCutter>(cutter_current == 0 ? 1.6f : (cutter_current == 1 ? 0.8f : 0.1f));
 
-			prototype.generate_program(static_cast<Prototype::ProgramType>(item_current), std::move(cutter));
+			if (prototype.generate_in_background)
+				prototype.generate_program_in_background(static_cast<Prototype::ProgramType>(item_current), std::move(cutter));
+			else
+				prototype.generate_program(static_cast<Prototype::ProgramType>(item_current), std::move(cutter));
 		}
 
 		if (prototype.generated_program.has_value())
@@ -689,6 +861,9 @@ namespace ManualCAD
 			ImGui::SeparatorText("Milling program");
 			auto& program = prototype.generated_program.value();
 			ImGui::Text("Name: %s", program.get_name().c_str());
+			const auto& estimate = program.get_cycle_time_estimate();
+			ImGui::Text("Estimated time: %d:%02d (%.0f%% of path at feed)", static_cast<int>(estimate.seconds) / 60, static_cast<int>(estimate.seconds) % 60, 100.0f * estimate.at_feed_fraction);
+			ImGui::Text("Feed: %.0f mm/min", program.get_feed_rate() * 600.0f);
 			ImGui::SeparatorText("Cutter");
 			ImGui::Text("Diameter: %.1f mm", program.cutter->get_diameter() * 10.0f);
 			ImGui::Text("Type: %s", program.cutter->get_type());
@@ -15,30 +15,34 @@ namespace ManualCAD
 		Range<float> get_v_range() const override { return surf.get_v_range(); }
 
 		Vector3 evaluate(float u, float v) const override {
-			return surf.evaluate(u, v) + offset * surf.normal(u, v);
+			return evaluate_all(u, v, 0).point;
 		}
 		Vector3 normal(float u, float v) const override {
-			return normalize(cross(du(u, v), dv(u, v)));
+			const auto derivatives = evaluate_all(u, v, 1);
+			return normalize(cross(derivatives.du, derivatives.dv));
 		}
 		Vector3 du(float u, float v) const override {
-			const auto fu = surf.du(u, v),
-				fv = surf.dv(u, v),
-				fuu = surf.duu(u, v),
-				fuv = surf.duv(u, v);
-			const auto cr = cross(fu, fv);
-			const auto dcr = cross(fuu, fv) + cross(fu, fuv);
-			const float invl = 1.0f/cr.length();
-			return surf.du(u,v) + (offset * invl) * (dcr - (invl * invl * dot(dcr, cr)) * cr);
+			return evaluate_all(u, v, 1).du;
 		}
 		Vector3 dv(float u, float v) const override {
-			const auto fu = surf.du(u, v),
-				fv = surf.dv(u, v),
-				fuv = surf.duv(u, v),
-				fvv = surf.dvv(u, v);
-			const auto cr = cross(fu, fv);
-			const auto dcr = cross(fuv, fv) + cross(fu, fvv);
+			return evaluate_all(u, v, 1).dv;
+		}
+		// Derivatives of offset surface need one order more of the base surface, thus order is limited to 1.
+		SurfaceDerivatives evaluate_all(float u, float v, int order) const override {
+			const auto f = surf.evaluate_all(u, v, order >= 1 ? 2 : 1);
+			const auto cr = cross(f.du, f.dv);
 			const float invl = 1.0f / cr.length();
-			return surf.dv(u, v) + (offset * invl) * (dcr - (invl * invl * dot(dcr, cr)) * cr);
+
+			SurfaceDerivatives result;
+			result.point = f.point + (offset * invl) * cr;
+			if (order >= 1)
+			{
+				const auto dcru = cross(f.duu, f.dv) + cross(f.du, f.duv),
+					dcrv = cross(f.duv, f.dv) + cross(f.du, f.dvv);
+				result.du = f.du + (offset * invl) * (dcru - (invl * invl * dot(dcru, cr)) * cr);
+				result.dv = f.dv + (offset * invl) * (dcrv - (invl * invl * dot(dcrv, cr)) * cr);
+			}
+			return result;
 		}
 
 		Box get_bounding_box() const override {
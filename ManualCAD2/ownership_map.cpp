@@ -0,0 +1,79 @@
+#include "ownership_map.h"
+#include <algorithm>
+
+namespace ManualCAD
+{
+	uint32_t OwnershipMap::find_run(int x, int y) const
+	{
+		const auto first = runs.begin() + row_offsets[y], last = runs.begin() + row_offsets[y + 1];
+		return static_cast<uint32_t>(std::upper_bound(first, last, x, [](int x, const Run& run) { return x < run.start; }) - runs.begin()) - 1;
+	}
+
+	OwnershipMap OwnershipMap::from_index_map(const HeightMap& map)
+	{
+		OwnershipMap result(map.width, map.size);
+		std::vector<uint8_t> owners(map.width);
+		for (int y = 0; y < map.height; ++y)
+		{
+			for (int x = 0; x < map.width; ++x)
+				owners[x] = static_cast<uint8_t>(std::clamp<long>(lroundf(map.get_pixel(x, y)), NONE, MAX_OWNERS));
+			result.append_row(owners.data());
+		}
+		return result;
+	}
+
+	void OwnershipMap::encode_row(const uint8_t* owners, int width, std::vector<std::pair<uint16_t, uint8_t>>& row_runs)
+	{
+		row_runs.clear();
+		for (int x = 0; x < width; ++x)
+			if (x == 0 || owners[x] != owners[x - 1])
+				row_runs.push_back({ static_cast<uint16_t>(x), owners[x] });
+	}
+
+	void OwnershipMap::append_row(const uint8_t* owners)
+	{
+		std::vector<std::pair<uint16_t, uint8_t>> row_runs;
+		encode_row(owners, width, row_runs);
+		append_row(row_runs);
+	}
+
+	void OwnershipMap::append_row(const std::vector<std::pair<uint16_t, uint8_t>>& row_runs)
+	{
+		for (const auto& run : row_runs)
+			runs.push_back({ run.first, run.second });
+		row_offsets.push_back(static_cast<uint32_t>(runs.size()));
+		++height;
+	}
+
+	void OwnershipMap::flood_fill(int x, int y, uint8_t owner)
+	{
+		if (x < 0 || x >= width || y < 0 || y >= height)
+			return;
+		const uint32_t first = find_run(x, y);
+		const uint8_t old = runs[first].owner;
+		if (old == owner)
+			return;
+
+		// runs are relabeled when pushed, so every run is visited once
+		std::vector<std::pair<uint32_t, int>> stack = { { first, y } };
+		runs[first].owner = owner;
+		while (!stack.empty())
+		{
+			const auto [run, row] = stack.back();
+			stack.pop_back();
+			const int start = runs[run].start, end = run_end(run, row);
+			for (int neighbour_row : { row - 1, row + 1 })
+			{
+				if (neighbour_row < 0 || neighbour_row >= height)
+					continue;
+				// runs overlapping [start, end) are 4-connected with the run
+				for (uint32_t r = find_run(start, neighbour_row); r < row_offsets[neighbour_row + 1] && runs[r].start < end; ++r)
+					if (runs[r].owner == old)
+					{
+						runs[r].owner = owner;
+						stack.push_back({ r, neighbour_row });
+					}
+			}
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "algebra.h"
+#include "height_map.h"
+#include <cstdint>
+#include <vector>
+
+namespace ManualCAD
+{
+	// Owner of every pixel of a grid over XZ plane (index of the topmost surface, counted from 1, or NONE), stored as runs of equal
+	// owners in every row. Pixels are addressed as in rendered index maps, so get_pixel(x, y) answers the same as index map's get_pixel.
+	class OwnershipMap {
+		friend class GenerationCache;
+
+		struct Run {
+			uint16_t start;
+			uint8_t owner;
+		};
+
+		std::vector<Run> runs; // runs of row y are [row_offsets[y], row_offsets[y + 1]), sorted by start, the first starts at 0
+		std::vector<uint32_t> row_offsets = { 0 };
+
+		int run_end(uint32_t run, int y) const { return run + 1 < row_offsets[y + 1] ? runs[run + 1].start : width; }
+		uint32_t find_run(int x, int y) const;
+	public:
+		static constexpr uint8_t NONE = 0;
+		static constexpr uint8_t OUTSIDE = 255; // marks empty pixels connected with border of the map (see flood_fill)
+		static constexpr int MAX_OWNERS = 254;
+
+		int width = 0, height = 0;
+		Vector3 size;
+
+		OwnershipMap() {}
+		OwnershipMap(int width, const Vector3& size) : width(width), size(size) {}
+		// Converts index map (values are indices of surfaces).
+		static OwnershipMap from_index_map(const HeightMap& map);
+
+		// Rows have to be appended in order; owners of a row are given for all its pixels.
+		void append_row(const uint8_t* owners);
+		// Appends row already encoded as runs (e.g. by encode_row on another thread).
+		void append_row(const std::vector<std::pair<uint16_t, uint8_t>>& row_runs);
+		static void encode_row(const uint8_t* owners, int width, std::vector<std::pair<uint16_t, uint8_t>>& row_runs);
+
+		// Returns NONE outside the map, as get_pixel of height map.
+		uint8_t get_pixel(int x, int y) const {
+			if (x < 0 || x >= width || y < 0 || y >= height)
+				return NONE;
+			return runs[find_run(x, y)].owner;
+		}
+
+		inline Vector2 position_to_pixel(Vector2 pos) const {
+			return {
+				(pos.x / size.x + 0.5f) * width,
+				(pos.y / size.z + 0.5f) * height
+			};
+		}
+
+		// Changes owner of 4-connected region of pixels with owner equal to owner of (x, y); runs are filled as a whole.
+		void flood_fill(int x, int y, uint8_t owner);
+
+		size_t get_run_count() const { return runs.size(); }
+	};
+}
\ No newline at end of file
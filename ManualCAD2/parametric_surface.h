@@ -6,6 +6,11 @@
 
 namespace ManualCAD 
 {
+	// Point of a surface together with its partial derivatives; derivatives above the evaluated order are zero.
+	struct SurfaceDerivatives {
+		Vector3 point{}, du{}, dv{}, duu{}, duv{}, dvv{};
+	};
+
 	class ParametricSurface {
 		static constexpr float EPS = 1e-6f;
 	public:
@@ -16,6 +21,17 @@ namespace ManualCAD
 		virtual Vector3 normal(float u, float v) const = 0;
 		virtual Vector3 du(float u, float v) const = 0;
 		virtual Vector3 dv(float u, float v) const = 0;
+		// Evaluates point and derivatives up to given order (0, 1 or 2) at once; surfaces override it to share the work between derivatives.
+		virtual SurfaceDerivatives evaluate_all(float u, float v, int order) const {
+			SurfaceDerivatives result;
+			result.point = evaluate(u, v);
+			if (order >= 1)
+			{
+				result.du = du(u, v);
+				result.dv = dv(u, v);
+			}
+			return result;
+		}
 
 		virtual Box get_bounding_box() const = 0;
 		virtual std::vector<RangedBox<float>> get_patch_bounds() const = 0;
@@ -37,5 +53,16 @@ namespace ManualCAD
 		virtual Vector3 duv(float u, float v) const = 0;
 		Vector3 dvu(float u, float v) const { return duv(u, v); }
 		virtual Vector3 dvv(float u, float v) const = 0;
+
+		SurfaceDerivatives evaluate_all(float u, float v, int order) const override {
+			SurfaceDerivatives result = ParametricSurface::evaluate_all(u, v, order);
+			if (order >= 2)
+			{
+				result.duu = duu(u, v);
+				result.duv = duv(u, v);
+				result.dvv = dvv(u, v);
+			}
+			return result;
+		}
 	};
 }
\ No newline at end of file
@@ -4,12 +4,15 @@
 #include "exception.h"
 #include "linear_equation_system_4x4.h"
 #include <random>
+#include <algorithm>
+#include <future>
+#include <thread>
 
 constexpr bool NO_HINT_RANDOM_SAMPLE = true; // when false, we sample values in a grid (not random), more accurate but slower
 // TODO refactor methods for NO_HINT_RANDOM_SAMPLE = false;
 namespace ManualCAD
 {
-	std::random_device dev;
+	thread_local std::random_device dev; // intersections of different surfaces are searched in parallel
 
 	inline void check_timeout(const std::clock_t& start_time)
 	{
@@ -155,10 +158,11 @@ namespace ManualCAD
 						break;
 					} // TODO delete try-catch
 
-					const auto P1 = surf1.evaluate(sol.x, sol.y), P2 = surf2.evaluate(sol.z, sol.w);
+					const auto S1 = surf1.evaluate_all(sol.x, sol.y, 1), S2 = surf2.evaluate_all(sol.z, sol.w, 1);
+					const auto P1 = S1.point, P2 = S2.point;
 					F = Vector4::extend(P1 - P2, dot(P1 - P, tangent) - step);
-					const auto dP1u = surf1.du(sol.x, sol.y), dP1v = surf1.dv(sol.x, sol.y),
-						dP2u = -surf2.du(sol.z, sol.w), dP2v = -surf2.dv(sol.z, sol.w);
+					const auto dP1u = S1.du, dP1v = S1.dv,
+						dP2u = -S2.du, dP2v = -S2.dv;
 
 					jacobian.elem[0][0] = dP1u.x;
 					jacobian.elem[0][1] = dP1v.x;
@@ -474,14 +478,16 @@ namespace ManualCAD
 
 			// gradienty proste (TODO sprzone)
 		Vector4 result = { uv1start.x, uv1start.y, uv2start.x, uv2start.y };
-		auto surf_point1 = surf1.evaluate(result.x, result.y),
-			surf_point2 = surf2.evaluate(result.z, result.w);
+		const auto start1 = surf1.evaluate_all(result.x, result.y, 1),
+			start2 = surf2.evaluate_all(result.z, result.w, 1);
+		auto surf_point1 = start1.point,
+			surf_point2 = start2.point;
 		float fval = dot(surf_point1 - surf_point2, surf_point1 - surf_point2);
 		Vector4 grad = {
-			2.0f * dot(surf_point1 - surf_point2, surf1.du(result.x, result.y)),
-			2.0f * dot(surf_point1 - surf_point2, surf1.dv(result.x, result.y)),
-			-2.0f * dot(surf_point1 - surf_point2, surf2.du(result.z, result.w)),
-			-2.0f * dot(surf_point1 - surf_point2, surf2.dv(result.z, result.w)),
+			2.0f * dot(surf_point1 - surf_point2, start1.du),
+			2.0f * dot(surf_point1 - surf_point2, start1.dv),
+			-2.0f * dot(surf_point1 - surf_point2, start2.du),
+			-2.0f * dot(surf_point1 - surf_point2, start2.dv),
 		};
 		float alpha = 1.0f;
 		if (grad.length() < EPS)
@@ -891,7 +897,7 @@ namespace ManualCAD
 		return intersect_surfaces(surf, surf, step, max_steps, start.first, start.second, false); // TODO consider if loop forcing is useful in self-intersections 
 	}
 
-	std::list<ParametricSurfaceIntersection> ParametricSurfaceIntersection::find_many_intersections(const ParametricSurface& surf1, const ParametricSurface& surf2, float step, size_t max_steps, size_t sample_count_x, size_t sample_count_y, const bool force_loop)
+	std::list<ParametricSurfaceIntersection> ParametricSurfaceIntersection::find_many_intersections(const ParametricSurface& surf1, const ParametricSurface& surf2, float step, size_t max_steps, size_t sample_count_x, size_t sample_count_y, const bool force_loop, int max_workers)
 	{
 		auto bounds1 = surf1.get_patch_bounds(),
 			bounds2 = surf2.get_patch_bounds();
@@ -905,9 +911,7 @@ namespace ManualCAD
 		//	y2 = box2.y_max - box2.y_min;
 		//const float min_d = (1.0f / max_samples) * sqrtf(x1 * x1 + y1 * y1 + x2 * x2 + y2 * y2);
 
-		std::list<ParametricSurfaceIntersection> intersections;
-
-		std::list<std::pair<RangedBox<float>, RangedBox<float>>> intersecting_boxes;
+		std::vector<std::pair<RangedBox<float>, RangedBox<float>>> intersecting_boxes;
 		for (const auto& rb1 : bounds1)
 		{
 			for (const auto& rb2 : bounds2)
@@ -918,14 +922,32 @@ namespace ManualCAD
 			}
 		}
 
-		/*auto urange1 = surf1.get_u_range(), vrange1 = surf1.get_v_range(),
-			urange2 = surf2.get_u_range(), vrange2 = surf2.get_v_range();*/
-		for (const auto& p : intersecting_boxes)
-		{
+		// common points near samples of a pair of boxes, in order of samples; refining doesn't touch shared state, so pairs are seeded in parallel
+		auto seed_box_pair = [&](int k) {
+			std::vector<std::pair<Vector2, Vector2>> seeds;
+			const auto& p = intersecting_boxes[k];
 			auto urange1 = p.first.us, vrange1 = p.first.vs,
 				urange2 = p.second.us, vrange2 = p.second.vs;
+			auto try_sample = [&](float u1, float v1, float u2, float v2, float min_d) {
+				const float d = (surf1.evaluate(u1, v1) - surf2.evaluate(u2, v2)).length();
+				if (d < min_d)
+				{
+					try
+					{
+						const Vector2 uv1 = { u1,v1 }, uv2 = { u2,v2 };
+						seeds.push_back(find_first_common_point(surf1, surf2, uv1, uv2));
+					}
+					catch (const std::exception&)
+					{
+						// nothing
+					}
+				}
+			};
 			if constexpr (NO_HINT_RANDOM_SAMPLE)
 			{
+				// every pair has its own stream, thus samples don't depend on threads and are the same in every run
+				std::seed_seq seed{ MANY_INTERSECTIONS_SEED, static_cast<unsigned>(k) };
+				std::mt19937 generator(seed);
 				std::uniform_real_distribution<float> random_u1(urange1.from, urange1.to);
 				std::uniform_real_distribution<float> random_v1(vrange1.from, vrange1.to);
 				std::uniform_real_distribution<float> random_u2(urange2.from, urange2.to);
@@ -939,35 +961,11 @@ namespace ManualCAD
 
 				for (int i = 0; i <= samples; ++i)
 				{
-					const float u1 = random_u1(dev),
-						v1 = random_v1(dev),
-						u2 = random_u2(dev),
-						v2 = random_v2(dev);
-
-					const float d = (surf1.evaluate(u1, v1) - surf2.evaluate(u2, v2)).length();
-					if (d < min_d)
-					{
-						try
-						{
-							const Vector2 uv1 = { u1,v1 }, uv2 = { u2,v2 };
-							auto start = find_first_common_point(surf1, surf2, uv1, uv2);
-							bool is_new = true;
-							for (const auto& isec : intersections)
-							{
-								if (isec.can_be_started_by(start.first, start.second, step))
-								{
-									is_new = false;
-									break;
-								}
-							}
-							if (is_new)
-								intersections.push_back(intersect_surfaces(surf1, surf2, step, max_steps, start.first, start.second, force_loop));
-						}
-						catch (const std::exception&)
-						{
-							// nothing
-						}
-					}
+					const float u1 = random_u1(generator),
+						v1 = random_v1(generator),
+						u2 = random_u2(generator),
+						v2 = random_v2(generator);
+					try_sample(u1, v1, u2, v2, min_d);
 				}
 			}
 			else
@@ -986,33 +984,58 @@ namespace ManualCAD
 									v1 = vrange1.from + j1 * (vrange1.to - vrange1.from) / (sample_count_y + 1),
 									u2 = urange2.from + i2 * (urange2.to - urange2.from) / (sample_count_x + 1),
 									v2 = vrange2.from + j2 * (vrange2.to - vrange2.from) / (sample_count_y + 1); // from 0 and (sample_count - 1) - search includes borders, from 1 and (sample_count + 1) - do not include borders
-								const float d = (surf1.evaluate(u1, v1) - surf2.evaluate(u2, v2)).length();
-								if (d < min_d)
-								{
-									try
-									{
-										const Vector2 uv1 = { u1,v1 }, uv2 = { u2,v2 };
-										auto start = find_first_common_point(surf1, surf2, uv1, uv2);
-										bool is_new = true;
-										for (const auto& isec : intersections)
-										{
-											if (isec.can_be_started_by(start.first, start.second, step))
-											{
-												is_new = false;
-												break;
-											}
-										}
-										if (is_new)
-											intersections.push_back(intersect_surfaces(surf1, surf2, step, max_steps, start.first, start.second, force_loop));
-									}
-									catch (const std::exception&)
-									{
-										// nothing
-									}
-								}
+								try_sample(u1, v1, u2, v2, min_d);
 							}
 			}
+			return seeds;
+		};
+
+		// plain threads instead of a pool, since callers in jobs of pools would wait for it; a single worker seeds in the calling thread
+		const int pairs = static_cast<int>(intersecting_boxes.size());
+		std::vector<std::vector<std::pair<Vector2, Vector2>>> seeds(pairs);
+		const int max_threads = max_workers > 0 ? max_workers : static_cast<int>(std::thread::hardware_concurrency());
+		const int workers = std::max(1, std::min(max_threads, pairs));
+		if (workers == 1)
+		{
+			for (int k = 0; k < pairs; ++k)
+				seeds[k] = seed_box_pair(k);
 		}
+		else
+		{
+			std::vector<std::future<void>> futures;
+			for (int w = 0; w < workers; ++w)
+				futures.push_back(std::async(std::launch::async, [&seed_box_pair, &seeds, w, workers, pairs]() {
+					for (int k = w; k < pairs; k += workers)
+						seeds[k] = seed_box_pair(k);
+				}));
+			for (auto& future : futures)
+				future.get();
+		}
+
+		// merge in order of pairs and samples: seeds of curves already traced are dropped, others start new curves
+		std::list<ParametricSurfaceIntersection> intersections;
+		for (const auto& pair_seeds : seeds)
+			for (const auto& start : pair_seeds)
+			{
+				try
+				{
+					bool is_new = true;
+					for (const auto& isec : intersections)
+					{
+						if (isec.can_be_started_by(start.first, start.second, step))
+						{
+							is_new = false;
+							break;
+						}
+					}
+					if (is_new)
+						intersections.push_back(intersect_surfaces(surf1, surf2, step, max_steps, start.first, start.second, force_loop));
+				}
+				catch (const std::exception&)
+				{
+					// nothing
+				}
+			}
 		return intersections;
 	}
 }
\ No newline at end of file
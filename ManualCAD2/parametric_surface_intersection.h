@@ -8,6 +8,10 @@
 namespace ManualCAD 
 {
 	class ParametricSurfaceIntersection {
+		friend class GenerationCache;
+
+		static constexpr unsigned MANY_INTERSECTIONS_SEED = 5489u; // mixed with index of box pair into random streams of find_many_intersections
+
 		const ParametricSurface& surf1;
 		const ParametricSurface& surf2;
 		std::vector<Vector2> uvs1;
@@ -47,6 +51,8 @@ namespace ManualCAD
 		static ParametricSurfaceIntersection intersect_surfaces_without_hint(const ParametricSurface& surf1, const ParametricSurface& surf2, float step, size_t max_steps, size_t sample_count_x, size_t sample_count_y, const bool force_loop = false);
 		static ParametricSurfaceIntersection self_intersect_surface_with_hint(const ParametricSurface& surf, float step, size_t max_steps, const Vector3& hint);
 		static ParametricSurfaceIntersection self_intersect_surface_without_hint(const ParametricSurface& surf, float step, size_t max_steps, size_t sample_count_x, size_t sample_count_y);
-		static std::list<ParametricSurfaceIntersection> find_many_intersections(const ParametricSurface& surf1, const ParametricSurface& surf2, float step, size_t max_steps, size_t sample_count_x, size_t sample_count_y, const bool force_loop = false);
+		// Pairs of patch boxes are seeded on at most max_workers threads (0 means all hardware threads); callers which already run in
+		// parallel (e.g. in jobs of a pool) pass 1. Result doesn't depend on number of workers.
+		static std::list<ParametricSurfaceIntersection> find_many_intersections(const ParametricSurface& surf1, const ParametricSurface& surf2, float step, size_t max_steps, size_t sample_count_x, size_t sample_count_y, const bool force_loop = false, int max_workers = 0);
 	};
 }
\ No newline at end of file
@@ -0,0 +1,244 @@
+#include "path_ordering.h"
+#include <chrono>
+#include <cmath>
+
+namespace ManualCAD
+{
+	namespace
+	{
+		// Uniform grid over XZ of path endpoints; endpoint e is the first (e even) or the last (e odd) point of path e / 2.
+		class EndpointGrid {
+			const std::vector<Vector3>& points;
+			float min_x = 0.0f, min_z = 0.0f, cell = 1.0f;
+			int nx = 1, nz = 1;
+			std::vector<std::vector<int>> cells;
+
+			int cell_x(float x) const { return std::clamp(static_cast<int>((x - min_x) / cell), 0, nx - 1); }
+			int cell_z(float z) const { return std::clamp(static_cast<int>((z - min_z) / cell), 0, nz - 1); }
+		public:
+			EndpointGrid(const std::vector<Vector3>& points) : points(points)
+			{
+				float max_x = -INFINITY, max_z = -INFINITY;
+				min_x = min_z = INFINITY;
+				for (const auto& p : points)
+				{
+					min_x = std::min(min_x, p.x); max_x = std::max(max_x, p.x);
+					min_z = std::min(min_z, p.z); max_z = std::max(max_z, p.z);
+				}
+				// about two endpoints per cell
+				const float extent_x = std::max(max_x - min_x, 1e-6f), extent_z = std::max(max_z - min_z, 1e-6f);
+				cell = std::max(sqrtf(2.0f * extent_x * extent_z / points.size()), 1e-3f * std::max(extent_x, extent_z));
+				nx = static_cast<int>(extent_x / cell) + 1;
+				nz = static_cast<int>(extent_z / cell) + 1;
+				cells.resize(static_cast<size_t>(nx) * nz);
+				for (size_t e = 0; e < points.size(); ++e)
+					cells[cell_x(points[e].x) + cell_z(points[e].z) * nx].push_back(static_cast<int>(e));
+			}
+
+			void remove(int e)
+			{
+				auto& c = cells[cell_x(points[e].x) + cell_z(points[e].z) * nx];
+				c.erase(std::find(c.begin(), c.end(), e));
+			}
+
+			// Returns up to k endpoints nearest to p (sorted by distance) accepted by given predicate. Cells are visited in square rings
+			// around p; points beyond ring r are farther than r cells, which bounds the search.
+			template <class Accept>
+			std::vector<int> nearest(const Vector3& p, size_t k, Accept accept) const
+			{
+				std::vector<std::pair<float, int>> found;
+				const int cx = cell_x(p.x), cz = cell_z(p.z);
+				const int max_ring = std::max({ cx, nx - 1 - cx, cz, nz - 1 - cz });
+				for (int r = 0; r <= max_ring; ++r)
+				{
+					auto visit = [&](int x, int z) {
+						if (x < 0 || x >= nx || z < 0 || z >= nz)
+							return;
+						for (int e : cells[x + z * nx])
+							if (accept(e))
+								found.push_back({ (points[e] - p).length(), e });
+					};
+					for (int x = cx - r; x <= cx + r; ++x)
+					{
+						visit(x, cz - r);
+						if (r > 0)
+							visit(x, cz + r);
+					}
+					for (int z = cz - r + 1; z <= cz + r - 1; ++z)
+					{
+						visit(cx - r, z);
+						visit(cx + r, z);
+					}
+					if (found.size() >= k)
+					{
+						std::partial_sort(found.begin(), found.begin() + k, found.end());
+						found.resize(k);
+						if (found.back().first <= r * cell)
+							break;
+					}
+				}
+				std::sort(found.begin(), found.end());
+				std::vector<int> result;
+				for (const auto& f : found)
+					result.push_back(f.second);
+				return result;
+			}
+		};
+	}
+
+	std::vector<PathOrdering::Step> PathOrdering::order(const std::vector<std::pair<Vector3, Vector3>>& endpoints, const Vector3& start, const Vector3& end, float time_budget_seconds)
+	{
+		const int n = endpoints.size();
+		if (n == 0)
+			return {};
+
+		const auto deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(time_budget_seconds));
+		std::vector<Vector3> points(2 * static_cast<size_t>(n));
+		for (int i = 0; i < n; ++i)
+		{
+			points[2 * i] = endpoints[i].first;
+			points[2 * i + 1] = endpoints[i].second;
+		}
+		EndpointGrid grid(points);
+
+		// nearest neighbour tour: the path continues from the endpoint nearest to the current position
+		std::vector<Step> tour;
+		tour.reserve(n);
+		Vector3 position = start;
+		for (int i = 0; i < n; ++i)
+		{
+			const int e = grid.nearest(position, 1, [](int) { return true; }).front();
+			const int path = e / 2;
+			tour.push_back({ path, (e & 1) == 1 });
+			grid.remove(2 * path);
+			grid.remove(2 * path + 1);
+			position = points[(e & 1) ? 2 * path : 2 * path + 1];
+		}
+
+		// tour positions: first(k) is where k-th path is entered, last(k) where it's left; start and end are fixed
+		std::vector<int> position_of(n);
+		for (int k = 0; k < n; ++k)
+			position_of[tour[k].path] = k;
+		auto first = [&](int k) -> const Vector3& { return k >= n ? end : points[2 * tour[k].path + (tour[k].reversed ? 1 : 0)]; };
+		auto last = [&](int k) -> const Vector3& { return k < 0 ? start : points[2 * tour[k].path + (tour[k].reversed ? 0 : 1)]; };
+		auto d = [](const Vector3& a, const Vector3& b) { return (a - b).length(); };
+		auto reverse_block = [&](int from, int to) { // reverses tour[from..to]
+			std::reverse(tour.begin() + from, tour.begin() + to + 1);
+			for (int k = from; k <= to; ++k)
+			{
+				tour[k].reversed = !tour[k].reversed;
+				position_of[tour[k].path] = k;
+			}
+		};
+
+		// neighbour lists are computed once, from all endpoints
+		EndpointGrid full_grid(points);
+		std::vector<std::vector<int>> neighbours(points.size());
+		for (size_t e = 0; e < points.size(); ++e)
+			neighbours[e] = full_grid.nearest(points[e], NEIGHBOURS, [e](int other) { return static_cast<size_t>(other / 2) != e / 2; });
+		// whether endpoint e is currently the point at which its path is left
+		auto is_leaving = [&](int e) { return ((e & 1) == 1) != tour[position_of[e / 2]].reversed; };
+		const auto start_neighbours = full_grid.nearest(start, NEIGHBOURS, [](int) { return true; });
+
+		constexpr float MIN_GAIN = 1e-6f;
+		bool improved = true;
+		int iteration = 0;
+		while (improved)
+		{
+			improved = false;
+
+			// 2-opt: new edge between last(g - 1) and a near endpoint which leaves some path
+			for (int g = 0; g <= n; ++g)
+			{
+				if ((++iteration & 255) == 0 && std::chrono::steady_clock::now() > deadline)
+					return tour;
+
+				const int a_endpoint = g == 0 ? -1 : 2 * tour[g - 1].path + (tour[g - 1].reversed ? 0 : 1);
+				const auto& candidates = g == 0 ? start_neighbours : neighbours[a_endpoint];
+				for (int c : candidates)
+				{
+					if (!is_leaving(c))
+						continue;
+					const int q = position_of[c / 2];
+					int from, to;
+					if (q >= g) // reverse [g..q], a connects to last(q)
+					{
+						from = g;
+						to = q;
+					}
+					else if (q < g - 1) // reverse [q + 1..g - 1], last(q) connects to a
+					{
+						from = q + 1;
+						to = g - 1;
+					}
+					else
+						continue;
+
+					const float delta = d(last(from - 1), last(to)) + d(first(from), first(to + 1)) - d(last(from - 1), first(from)) - d(last(to), first(to + 1));
+					if (delta < -MIN_GAIN)
+					{
+						reverse_block(from, to);
+						improved = true;
+						break;
+					}
+				}
+			}
+
+			// Or-opt: move a block of up to OR_OPT_MAX_LENGTH paths next to a near endpoint, possibly reversed
+			for (int i = 0; i < n; ++i)
+			{
+				if ((++iteration & 255) == 0 && std::chrono::steady_clock::now() > deadline)
+					return tour;
+
+				for (int length = 1; length <= OR_OPT_MAX_LENGTH && i + length <= n; ++length)
+				{
+					const int j = i + length - 1;
+					const float removal_gain = d(last(i - 1), first(i)) + d(last(j), first(j + 1)) - d(last(i - 1), first(j + 1));
+					if (removal_gain <= MIN_GAIN)
+						continue;
+
+					bool moved = false;
+					const int block_ends[2] = { 2 * tour[i].path + (tour[i].reversed ? 1 : 0), 2 * tour[j].path + (tour[j].reversed ? 0 : 1) };
+					for (int block_end : block_ends)
+					{
+						for (int c : neighbours[block_end])
+						{
+							// block may be inserted into gap just before or just after path of c
+							const int q = position_of[c / 2];
+							for (int g : { q, q + 1 })
+							{
+								if (g >= i && g <= j + 1)
+									continue;
+								const Vector3& a = last(g - 1), & b = first(g);
+								const float forward = d(a, first(i)) + d(last(j), b) - d(a, b),
+									backward = d(a, last(j)) + d(first(i), b) - d(a, b);
+								const float cost = std::min(forward, backward);
+								if (cost - removal_gain >= -MIN_GAIN)
+									continue;
+
+								if (backward < forward)
+									reverse_block(i, j);
+								// rotate the block into place
+								if (g < i)
+									std::rotate(tour.begin() + g, tour.begin() + i, tour.begin() + j + 1);
+								else
+									std::rotate(tour.begin() + i, tour.begin() + j + 1, tour.begin() + g);
+								for (int k = std::min(g, i); k < std::max(g, j + 1); ++k)
+									position_of[tour[k].path] = k;
+								moved = improved = true;
+								break;
+							}
+							if (moved)
+								break;
+						}
+						if (moved)
+							break;
+					}
+					if (moved)
+						break;
+				}
+			}
+		}
+		return tour;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "algebra.h"
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace ManualCAD
+{
+	// Orders open paths to shorten travel between them, as a generalized TSP where every path is visited once, in either direction.
+	// Tour is built with nearest neighbour search and improved with 2-opt and Or-opt moves (on nearest endpoints only) until
+	// no move shortens it or time budget runs out.
+	class PathOrdering {
+		static constexpr size_t NEIGHBOURS = 8;
+		static constexpr int OR_OPT_MAX_LENGTH = 3;
+	public:
+		struct Step {
+			int path;
+			bool reversed;
+		};
+
+		// Paths are given by their first and last points; tour starts at start and ends at end.
+		static std::vector<Step> order(const std::vector<std::pair<Vector3, Vector3>>& endpoints, const Vector3& start, const Vector3& end, float time_budget_seconds);
+
+		// Returns paths (containers of points with front and back) in optimized order, reversing them where needed.
+		template <class Path>
+		static std::vector<Path> reorder(const std::vector<Path>& paths, const Vector3& start, const Vector3& end, float time_budget_seconds)
+		{
+			std::vector<std::pair<Vector3, Vector3>> endpoints;
+			endpoints.reserve(paths.size());
+			for (const auto& path : paths)
+				endpoints.push_back({ to_vector3(path.front()), to_vector3(path.back()) });
+
+			std::vector<Path> result;
+			result.reserve(paths.size());
+			for (const auto& step : order(endpoints, start, end, time_budget_seconds))
+			{
+				result.push_back(paths[step.path]);
+				if (step.reversed)
+					std::reverse(result.back().begin(), result.back().end());
+			}
+			return result;
+		}
+	private:
+		static Vector3 to_vector3(const Vector3& v) { return v; }
+		static Vector3 to_vector3(const Vector2& v) { return { v.x, 0.0f, v.y }; }
+	};
+}
\ No newline at end of file
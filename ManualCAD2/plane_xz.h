@@ -41,6 +41,17 @@ namespace ManualCAD
 			return { 0.0f,0.0f,0.0f };
 		}
 
+		SurfaceDerivatives evaluate_all(float u, float v, int order) const override {
+			SurfaceDerivatives result;
+			result.point = { u, height, v };
+			if (order >= 1)
+			{
+				result.du = { 1.0f,0.0f,0.0f };
+				result.dv = { 0.0f,0.0f,1.0f };
+			}
+			return result;
+		}
+
 		Box get_bounding_box() const override {
 			Box box;
 			box.x_min = min.x;
@@ -6,23 +6,27 @@
 
 namespace ManualCAD
 {
-	// Calculates and encapsulates envelope of a set of 2D polygons
+	// Calculates and encapsulates envelope (outer boundary of union) of a set of 2D polygons
 	class PolygonEnvelope {
+		std::vector<std::vector<Vector2>> loops; // ccw, the largest first
 		std::vector<Vector2> points;
 
-		void remove_loops();
-		void remove_sharp_corners();
+		void set_outer_loops(std::vector<std::vector<Vector2>>&& boundary);
 	public:
 		// polygons should be oriented ccw
 		PolygonEnvelope(const std::vector<std::vector<Vector2>>& polygons_vecs);
+		// the largest loop of envelope
 		const std::vector<Vector2>& get_points() const { return points; }
+		// all loops of envelope (more than one if polygons form disjoint groups)
+		const std::vector<std::vector<Vector2>>& get_loops() const { return loops; }
 
-		void expand(float d);
+		// offsets envelope by d, with convex corners rounded with given chord tolerance
+		void expand(float d, float tolerance = 1e-3f);
 
 		class Builder {
 			std::vector<std::vector<Vector2>> polygons;
 		public:
-			void add_polygon(const std::vector<Vector2>& polygon) { polygons.push_back(polygon); /* TODO orientation */ }
+			void add_polygon(const std::vector<Vector2>& polygon);
 			PolygonEnvelope build() const {
 				return { polygons };
 			}
@@ -0,0 +1,799 @@
+#include "polygon_union.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <queue>
+#include <set>
+
+namespace ManualCAD
+{
+	namespace
+	{
+		// bounding box is mapped to [0, GRID_EXTENT]^2; intersections are kept as fractions with terms below 2^60, and predicates on them
+		// multiply up to three such terms, which fits in 128 bits
+		constexpr double GRID_EXTENT = static_cast<double>(1 << 19);
+
+		// signed 128-bit integer (two's complement), with just the operations exact predicates need
+		class Int128 {
+			uint64_t high, low;
+
+			Int128(uint64_t high, uint64_t low) : high(high), low(low) {}
+			bool negative() const { return (high >> 63) != 0; }
+			static Int128 multiply(uint64_t a, uint64_t b)
+			{
+				constexpr uint64_t MASK = 0xffffffffu;
+				const uint64_t a0 = a & MASK, a1 = a >> 32, b0 = b & MASK, b1 = b >> 32;
+				const uint64_t p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+				const uint64_t middle = (p00 >> 32) + (p01 & MASK) + (p10 & MASK);
+				return Int128(p11 + (p01 >> 32) + (p10 >> 32) + (middle >> 32), (middle << 32) | (p00 & MASK));
+			}
+		public:
+			Int128(int64_t value) : high(value < 0 ? ~uint64_t(0) : 0), low(static_cast<uint64_t>(value)) {}
+
+			Int128 operator-() const { return Int128(~high + (low == 0), ~low + 1); }
+			Int128 operator+(const Int128& other) const
+			{
+				const uint64_t sum = low + other.low;
+				return Int128(high + other.high + (sum < low), sum);
+			}
+			Int128 operator-(const Int128& other) const { return *this + -other; }
+			// product has to fit in 128 bits
+			Int128 operator*(int64_t factor) const
+			{
+				const Int128 magnitude = negative() ? -*this : *this;
+				const uint64_t factor_magnitude = factor < 0 ? 0 - static_cast<uint64_t>(factor) : static_cast<uint64_t>(factor);
+				Int128 product = multiply(magnitude.low, factor_magnitude);
+				product.high += magnitude.high * factor_magnitude;
+				return negative() != (factor < 0) ? -product : product;
+			}
+			int sign() const { return negative() ? -1 : (high != 0 || low != 0); }
+		};
+
+		struct Point {
+			int64_t x, y;
+
+			bool operator==(const Point& other) const { return x == other.x && y == other.y; }
+			bool operator!=(const Point& other) const { return !(*this == other); }
+			bool operator<(const Point& other) const { return x < other.x || (x == other.x && y < other.y); }
+		};
+
+		int64_t cross(const Point& u, const Point& v) { return u.x * v.y - u.y * v.x; }
+		Point difference(const Point& a, const Point& b) { return { a.x - b.x, a.y - b.y }; }
+
+		// sign of the turn a -> b -> c (positive for left turn)
+		int orientation(const Point& a, const Point& b, const Point& c)
+		{
+			const int64_t value = cross(difference(b, a), difference(c, a));
+			return (value > 0) - (value < 0);
+		}
+
+		// true if direction u precedes v in ccw order starting from positive x axis
+		bool angle_less(const Point& u, const Point& v)
+		{
+			const bool lower_u = u.y < 0 || (u.y == 0 && u.x < 0), lower_v = v.y < 0 || (v.y == 0 && v.x < 0);
+			if (lower_u != lower_v)
+				return lower_v;
+			return cross(u, v) > 0;
+		}
+
+		// point (x / d, y / d) with d > 0; intersections of edges are not on the grid
+		struct RationalPoint {
+			int64_t x, y, d;
+
+			RationalPoint(int64_t x, int64_t y, int64_t d) : x(x), y(y), d(d) {}
+			RationalPoint(const Point& p) : x(p.x), y(p.y), d(1) {}
+
+			bool operator==(const Point& p) const { return x == p.x * d && y == p.y * d; }
+			// order of the sweep: by x, then by y
+			bool operator<(const RationalPoint& other) const
+			{
+				const int by_x = compare(x, other.x, other.d);
+				return by_x < 0 || (by_x == 0 && compare(y, other.y, other.d) < 0);
+			}
+			// sign of u / d - v / other_d; coordinates are below 2^20, so their difference in floating point is off by less than 1e-9
+			int compare(int64_t u, int64_t v, int64_t other_d) const
+			{
+				const double difference = static_cast<double>(u) / d - static_cast<double>(v) / other_d;
+				if (std::abs(difference) > 1e-8)
+					return difference > 0.0 ? 1 : -1;
+				return (Int128(u) * other_d - Int128(v) * d).sign();
+			}
+			// grid point of the pixel containing the point (see passes_through_pixel)
+			Point pixel() const
+			{
+				auto floor_div = [](int64_t a, int64_t b) { return a / b - (a % b < 0); };
+				return { floor_div(2 * x + d, 2 * d), floor_div(2 * y + d, 2 * d) };
+			}
+		};
+
+		class Grid {
+			double origin_x = 0.0, origin_y = 0.0, scale = 1.0;
+		public:
+			Grid(const std::vector<std::vector<Vector2>>& polygons) {
+				float min_x = INFINITY, min_y = INFINITY, max_x = -INFINITY, max_y = -INFINITY;
+				for (const auto& polygon : polygons)
+					for (const auto& p : polygon)
+					{
+						min_x = std::min(min_x, p.x); max_x = std::max(max_x, p.x);
+						min_y = std::min(min_y, p.y); max_y = std::max(max_y, p.y);
+					}
+				if (min_x > max_x)
+					return;
+				origin_x = min_x;
+				origin_y = min_y;
+				const double extent = std::max(max_x - min_x, max_y - min_y);
+				if (extent > 0.0)
+					scale = GRID_EXTENT / extent;
+			}
+
+			Point snap(const Vector2& p) const { return { llround((p.x - origin_x) * scale), llround((p.y - origin_y) * scale) }; }
+			Vector2 unsnap(const Point& p) const { return { static_cast<float>(origin_x + p.x / scale), static_cast<float>(origin_y + p.y / scale) }; }
+		};
+
+		// edge with a < b; weight is the number of polygon edges going from a to b minus number of those going from b to a
+		struct Edge {
+			Point a, b;
+			int weight;
+		};
+
+		std::vector<Edge> make_edges(const std::vector<std::vector<Vector2>>& polygons, const Grid& grid)
+		{
+			std::vector<Edge> edges;
+			for (const auto& polygon : polygons)
+				for (size_t i = 0; i < polygon.size(); ++i)
+				{
+					const Point a = grid.snap(polygon[i]), b = grid.snap(polygon[(i + 1) % polygon.size()]);
+					if (a == b)
+						continue;
+					if (a < b)
+						edges.push_back({ a, b, 1 });
+					else
+						edges.push_back({ b, a, -1 });
+				}
+			return edges;
+		}
+
+		// Predicates on intersections are evaluated in floating point first; the result is used if it's farther from zero than the
+		// bound of rounding errors (well below 1e-14 of the sum of magnitudes of the terms), otherwise they are evaluated exactly.
+
+		// sign of y of non-vertical edge at x of point p minus y of p (i.e. negative if p lies above the edge)
+		int height_relative_to(const Edge& e, const RationalPoint& p)
+		{
+			const int64_t dx = e.b.x - e.a.x, dy = e.b.y - e.a.y, along_x = p.x - e.a.x * p.d, along_y = p.y - e.a.y * p.d;
+			const double term_x = static_cast<double>(along_x) * dy, term_y = static_cast<double>(along_y) * dx;
+			const double bound = 1e-14 * (std::abs(term_x) + std::abs(term_y));
+			if (std::abs(term_x - term_y) > bound)
+				return term_x > term_y ? 1 : -1;
+			return (Int128(along_x) * dy - Int128(along_y) * dx).sign();
+		}
+
+		// sign of y of edge e minus y of edge f, both non-vertical, at x of point p
+		int height_difference(const Edge& e, const Edge& f, const RationalPoint& p)
+		{
+			// y of edge at x = p.x, multiplied by p.d and by its dx (which is positive)
+			auto approximate_height = [&p](const Edge& edge, double& magnitude) {
+				const double term_a = static_cast<double>(edge.a.y * (edge.b.x - edge.a.x)) * p.d;
+				const double term_p = static_cast<double>(p.x - edge.a.x * p.d) * (edge.b.y - edge.a.y);
+				magnitude = std::abs(term_a) + std::abs(term_p);
+				return term_a + term_p;
+			};
+			double magnitude_e, magnitude_f;
+			const double height_e = approximate_height(e, magnitude_e), height_f = approximate_height(f, magnitude_f);
+			const double value = height_e * (f.b.x - f.a.x) - height_f * (e.b.x - e.a.x);
+			if (std::abs(value) > 1e-14 * (magnitude_e * (f.b.x - f.a.x) + magnitude_f * (e.b.x - e.a.x)))
+				return value > 0.0 ? 1 : -1;
+
+			auto scaled_height = [&p](const Edge& edge) {
+				return Int128(edge.a.y * (edge.b.x - edge.a.x)) * p.d + Int128(p.x - edge.a.x * p.d) * (edge.b.y - edge.a.y);
+			};
+			return (scaled_height(e) * (f.b.x - f.a.x) - scaled_height(f) * (e.b.x - e.a.x)).sign();
+		}
+
+		// Bentley-Ottmann sweep over x (and over y at equal x), which finds all points where at least two edges meet in O((n + k) log n)
+		// for n edges and k such points. Edges crossing the sweep line are kept in order of y; all predicates are exact.
+		class IntersectionSweep {
+			const std::vector<Edge>& edges;
+			RationalPoint sweep = { 0, 0, 1 }; // current event point
+
+			// Edges crossing the sweep line in order of y at the event point p. Vertical edges are at p, edges meeting at p are ordered
+			// as right of it (by slope), edges meeting above p are still ordered as left of the point where they meet.
+			// Lookups by point are only made with the event point, which stands for edges passing through it.
+			struct StatusLess {
+				using is_transparent = void;
+				const IntersectionSweep* owner;
+
+				bool operator()(int i, int j) const { return owner->status_less(i, j); }
+				bool operator()(int i, const RationalPoint&) const { return owner->height_at_sweep(i) < 0; }
+				bool operator()(const RationalPoint&, int i) const { return owner->height_at_sweep(i) > 0; }
+			};
+
+			struct Later {
+				bool operator()(const RationalPoint& p, const RationalPoint& q) const { return q < p; }
+			};
+
+			std::priority_queue<RationalPoint, std::vector<RationalPoint>, Later> crossings; // a crossing may be found more than once
+			std::set<int, StatusLess> status;
+			std::vector<Point> hot_pixels;
+
+			bool is_vertical(int i) const { return edges[i].a.x == edges[i].b.x; }
+			int height_at_sweep(int i) const { return is_vertical(i) ? 0 : height_relative_to(edges[i], sweep); }
+			bool status_less(int i, int j) const;
+			void add_crossing(int i, int j);
+			void handle_event(std::vector<int>& starting); // continuing edges are added to starting ones
+		public:
+			IntersectionSweep(const std::vector<Edge>& edges) : edges(edges), status(StatusLess{ this }) {}
+
+			// Returns pixels (see passes_through_pixel) containing endpoints of edges or points where edges meet, sorted.
+			std::vector<Point> find_hot_pixels();
+		};
+
+		bool IntersectionSweep::status_less(int i, int j) const
+		{
+			if (i == j)
+				return false;
+			int by_height;
+			if (is_vertical(i))
+				by_height = -height_at_sweep(j);
+			else if (is_vertical(j))
+				by_height = height_at_sweep(i);
+			else
+				by_height = height_difference(edges[i], edges[j], sweep);
+			if (by_height != 0)
+				return by_height < 0;
+
+			// edges meet on the sweep line; slope of i is greater if cross product of directions of j and i is positive
+			const int64_t by_slope = cross(difference(edges[j].b, edges[j].a), difference(edges[i].b, edges[i].a));
+			if (by_slope != 0)
+				return height_at_sweep(i) > 0 ? by_slope > 0 : by_slope < 0;
+			return i < j; // overlapping edges
+		}
+
+		// adds event where edges cross at a point interior to both of them, if it's not swept yet; other points where edges meet are
+		// endpoints, which are events from the beginning
+		void IntersectionSweep::add_crossing(int i, int j)
+		{
+			const Edge& e = edges[i], & f = edges[j];
+			const int o1 = orientation(e.a, e.b, f.a), o2 = orientation(e.a, e.b, f.b),
+				o3 = orientation(f.a, f.b, e.a), o4 = orientation(f.a, f.b, e.b);
+			if (o1 * o2 >= 0 || o3 * o4 >= 0)
+				return;
+
+			const Point de = difference(e.b, e.a), df = difference(f.b, f.a);
+			int64_t numerator = cross(difference(f.a, e.a), df), denominator = cross(de, df); // crossing is at e.a + de * numerator / denominator
+			if (denominator < 0)
+			{
+				numerator = -numerator;
+				denominator = -denominator;
+			}
+			const RationalPoint crossing = { e.a.x * denominator + de.x * numerator, e.a.y * denominator + de.y * numerator, denominator };
+			if (sweep < crossing)
+				crossings.push(crossing);
+		}
+
+		void IntersectionSweep::handle_event(std::vector<int>& starting)
+		{
+			// edges in status containing the event point are adjacent; those which don't end there go on with the starting ones
+			auto [first, last] = status.equal_range(sweep);
+			size_t meeting = starting.size();
+			for (auto it = first; it != last; ++it, ++meeting)
+				if (!(sweep == edges[*it].b))
+					starting.push_back(*it);
+			if (meeting > 1)
+				hot_pixels.push_back(sweep.pixel());
+			last = status.erase(first, last);
+
+			// in their order all of them go right before the edge following the range, which is a hint for inserting
+			std::sort(starting.begin(), starting.end(), [this](int i, int j) { return status_less(i, j); });
+			first = last;
+			for (auto it = starting.rbegin(); it != starting.rend(); ++it)
+				first = status.insert(first, *it);
+
+			// only edges which became adjacent may cross
+			if (first == last)
+			{
+				if (first != status.begin() && first != status.end())
+					add_crossing(*std::prev(first), *first);
+				return;
+			}
+			if (first != status.begin())
+				add_crossing(*std::prev(first), *first);
+			if (last != status.end())
+				add_crossing(*std::prev(last), *last);
+		}
+
+		std::vector<Point> IntersectionSweep::find_hot_pixels()
+		{
+			// endpoints with edges starting there (or -1 for the end of an edge) are events from the beginning
+			std::vector<std::pair<Point, int>> endpoints;
+			endpoints.reserve(2 * edges.size());
+			for (size_t i = 0; i < edges.size(); ++i)
+			{
+				endpoints.push_back({ edges[i].a, static_cast<int>(i) });
+				endpoints.push_back({ edges[i].b, -1 });
+				hot_pixels.push_back(edges[i].a);
+				hot_pixels.push_back(edges[i].b);
+			}
+			std::sort(endpoints.begin(), endpoints.end(), [](const auto& p, const auto& q) { return p.first < q.first; });
+
+			std::vector<int> starting;
+			size_t next_endpoint = 0;
+			while (next_endpoint < endpoints.size() || !crossings.empty())
+			{
+				if (crossings.empty() || (next_endpoint < endpoints.size() && !(crossings.top() < endpoints[next_endpoint].first)))
+					sweep = endpoints[next_endpoint].first;
+				else
+					sweep = crossings.top();
+				starting.clear();
+				for (; next_endpoint < endpoints.size() && sweep == endpoints[next_endpoint].first; ++next_endpoint)
+					if (endpoints[next_endpoint].second >= 0)
+						starting.push_back(endpoints[next_endpoint].second);
+				while (!crossings.empty() && !(sweep < crossings.top()))
+					crossings.pop();
+				handle_event(starting);
+			}
+			std::sort(hot_pixels.begin(), hot_pixels.end());
+			hot_pixels.erase(std::unique(hot_pixels.begin(), hot_pixels.end()), hot_pixels.end());
+			return std::move(hot_pixels);
+		}
+
+		// Whether edge passes through pixel around grid point c: [c.x - 1/2, c.x + 1/2) x [c.y - 1/2, c.y + 1/2). Edge misses the pixel
+		// if all its corners lie on one side of its line; a corner lying on the line is moved by an infinitesimal amount left (and by much
+		// less down), as the closed box moved so is equivalent to the half-open pixel.
+		bool passes_through_pixel(const Edge& e, const Point& c)
+		{
+			if (e.a.x > c.x || e.b.x < c.x || std::min(e.a.y, e.b.y) > c.y || std::max(e.a.y, e.b.y) < c.y)
+				return false;
+			const int64_t dx = e.b.x - e.a.x, dy = e.b.y - e.a.y;
+			bool left = false, right = false;
+			for (int64_t corner_x : { 2 * (c.x - e.a.x) - 1, 2 * (c.x - e.a.x) + 1 }) // corners relative to e.a in doubled coordinates
+				for (int64_t corner_y : { 2 * (c.y - e.a.y) - 1, 2 * (c.y - e.a.y) + 1 })
+				{
+					int64_t side = dx * corner_y - dy * corner_x;
+					if (side == 0)
+						side = dy != 0 ? dy : -dx;
+					left = left || side > 0;
+					right = right || side < 0;
+				}
+			return left && right;
+		}
+
+		// merges parts with equal endpoints (summing weights); parts with zero weight are not a boundary of anything
+		std::vector<Edge> merge_edges(std::vector<Edge>& parts)
+		{
+			std::sort(parts.begin(), parts.end(), [](const Edge& e, const Edge& f) { return e.a < f.a || (e.a == f.a && e.b < f.b); });
+			std::vector<Edge> merged;
+			for (const auto& part : parts)
+			{
+				if (!merged.empty() && merged.back().a == part.a && merged.back().b == part.b)
+					merged.back().weight += part.weight;
+				else
+					merged.push_back(part);
+			}
+			merged.erase(std::remove_if(merged.begin(), merged.end(), [](const Edge& e) { return e.weight == 0; }), merged.end());
+			return merged;
+		}
+
+		// Snap rounding: every edge is replaced with a path through grid points of all hot pixels it passes through. Every point where
+		// edges meet lies in a hot pixel, so paths don't cross; and a path goes through every hot pixel around a grid point on its
+		// segments, so parts of paths meet only at endpoints or are equal.
+		std::vector<Edge> snap_edges(const std::vector<Edge>& edges, const std::vector<Point>& hot_pixels)
+		{
+			if (hot_pixels.empty())
+				return {};
+
+			// hot pixels are bucketed into square tiles (about one per tile), every edge tests pixels in tiles it passes near
+			int64_t low_x = hot_pixels[0].x, low_y = hot_pixels[0].y, high_x = low_x, high_y = low_y; // endpoints are hot, so edges are inside
+			for (const auto& p : hot_pixels)
+			{
+				low_x = std::min(low_x, p.x); high_x = std::max(high_x, p.x);
+				low_y = std::min(low_y, p.y); high_y = std::max(high_y, p.y);
+			}
+			const int64_t tile_size = static_cast<int64_t>(std::max(high_x - low_x, high_y - low_y) / sqrt(static_cast<double>(hot_pixels.size()))) + 1;
+			const int64_t columns = (high_x - low_x) / tile_size + 1, rows = (high_y - low_y) / tile_size + 1;
+			auto column_of = [low_x, high_x, tile_size](int64_t x) { return (std::clamp(x, low_x, high_x) - low_x) / tile_size; };
+			auto row_of = [low_y, high_y, tile_size](int64_t y) { return (std::clamp(y, low_y, high_y) - low_y) / tile_size; };
+			auto tile_of = [&column_of, &row_of, columns](const Point& p) { return static_cast<size_t>(column_of(p.x) + row_of(p.y) * columns); };
+
+			std::vector<size_t> tile_start(static_cast<size_t>(columns * rows) + 1, 0);
+			for (const auto& p : hot_pixels)
+				++tile_start[tile_of(p) + 1];
+			std::partial_sum(tile_start.begin(), tile_start.end(), tile_start.begin());
+			std::vector<Point> tiled(hot_pixels.size());
+			{
+				auto next = tile_start;
+				for (const auto& p : hot_pixels)
+					tiled[next[tile_of(p)]++] = p;
+			}
+
+			std::vector<Edge> parts;
+			std::vector<Point> path;
+			for (const auto& e : edges)
+			{
+				// a pixel passed through has its grid point at most 1/2 away from the edge along both axes
+				path.clear();
+				const int64_t dx = e.b.x - e.a.x, dy = e.b.y - e.a.y;
+				for (int64_t column = column_of(e.a.x - 1); column <= column_of(e.b.x + 1); ++column)
+				{
+					const int64_t from_x = std::max(e.a.x, low_x + column * tile_size - 1), to_x = std::min(e.b.x, low_x + (column + 1) * tile_size);
+					double from_y = static_cast<double>(std::min(e.a.y, e.b.y)), to_y = static_cast<double>(std::max(e.a.y, e.b.y));
+					if (dx != 0)
+					{
+						const double y1 = e.a.y + static_cast<double>(from_x - e.a.x) * dy / dx, y2 = e.a.y + static_cast<double>(to_x - e.a.x) * dy / dx;
+						from_y = std::min(y1, y2);
+						to_y = std::max(y1, y2);
+					}
+					const int64_t last_row = row_of(static_cast<int64_t>(ceil(to_y)) + 1);
+					for (int64_t row = row_of(static_cast<int64_t>(floor(from_y)) - 1); row <= last_row; ++row)
+					{
+						const size_t tile = static_cast<size_t>(column + row * columns);
+						for (size_t k = tile_start[tile]; k < tile_start[tile + 1]; ++k)
+							if (passes_through_pixel(e, tiled[k]))
+								path.push_back(tiled[k]);
+					}
+				}
+
+				// pixels along a line are in order of projections of their grid points
+				auto along = [&e, dx, dy](const Point& p) { return dx * (p.x - e.a.x) + dy * (p.y - e.a.y); };
+				std::sort(path.begin(), path.end(), [&along](const Point& p, const Point& q) { return along(p) < along(q); });
+				for (size_t k = 1; k < path.size(); ++k)
+				{
+					const Point& p = path[k - 1], & q = path[k];
+					if (p < q)
+						parts.push_back({ p, q, e.weight });
+					else
+						parts.push_back({ q, p, -e.weight });
+				}
+			}
+			return merge_edges(parts);
+		}
+
+		// Order of non-vertical edges which don't cross, at x slightly less than sweep_x (where all of them are). A point on the sweep
+		// line stands for its y in lookups.
+		struct SweepLineLess {
+			using is_transparent = void;
+			const std::vector<Edge>* edges;
+			const int64_t* sweep_x;
+
+			// y at sweep line multiplied by dx of the edge
+			int64_t scaled_height(const Edge& e) const { return e.a.y * (e.b.x - e.a.x) + (*sweep_x - e.a.x) * (e.b.y - e.a.y); }
+			bool operator()(int i, int j) const
+			{
+				const Edge& e = (*edges)[i], & f = (*edges)[j];
+				const int64_t by_height = scaled_height(e) * (f.b.x - f.a.x) - scaled_height(f) * (e.b.x - e.a.x);
+				if (by_height != 0)
+					return by_height < 0;
+				return cross(difference(f.b, f.a), difference(e.b, e.a)) > 0; // left of the point where edges meet, the steeper one is lower
+			}
+			bool operator()(int i, const Point& p) const { return scaled_height((*edges)[i]) < p.y * ((*edges)[i].b.x - (*edges)[i].a.x); }
+			bool operator()(const Point& p, int i) const { return p.y * ((*edges)[i].b.x - (*edges)[i].a.x) < scaled_height((*edges)[i]); }
+		};
+
+		// Planar graph of edges meeting only at endpoints. Half-edge 2i goes along edge i (from a to b), 2i + 1 goes back; face of a half-edge
+		// lies on its left.
+		class PlanarGraph {
+			const std::vector<Edge>& edges;
+			std::vector<Point> vertices; // sorted
+			std::vector<int> around; // half-edges leaving every vertex in ccw order, for vertices in order
+			std::vector<size_t> first_around; // of every vertex, and the end
+			std::vector<int> origin, position; // vertex of half-edge and its position around it
+			std::vector<int> face;
+			int face_count = 0;
+
+			const Point& start(int h) const { return (h & 1) ? edges[h / 2].b : edges[h / 2].a; }
+			Point direction(int h) const {
+				const Edge& e = edges[h / 2];
+				return (h & 1) ? difference(e.a, e.b) : difference(e.b, e.a);
+			}
+			int weight(int h) const { return (h & 1) ? -edges[h / 2].weight : edges[h / 2].weight; }
+			size_t degree(int v) const { return first_around[v + 1] - first_around[v]; }
+			int next(int h) const { // next half-edge around the face: the first one clockwise from the twin at the end vertex
+				const int twin = h ^ 1, v = origin[twin];
+				return around[first_around[v] + (position[twin] + degree(v) - 1) % degree(v)];
+			}
+
+			void build_faces();
+		public:
+			PlanarGraph(const std::vector<Edge>& edges);
+			std::vector<std::vector<Vector2>> positive_region_boundary(const Grid& grid);
+		};
+
+		PlanarGraph::PlanarGraph(const std::vector<Edge>& edges) : edges(edges)
+		{
+			// half-edges sorted by their start and then by angle give vertices and half-edges around them at once
+			std::vector<std::pair<Point, int>> starts(2 * edges.size()); // kept with half-edges, so that sorting doesn't jump over edges
+			for (size_t h = 0; h < starts.size(); ++h)
+				starts[h] = { start(static_cast<int>(h)), static_cast<int>(h) };
+			std::sort(starts.begin(), starts.end(), [this](const std::pair<Point, int>& s, const std::pair<Point, int>& t) {
+				return s.first != t.first ? s.first < t.first : angle_less(direction(s.second), direction(t.second));
+			});
+			around.resize(starts.size());
+			origin.resize(starts.size());
+			position.resize(starts.size());
+			for (size_t k = 0; k < starts.size(); ++k)
+			{
+				const int h = around[k] = starts[k].second;
+				if (k == 0 || starts[k].first != starts[k - 1].first)
+				{
+					vertices.push_back(starts[k].first);
+					first_around.push_back(k);
+				}
+				origin[h] = static_cast<int>(vertices.size()) - 1;
+				position[h] = static_cast<int>(k - first_around.back());
+			}
+			first_around.push_back(around.size());
+
+			build_faces();
+		}
+
+		void PlanarGraph::build_faces()
+		{
+			face.assign(origin.size(), -1);
+			const int half_edge_count = static_cast<int>(origin.size());
+			for (int h = 0; h < half_edge_count; ++h)
+			{
+				if (face[h] != -1)
+					continue;
+				for (int current = h; face[current] == -1; current = next(current))
+					face[current] = face_count;
+				++face_count;
+			}
+		}
+
+		std::vector<std::vector<Vector2>> PlanarGraph::positive_region_boundary(const Grid& grid)
+		{
+			// winding numbers are propagated across edges from the outer face of every component, relative to it at first
+			std::vector<size_t> first_face_edge(face_count + 1, 0);
+			for (int f : face)
+				++first_face_edge[f + 1];
+			std::partial_sum(first_face_edge.begin(), first_face_edge.end(), first_face_edge.begin());
+			std::vector<int> face_edges(face.size());
+			{
+				auto next_face_edge = first_face_edge;
+				const int half_edge_count = static_cast<int>(face.size());
+				for (int h = 0; h < half_edge_count; ++h)
+					face_edges[next_face_edge[face[h]]++] = h;
+			}
+
+			constexpr int UNKNOWN = INT32_MIN;
+			std::vector<int> winding(face_count, UNKNOWN), component(face_count);
+			std::vector<size_t> component_start; // lowest-left vertex of every component, in order
+			std::queue<int> faces;
+			for (size_t v = 0; v < vertices.size(); ++v) // vertices are sorted, thus the first vertex of a component is its lowest-left one
+			{
+				if (winding[face[around[first_around[v]]]] != UNKNOWN) // component is done
+					continue;
+
+				// all edges leave the lowest-left vertex to the right, so the one turned most ccw has the outer face on its left
+				int outer = around[first_around[v]];
+				for (size_t k = first_around[v]; k < first_around[v + 1]; ++k)
+					if (cross(direction(outer), direction(around[k])) > 0)
+						outer = around[k];
+
+				winding[face[outer]] = 0;
+				component[face[outer]] = static_cast<int>(component_start.size());
+				component_start.push_back(v);
+				faces.push(face[outer]);
+				while (!faces.empty())
+				{
+					const int f = faces.front();
+					faces.pop();
+					for (size_t k = first_face_edge[f]; k < first_face_edge[f + 1]; ++k)
+					{
+						const int h = face_edges[k], other = face[h ^ 1];
+						if (winding[other] != UNKNOWN)
+							continue;
+						winding[other] = winding[f] - weight(h);
+						component[other] = component[f];
+						faces.push(other);
+					}
+				}
+			}
+
+			// outer face of a component lies in a face of components found before, which is just below its lowest-left vertex (seen
+			// slightly left of it, where no edges of the component are). It's found with a sweep stopping at these vertices, keeping
+			// non-vertical edges which cross the sweep line; edges between stops are skipped.
+			std::vector<int> component_winding(component_start.size(), 0);
+			if (component_start.size() > 1)
+			{
+				std::vector<int> by_end;
+				for (size_t i = 0; i < edges.size(); ++i) // edges are sorted by start
+					if (edges[i].a.x != edges[i].b.x)
+						by_end.push_back(static_cast<int>(i));
+				std::sort(by_end.begin(), by_end.end(), [this](int i, int j) { return edges[i].b.x < edges[j].b.x; });
+				std::vector<bool> inserted(edges.size(), false);
+				size_t started = 0, ended = 0;
+				int64_t sweep_x = vertices[component_start[1]].x;
+				std::set<int, SweepLineLess> crossing(SweepLineLess{ &edges, &sweep_x });
+				for (size_t c = 1; c < component_start.size(); ++c)
+				{
+					const Point& p = vertices[component_start[c]];
+					// edges ending before the stop are removed while the sweep line is still at the previous one, where they are
+					for (; ended < by_end.size() && edges[by_end[ended]].b.x < p.x; ++ended)
+						if (inserted[by_end[ended]])
+							crossing.erase(by_end[ended]);
+					sweep_x = p.x;
+					for (; started < edges.size() && edges[started].a.x < p.x; ++started)
+						if (edges[started].b.x >= p.x && edges[started].a.x != edges[started].b.x)
+						{
+							crossing.insert(static_cast<int>(started));
+							inserted[started] = true;
+						}
+
+					const auto above = crossing.lower_bound(p);
+					if (above != crossing.begin())
+					{
+						const int below = face[2 * *std::prev(above)]; // face above an edge is on its left
+						component_winding[c] = winding[below] + component_winding[component[below]];
+					}
+				}
+			}
+			for (int f = 0; f < face_count; ++f)
+				winding[f] += component_winding[component[f]];
+
+			auto is_boundary = [this, &winding](int h) { return winding[face[h]] > 0 && winding[face[h ^ 1]] <= 0; };
+			std::vector<bool> visited(face.size(), false);
+			std::vector<std::vector<Vector2>> loops;
+			const int half_edge_count = static_cast<int>(face.size());
+			for (int h = 0; h < half_edge_count; ++h)
+			{
+				if (visited[h] || !is_boundary(h))
+					continue;
+
+				// winding numbers of a planar graph are consistent, so the loop closes; if it didn't, it would be dropped rather than
+				// failing the whole union
+				std::vector<Point> loop;
+				int current = h;
+				while (current != -1 && !visited[current])
+				{
+					visited[current] = true;
+					loop.push_back(vertices[origin[current]]);
+					int candidate = next(current);
+					for (size_t turns = 0; candidate != -1 && !is_boundary(candidate); ++turns) // rotate around the end vertex through faces inside the region
+						candidate = turns == degree(origin[candidate]) ? -1 : next(candidate ^ 1);
+					current = candidate;
+				}
+				if (current != h)
+					continue;
+
+				std::vector<Vector2> result;
+				result.reserve(loop.size());
+				for (size_t k = 0; k < loop.size(); ++k)
+				{
+					const Point& previous = loop[(k + loop.size() - 1) % loop.size()], & following = loop[(k + 1) % loop.size()];
+					if (orientation(previous, loop[k], following) != 0 || loop.size() <= 3) // skip vertices from splitting straight edges
+						result.push_back(grid.unsnap(loop[k]));
+				}
+				loops.push_back(std::move(result));
+			}
+			return loops;
+		}
+
+		// Douglas-Peucker simplification of a closed polygon; every removed point lies within tolerance from the result
+		std::vector<Vector2> simplify(const std::vector<Vector2>& polygon, float tolerance)
+		{
+			const size_t n = polygon.size();
+			if (n < 4)
+				return polygon;
+
+			size_t farthest = 0; // polygon is split into two chains between the first and the farthest point
+			for (size_t i = 1; i < n; ++i)
+				if ((polygon[i] - polygon[0]).lengthsq() > (polygon[farthest] - polygon[0]).lengthsq())
+					farthest = i;
+
+			std::vector<bool> keep(n, false);
+			keep[0] = keep[farthest] = true;
+			std::vector<std::pair<size_t, size_t>> chains = { { 0, farthest }, { farthest, n } }; // index n stands for 0
+			while (!chains.empty())
+			{
+				const auto [from, to] = chains.back();
+				chains.pop_back();
+				const Vector2& a = polygon[from], & b = polygon[to % n];
+				const Vector2 ab = b - a;
+				const float length = ab.length();
+
+				size_t worst = from;
+				float worst_distance = tolerance;
+				for (size_t i = from + 1; i < to; ++i)
+				{
+					const float distance = length > 0.0f ? std::abs(cross_sign(ab, polygon[i] - a)) / length : (polygon[i] - a).length();
+					if (distance > worst_distance)
+					{
+						worst_distance = distance;
+						worst = i;
+					}
+				}
+				if (worst == from)
+					continue;
+				keep[worst] = true;
+				chains.push_back({ from, worst });
+				chains.push_back({ worst, to });
+			}
+
+			std::vector<Vector2> result;
+			for (size_t i = 0; i < n; ++i)
+				if (keep[i])
+					result.push_back(polygon[i]);
+			return result;
+		}
+
+		// raw offset curve (Chen, McMains): edges moved along normals, arcs around convex corners and reflex corners connected through
+		// the original vertex; its points with positive winding number form the offset polygon
+		std::vector<Vector2> raw_offset(const std::vector<Vector2>& polygon, float d, float tolerance)
+		{
+			std::vector<Vector2> points;
+			for (size_t i = 0; i < polygon.size(); ++i)
+				if (points.empty() || (polygon[i] - points.back()).lengthsq() > 0.0f)
+					points.push_back(polygon[i]);
+			while (points.size() > 1 && (points.back() - points.front()).lengthsq() == 0.0f)
+				points.pop_back();
+			if (points.size() < 3)
+				return {};
+
+			const size_t n = points.size();
+			std::vector<Vector2> normals(n); // outward normal (for ccw polygon) of edge following the point
+			for (size_t i = 0; i < n; ++i)
+			{
+				const Vector2 t = normalize(points[(i + 1) % n] - points[i]);
+				normals[i] = { t.y, -t.x };
+			}
+
+			const float arc_step = 2.0f * acosf(std::max(-1.0f, 1.0f - tolerance / std::abs(d)));
+			std::vector<Vector2> curve;
+			for (size_t i = 0; i < n; ++i)
+			{
+				const Vector2& p = points[i], & n_prev = normals[(i + n - 1) % n], & n_next = normals[i];
+				const float sin_angle = cross_sign(n_prev, n_next), cos_angle = dot(n_prev, n_next);
+				curve.push_back(p + d * n_prev);
+				if (sin_angle * d > 0.0f) // convex corner in direction of offset
+				{
+					const float angle = atan2f(sin_angle, cos_angle);
+					const int steps = std::min(256, static_cast<int>(ceilf(std::abs(angle) / arc_step)));
+					for (int k = 1; k < steps; ++k)
+					{
+						const float a = angle * k / steps;
+						const Vector2 r = { n_prev.x * cosf(a) - n_prev.y * sinf(a), n_prev.x * sinf(a) + n_prev.y * cosf(a) };
+						curve.push_back(p + d * r);
+					}
+				}
+				else if (sin_angle != 0.0f || cos_angle < 0.0f)
+					curve.push_back(p);
+				curve.push_back(p + d * n_next);
+			}
+			return curve;
+		}
+	}
+
+	std::vector<std::vector<Vector2>> PolygonUnion::unite(const std::vector<std::vector<Vector2>>& polygons)
+	{
+		const Grid grid(polygons);
+		const auto edges = make_edges(polygons, grid);
+		const auto snapped = snap_edges(edges, IntersectionSweep(edges).find_hot_pixels());
+		return PlanarGraph(snapped).positive_region_boundary(grid);
+	}
+
+	std::vector<std::vector<Vector2>> PolygonUnion::offset(const std::vector<std::vector<Vector2>>& polygons, float d, float tolerance)
+	{
+		if (d == 0.0f)
+			return unite(polygons);
+
+		std::vector<std::vector<Vector2>> curves;
+		curves.reserve(polygons.size());
+		for (const auto& polygon : polygons)
+		{
+			// every vertex of the raw offset curve contributes edges as long as the offset, so dense input is simplified first
+			auto curve = raw_offset(simplify(polygon, tolerance), d, tolerance);
+			if (!curve.empty())
+				curves.push_back(std::move(curve));
+		}
+		return unite(curves);
+	}
+
+	float PolygonUnion::signed_area(const std::vector<Vector2>& polygon)
+	{
+		double area = 0.0;
+		for (size_t i = 0; i < polygon.size(); ++i)
+			area += cross_sign(polygon[i], polygon[(i + 1) % polygon.size()]);
+		return static_cast<float>(0.5 * area);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "algebra.h"
+#include <vector>
+
+namespace ManualCAD
+{
+	// Union and offset of sets of polygons. Polygons are snapped to an integer grid, points where edges meet are found with a Bentley-Ottmann
+	// sweep with exact predicates in O((n + k) log n), and edges are snap rounded through pixels of these points, so they form a planar graph
+	// in one pass. Faces of the graph get winding numbers and the result is the boundary of the region with positive winding number.
+	class PolygonUnion {
+	public:
+		// Returns boundary of union of polygons, where ccw polygons add area and cw polygons are holes.
+		// Left side of every returned loop is inside, thus outer loops are ccw and holes are cw.
+		static std::vector<std::vector<Vector2>> unite(const std::vector<std::vector<Vector2>>& polygons);
+		// Returns boundary of union of polygons offset by d (positive d expands ccw polygons). Convex corners are rounded with arcs
+		// approximated with given chord tolerance.
+		static std::vector<std::vector<Vector2>> offset(const std::vector<std::vector<Vector2>>& polygons, float d, float tolerance);
+
+		static float signed_area(const std::vector<Vector2>& polygon);
+	};
+}
\ No newline at end of file
@@ -6,15 +6,56 @@
 #include "surface_path.h"
 #include "offset_surface.h"
 #include "rough_path.h"
+#include "adaptive_rough_path.h"
 #include "curve_path.h"
+#include "waterline_path.h"
+#include "thread_pool.h"
+#include "path_ordering.h"
+#include "corner_smoothing.h"
+#include "height_map_dilation.h"
+#include "logger.h"
 
 namespace ManualCAD
 {
 	int Prototype::counter = 0;
 
+	namespace
+	{
+		// generations of all prototypes share a few workers (generation itself may use other threads)
+		ThreadPool& generation_pool()
+		{
+			static ThreadPool pool(2);
+			return pool;
+		}
+	}
+
+	// Waits (without blocking a frame) for program generated on a worker thread and hands it over to the prototype.
+	class ProgramGenerationTaskStep : public SingleTaskStep
+	{
+		Prototype& prototype;
+		std::shared_ptr<Prototype::ProgramGeneration> generation; // keeps task_ended flag alive as long as the task
+	public:
+		ProgramGenerationTaskStep(Prototype& prototype, const std::shared_ptr<Prototype::ProgramGeneration>& generation) : prototype(prototype), generation(generation) {}
+
+		bool execute(const TaskParameters& parameters) override {
+			if (prototype.surfaces_changed()) // program would not match the model
+				generation->progress.cancel();
+			if (generation->result.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+				return true;
+			prototype.finish_generation();
+			return false;
+		}
+
+		void execute_immediately(const TaskParameters& parameters) override {
+			generation->result.wait();
+			prototype.finish_generation();
+		}
+	};
+
 	void Prototype::generate_renderable()
 	{
-		update_view();
+		if (!is_generating()) // worker reads view boundary, so it is not updated until generation ends
+			update_view();
 		view.color = color;
 	}
 
@@ -48,49 +89,51 @@ namespace ManualCAD
 		return { point.x,safe_height(),point.y };
 	}
 
-	std::vector<Vector3> Prototype::link_flat_paths(const std::vector<std::vector<Vector2>>& paths)
+	std::vector<Vector3> Prototype::link_flat_paths(const std::vector<std::vector<Vector2>>& unordered_paths, const ClearanceMap* clearance_map)
 	{
 		const Vector2 min = { view_boundary_points[0].x, view_boundary_points[0].z },
 			max = { view_boundary_points[2].x, view_boundary_points[2].z };
 		const float height = view_boundary_points[0].y;
-
-		size_t point_count = 3; // start path
+		// with clearance map cutter descends beside the block and reaches the first path with a checked link, thus paths are ordered
+		// from there; otherwise it descends at the first path like at any other one
+		const Vector2 to_leap = { min.x - 2.0f * scale, 0.5f * (min.y + max.y) };
+		const Vector2 tour_start = clearance_map != nullptr ? to_leap : 0.5f * (min + max);
+		const Vector3 tour_start3 = { tour_start.x, 0.0f, tour_start.y }, middle = { 0.5f * (min.x + max.x), 0.0f, 0.5f * (min.y + max.y) }; // reorder takes Vector2 (x, z) as (x, 0, z)
+		const auto paths = PathOrdering::reorder(unordered_paths, tour_start3, middle, LINK_ORDER_TIME_BUDGET);
+
+		size_t point_count = clearance_map != nullptr ? 5 : 2; // start path
 		for (const auto& p : paths)
 			point_count += p.size() + 2; // path plus leap
 
 		std::vector<Vector3> result;
 		result.reserve(point_count);
 
-		Vector2 to_leap;
-		const auto& start_point = paths.front().front();
-		if (start_point.x <= center.x)
-		{
-			to_leap = { min.x - 2.0f * scale, 0.5f * (min.y + max.y) };
-		}
-		else if (start_point.x >= center.x)
+		std::vector<Vector3> l;
+		if (clearance_map != nullptr)
 		{
-			to_leap = { max.x + 2.0f * scale, 0.5f * (min.y + max.y) };
+			l = leap(0.5f * (min + max), to_leap);
+			result.insert(result.end(), l.begin(), l.end());
+			result.push_back({ to_leap.x, height, to_leap.y });
+			append_link({ to_leap.x, height, to_leap.y }, { paths.front().front().x, height, paths.front().front().y }, *clearance_map, result);
 		}
-		/*else if (start_point.y <= min.y)
+		else
 		{
-			to_leap = { 0.5f * (min.x + max.x), min.y - scale };
+			l = leap(0.5f * (min + max), paths.front().front());
+			result.insert(result.end(), l.begin(), l.end());
 		}
-		else if (start_point.y >= max.y)
-		{
-			to_leap = { 0.5f * (min.x + max.x), max.y + scale };
-		}*/
-
-		auto l = leap(0.5f * (min + max), to_leap);
-		result.insert(result.end(), l.begin(), l.end());
-		result.push_back({ to_leap.x, height, to_leap.y });
 		for (int i = 0; i < paths.size() - 1; ++i)
 		{
 			for (const auto& v : paths[i])
 			{
 				result.push_back({ v.x, height, v.y });
 			}
-			l = leap(paths[i].back(), paths[i + 1].front());
-			result.insert(result.end(), l.begin(), l.end());
+			if (clearance_map != nullptr)
+				append_link({ paths[i].back().x, height, paths[i].back().y }, { paths[i + 1].front().x, height, paths[i + 1].front().y }, *clearance_map, result);
+			else
+			{
+				l = leap(paths[i].back(), paths[i + 1].front());
+				result.insert(result.end(), l.begin(), l.end());
+			}
 		}
 		for (const auto& v : paths.back())
 			result.push_back({ v.x, height, v.y });
@@ -99,15 +142,16 @@ namespace ManualCAD
 		to_workpiece_coords(result);
 
 		if constexpr (ApplicationSettings::DEBUG)
-			assert(result.size() == point_count);
+			assert(clearance_map != nullptr ? result.size() <= point_count : result.size() == point_count);
 
 		return result;
 	}
 
-	std::vector<Vector3> Prototype::link_paths(const std::vector<std::vector<Vector3>>& paths)
+	std::vector<Vector3> Prototype::link_paths(const std::vector<std::vector<Vector3>>& unordered_paths)
 	{
 		const Vector2 min = { view_boundary_points[0].x, view_boundary_points[0].z },
 			max = { view_boundary_points[2].x, view_boundary_points[2].z };
+		const auto paths = PathOrdering::reorder(unordered_paths, elevate(0.5f * (min + max)), elevate(0.5f * (min + max)), LINK_ORDER_TIME_BUDGET);
 		float height = view_boundary_points[0].y + scale * signature_depth;
 
 		std::vector<Vector3> result;
@@ -140,37 +184,25 @@ namespace ManualCAD
 		return result;
 	}
 
-	std::vector<Vector3> Prototype::link_surface_ball_cutter_paths(const std::vector<std::vector<std::vector<Vector2>>>& paths, const float radius, const PlaneXZ& plane)
+	std::vector<std::vector<Vector3>> Prototype::sample_surface_ball_cutter_paths(const std::vector<std::vector<std::vector<Vector2>>>& paths, const float radius, const PlaneXZ& plane)
 	{
-		const Vector2 min = { view_boundary_points[0].x, view_boundary_points[0].z },
-			max = { view_boundary_points[2].x, view_boundary_points[2].z };
-		const float height = view_boundary_points[0].y;
-
-		std::vector<std::list<Vector3>> surface_results(surfaces.size() + 1); // plus 1 because we also make paths for plane
+		std::vector<std::vector<Vector3>> paths3d;
 
 		// paths for surfaces
 		int i = 0;
-		for (const auto* surf : surfaces)
+		for (const auto* surf : generation_surfaces)
 		{
 			auto offset_surf = OffsetSurface{ *surf, radius };
 			for (const auto& path : paths[i])
 			{
-				std::list<Vector3> path3d;
-				constexpr float step = 0.05f;
-				for (int j = 0; j < path.size() - 1; ++j)
-				{
-					const float d = (path[j + 1] - path[j]).length();
-					for (float t = 0.0f; t <= d; t += step)
-					{
-						auto uv = lerp(path[j], path[j + 1], t);
-						path3d.push_back(offset_surf.evaluate(uv.x, uv.y) - Vector3{0.0f, radius, 0.0f}); // VERY important: subtract radius from position (because of ball cutter: curves mark movement of its center)
-					}	
-				}
+				std::vector<Vector3> path3d;
+				SurfacePath::sample_path(offset_surf, path, scale * SURFACE_PATH_CHORD_TOLERANCE, scale * SURFACE_PATH_MAX_SEGMENT_LENGTH, path3d);
+				for (auto& p : path3d)
+					p.y -= radius; // VERY important: subtract radius from position (because of ball cutter: curves mark movement of its center)
 				//for (int j = 0; j < path.size(); ++j) // improper: only for zig-zag testing
 				//	path3d.push_back(offset_surf.evaluate(path[j].x, path[j].y));
-				path3d.push_front(elevate_to_rough(path3d.front()));
-				path3d.push_back(elevate_to_rough(path3d.back()));
-				surface_results[i].insert(surface_results[i].begin(), path3d.begin(), path3d.end());
+				if (path3d.size() > 1)
+					paths3d.push_back(std::move(path3d));
 			}
 			++i;
 		}
@@ -178,36 +210,191 @@ namespace ManualCAD
 		// paths for plane
 		for (const auto& path : paths.back())
 		{
-			std::list<Vector3> path3d;
+			std::vector<Vector3> path3d;
 			for (int j = 0; j < path.size(); ++j)
 				path3d.push_back(plane.evaluate(path[j].x, path[j].y) - Vector3{ 0.0f, radius, 0.0f });
-			path3d.push_front(elevate_to_rough(path3d.front()));
-			path3d.push_back(elevate_to_rough(path3d.back()));
-			surface_results[i].insert(surface_results[i].begin(), path3d.begin(), path3d.end());
+			if (!path3d.empty())
+				paths3d.push_back(std::move(path3d));
 		}
+		return paths3d;
+	}
 
-		size_t point_count = 2;
-		for (const auto& r : surface_results)
-			point_count += r.size();
+	std::vector<Vector3> Prototype::link_cutter_tip_paths(const std::vector<std::vector<Vector3>>& unordered_paths, const ClearanceMap* clearance_map)
+	{
+		const Vector2 min = { view_boundary_points[0].x, view_boundary_points[0].z },
+			max = { view_boundary_points[2].x, view_boundary_points[2].z };
 
-		std::vector<Vector3> result;
-		result.reserve(point_count);
+		// paths are milled in order which shortens links between them (every path may be reversed)
+		const auto start = elevate(0.5f * (min + max));
+		const auto paths3d = PathOrdering::reorder(unordered_paths, start, start, LINK_ORDER_TIME_BUDGET);
 
-		result.push_back(elevate(0.5f * (min + max)));
+		std::vector<Vector3> result;
+		result.push_back(start);
+		for (int k = 0; k < paths3d.size(); ++k)
+		{
+			if (k == 0)
+				result.push_back(elevate_to_rough(paths3d[k].front()));
+			else if (clearance_map != nullptr)
+				append_link(paths3d[k - 1].back(), paths3d[k].front(), *clearance_map, result);
+			else
+			{
+				result.push_back(elevate_to_rough(paths3d[k - 1].back()));
+				result.push_back(elevate_to_rough(paths3d[k].front()));
+			}
+			result.insert(result.end(), paths3d[k].begin(), paths3d[k].end());
+		}
+		if (!paths3d.empty())
+			result.push_back(elevate_to_rough(paths3d.back().back()));
+		result.push_back(start);
 
-		for (auto& r : surface_results)
-			result.insert(result.end(), r.begin(), r.end());
+		to_workpiece_coords(result);
+		return result;
+	}
 
-		result.push_back(elevate(0.5f * (min + max)));
+	Prototype::ClearanceMap Prototype::render_clearance_map(const Cutter& cutter, HeightMapRenderer::Backend backend, int pooling)
+	{
+		Box box;
+		box.x_min = view_boundary_points[0].x;
+		box.x_max = view_boundary_points[2].x;
+		box.z_min = view_boundary_points[0].z;
+		box.z_max = view_boundary_points[2].z;
+		box.y_min = view_boundary_points[0].y;
+		box.y_max = box.y_min + scale * mill_height;
+		auto height_map = HeightMapRenderer{ generation_surfaces, box }.render_height_map({ size.x, mill_height, size.z }, backend);
+
+		// as in rough paths, rendered map is transposed
+		const auto pooled_map = HeightMapDilation::max_pool(height_map, pooling);
+		return { HeightMapDilation::dilate_by_cutter(pooled_map, cutter, pooled_map.size.z / pooled_map.height, pooled_map.size.x / pooled_map.width), std::move(height_map), cutter };
+	}
 
-		to_workpiece_coords(result);
+	Prototype::ClearanceMap Prototype::make_stock_clearance_map(const HeightMap& stock, const Cutter& cutter)
+	{
+		// stock is resampled (with maximum) to a square map transposed like rendered maps, with heights above base of the model
+		const float base = size.y - mill_height;
+		auto resample = [&](int pooling) {
+			const int n = std::max(1, std::max(stock.width, stock.height) / pooling);
+			HeightMap map(n, n, { size.x, mill_height, size.z });
+			float* pixels = map.data();
+			for (int b = 0; b < n; ++b)
+				for (int a = 0; a < n; ++a)
+				{
+					const auto from = stock.position_to_pixel(map.pixel_to_position({ static_cast<float>(b), static_cast<float>(a) })),
+						to = stock.position_to_pixel(map.pixel_to_position({ static_cast<float>(b + 1), static_cast<float>(a + 1) }));
+					const int x_from = std::clamp(static_cast<int>(floorf(from.x)), 0, stock.width - 1), x_to = std::clamp(static_cast<int>(ceilf(to.x)) - 1, x_from, stock.width - 1),
+						z_from = std::clamp(static_cast<int>(floorf(from.y)), 0, stock.height - 1), z_to = std::clamp(static_cast<int>(ceilf(to.y)) - 1, z_from, stock.height - 1);
+					float h = 0.0f;
+					for (int x = x_from; x <= x_to; ++x)
+						for (int z = z_from; z <= z_to; ++z)
+							h = std::max(h, stock.get_pixel(x, z) - base);
+					pixels[a + b * n] = h / mill_height;
+				}
+			return map;
+		};
+		const auto map = resample(CLEARANCE_MAP_POOLING);
+		return { HeightMapDilation::dilate_by_cutter(map, cutter, map.size.z / map.height, map.size.x / map.width), resample(1), cutter };
+	}
 
-		if constexpr (ApplicationSettings::DEBUG)
-			assert(result.size() == point_count);
+	std::vector<std::vector<Vector3>> Prototype::clip_to_rest_material(const std::vector<std::vector<Vector3>>& paths, const HeightMap& stock_clearance_map)
+	{
+		const float base = size.y - mill_height;
+		const float cell = std::min(stock_clearance_map.size.x / stock_clearance_map.width, stock_clearance_map.size.z / stock_clearance_map.height);
+		// cutter removes material where its tip is below the lowest height at which it doesn't touch the stock
+		auto removes_material = [&](const Vector3& p) {
+			const auto coords = stock_clearance_map.position_to_pixel(p);
+			return p.y < base + stock_clearance_map.get_pixel(coords.y, coords.x) - rest_tolerance;
+		};
 
+		std::vector<std::vector<Vector3>> result;
+		for (const auto& path : paths)
+		{
+			std::vector<Vector3> part;
+			for (int j = 0; j + 1 < path.size(); ++j)
+			{
+				// segments are checked with map's resolution, as they may be much longer than a cell
+				const auto a = to_workpiece_coords(path[j]), b = to_workpiece_coords(path[j + 1]);
+				const int samples = static_cast<int>(Vector2{ b.x - a.x, b.z - a.z }.length() / cell) + 2;
+				bool engaged = false;
+				for (int s = 0; s < samples && !engaged; ++s)
+					engaged = removes_material(lerp(a, b, static_cast<float>(s) / (samples - 1)));
+
+				if (engaged)
+				{
+					if (part.empty())
+						part.push_back(path[j]);
+					part.push_back(path[j + 1]);
+				}
+				else if (!part.empty())
+				{
+					result.push_back(std::move(part));
+					part.clear();
+				}
+			}
+			if (!part.empty())
+				result.push_back(std::move(part));
+		}
 		return result;
 	}
 
+	void Prototype::append_link(const Vector3& from, const Vector3& to, const ClearanceMap& clearance, std::vector<Vector3>& result)
+	{
+		if (!stay_down_links)
+		{
+			result.push_back(elevate_to_rough(from));
+			result.push_back(elevate_to_rough(to));
+			return;
+		}
+
+		const auto& clearance_map = clearance.map, & source = clearance.source;
+		const auto a = to_workpiece_coords(from), b = to_workpiece_coords(to);
+		const float base = size.y - mill_height; // clearance map heights are measured from base of the model
+		const float cell = std::min(clearance_map.size.x / clearance_map.width, clearance_map.size.z / clearance_map.height);
+		const float source_cell = std::min(source.size.x / source.width, source.size.z / source.height);
+		const float length = Vector2{ b.x - a.x, b.z - a.z }.length();
+
+		bool straight_clear = true;
+		float highest = std::max(a.y, b.y);
+		const float tolerance = b.y < a.y ? 0.0f : LINK_TOLERANCE; // descending cutter would plunge into material below the map
+		auto check = [&](const Vector3& p, float map_h) {
+			highest = std::max(highest, base + map_h);
+			if (p.y < base + map_h - tolerance)
+				straight_clear = false;
+		};
+		const int samples = static_cast<int>(length / cell) + 2;
+		for (int s = 0; s < samples; ++s)
+		{
+			const float t = static_cast<float>(s) / (samples - 1);
+			if (t * length < cell || (1.0f - t) * length < cell)
+				continue;
+			const auto p = lerp(a, b, t);
+			const auto coords = clearance_map.position_to_pixel(p);
+			check(p, clearance_map.get_pixel(coords.y, coords.x));
+		}
+		// within a cell of the ends (e.g. along walls of the model, where cutter already stands) pooled map would stop the link,
+		// thus there samples are as fine as the unpooled map and are dilated exactly
+		for (float d = source_cell; d < std::min(cell, 0.5f * length); d += source_cell)
+			for (const float t : { d / length, 1.0f - d / length })
+			{
+				const auto p = lerp(a, b, t);
+				const auto coords = source.position_to_pixel(p);
+				check(p, HeightMapDilation::dilate_pixel_by_cutter(source, clearance.cutter, source.size.z / source.height, source.size.x / source.width,
+					static_cast<int>(coords.y), static_cast<int>(coords.x)));
+			}
+		if (straight_clear)
+			return;
+
+		const float link_height = scale * (highest + LINK_CLEARANCE) + center.y;
+		if (link_height >= height_after_rough())
+		{
+			result.push_back(elevate_to_rough(from));
+			result.push_back(elevate_to_rough(to));
+		}
+		else
+		{
+			result.push_back(elevate_to(from, link_height));
+			result.push_back(elevate_to(to, link_height));
+		}
+	}
+
 	std::vector<Vector3> Prototype::link_single_flat_loop(const std::vector<Vector2>& loop)
 	{
 		const Vector2 min = { view_boundary_points[0].x, view_boundary_points[0].z },
@@ -299,52 +486,70 @@ namespace ManualCAD
 		//points = compact_path(points);
 		//auto intersections = ParametricSurfaceIntersection::find_many_intersections(*surfaces.front(), plane, 0.01f, 2500, 20, 20, false);
 		//std::vector<Vector3> points = link_single_flat_loop(intersections.back().get_uvs2());
-		auto lines = SurfacePath{ surfaces }.generate_paths(plane, scale * 0.4f, scale * 0.724f, scale * mill_height, size);
+		auto lines = SurfacePath{ generation_surfaces }.generate_paths(plane, scale * 0.4f, scale * 0.724f, scale * mill_height, size, map_backend, nullptr, generation_cache());
 		std::vector<Vector3> points;
 
 		int i = 0;
-		for (auto* surf : surfaces)
+		for (auto* surf : generation_surfaces)
 		{
 			auto s = OffsetSurface{ *surf, scale * 0.4f };
 			for (const auto& l : lines[i])
-			{
-				const float step = 0.05f;
-				for (int j = 0; j < l.size() - 1; ++j)
-				{
-					const float d = (l[j + 1] - l[j]).length();
-					for (float t = 0.0f; t <= d; t += step)
-					{
-						auto uv = lerp(l[j], l[j + 1], t);
-						points.push_back(s.evaluate(uv.x, uv.y));
-					}
-				}
-			}
+				SurfacePath::sample_path(s, l, scale * SURFACE_PATH_CHORD_TOLERANCE, scale * SURFACE_PATH_MAX_SEGMENT_LENGTH, points);
 			++i;
 		}
 		view.set_data(points);
 	}
 
-	void Prototype::generate_rough_program(const Cutter& cutter)
+	std::optional<MillingProgram> Prototype::generate_rough_program(const Cutter& cutter, HeightMapRenderer::Backend backend, GenerationProgress& progress)
+	{
+		const Vector2 min = { view_boundary_points[0].x, view_boundary_points[0].z },
+			max = { view_boundary_points[2].x, view_boundary_points[2].z };
+		RoughPath path{ generation_surfaces, center, min, max, size.y - mill_height, size.y, scale };
+		auto points = path.generate_path(2, size, cutter, cutter.get_radius() * rough_epsilon_factor, rough_height_offset, backend, &progress);
+
+		progress.set_stage(GenerationProgress::Stage::Linking);
+		points = CornerSmoothing::smooth(compact_path(points), corner_tolerance, CORNER_CHORD_TOLERANCE); // blends need whole segments, not collinear pieces
+
+		MillingProgram program{ "Rough" };
+		program.add_move({ 3,false,{0.0f, safe_height_unscaled(), 0.0f}, {points[0].x, safe_height_unscaled(), points[0].z} });
+		program.add_move({ 4,false,{points[0].x, safe_height_unscaled(), points[0].z}, points[0] });
+		int i = 0;
+		for (; i < points.size() - 1; ++i)
+			program.add_move({ i + 5,false,points[i],points[i + 1] });
+
+		program.add_move({ i + 5,false, points.back(), {points.back().x, safe_height_unscaled(), points.back().z} });
+		program.add_move({ i + 6,false,{points.back().x, safe_height_unscaled(), points.back().z}, {0.0f, safe_height_unscaled(), 0.0f} });
+		return program;
+	}
+
+	std::optional<MillingProgram> Prototype::generate_adaptive_rough_program(const Cutter& cutter, HeightMapRenderer::Backend backend, GenerationProgress& progress)
 	{
 		const Vector2 min = { view_boundary_points[0].x, view_boundary_points[0].z },
 			max = { view_boundary_points[2].x, view_boundary_points[2].z };
-		RoughPath path{ surfaces, center, min, max, size.y - mill_height, size.y, scale };
-		auto points = path.generate_path(2, size, cutter.get_radius(), cutter.get_radius() * rough_epsilon_factor, rough_height_offset);
+		AdaptiveRoughPath path{ generation_surfaces, center, min, max, size.y - mill_height, size.y, scale };
+		auto points = path.generate_path(adaptive_levels, size, cutter, 2.0f * cutter.get_radius() * adaptive_stepover_factor, rough_height_offset, backend, &progress);
+		if (points.empty())
+		{
+			Logger::log_warning("[WARNING] No stock to remove above the model\n");
+			return std::nullopt;
+		}
 
-		compact_path(points);
+		progress.set_stage(GenerationProgress::Stage::Linking);
+		points = compact_path(points);
 
-		generated_program = MillingProgram{ "Rough" };
-		generated_program.value().add_move({ 3,false,{0.0f, safe_height_unscaled(), 0.0f}, {points[0].x, safe_height_unscaled(), points[0].z} });
-		generated_program.value().add_move({ 4,false,{points[0].x, safe_height_unscaled(), points[0].z}, points[0] });
+		MillingProgram program{ "Adaptive rough" };
+		program.add_move({ 3,false,{0.0f, safe_height_unscaled(), 0.0f}, {points[0].x, safe_height_unscaled(), points[0].z} });
+		program.add_move({ 4,false,{points[0].x, safe_height_unscaled(), points[0].z}, points[0] });
 		int i = 0;
 		for (; i < points.size() - 1; ++i)
-			generated_program.value().add_move({ i + 5,false,points[i],points[i + 1] });
+			program.add_move({ i + 5,false,points[i],points[i + 1] });
 
-		generated_program.value().add_move({ i + 5,false, points.back(), {points.back().x, safe_height_unscaled(), points.back().z} });
-		generated_program.value().add_move({ i + 6,false,{points.back().x, safe_height_unscaled(), points.back().z}, {0.0f, safe_height_unscaled(), 0.0f} });
+		program.add_move({ i + 5,false, points.back(), {points.back().x, safe_height_unscaled(), points.back().z} });
+		program.add_move({ i + 6,false,{points.back().x, safe_height_unscaled(), points.back().z}, {0.0f, safe_height_unscaled(), 0.0f} });
+		return program;
 	}
 
-	void Prototype::generate_flat_plane_program(const Cutter& cutter)
+	std::optional<MillingProgram> Prototype::generate_flat_plane_program(const Cutter& cutter, HeightMapRenderer::Backend backend, GenerationProgress& progress)
 	{
 		const Vector2 min = { view_boundary_points[0].x, view_boundary_points[0].z },
 			max = { view_boundary_points[2].x, view_boundary_points[2].z },
@@ -355,8 +560,11 @@ namespace ManualCAD
 
 		const float radius = scale * cutter.get_radius();
 
-		for (const auto* surf : surfaces)
+		progress.set_stage(GenerationProgress::Stage::Intersecting);
+		int surfaces_done = 0;
+		for (const auto* surf : generation_surfaces)
 		{
+			progress.set_progress(static_cast<float>(surfaces_done++) / generation_surfaces.size());
 			OffsetSurface offset_surf{ *surf, radius };
 			try
 			{
@@ -371,19 +579,31 @@ namespace ManualCAD
 		auto envelope = envelope_builder.build();
 		//envelope.expand(scale * cutter.get_radius() * (1.0f + epsilon_factor)); // TODO co lepszego eby nie podcinao
 
+		progress.set_stage(GenerationProgress::Stage::ZigZag);
 		ZigZagPath zigzag;
-		zigzag.add_line(envelope.get_points(), true);
-		auto paths = zigzag.generate_paths_outside_loops(min - cutter_offset, max + cutter_offset, scale * cutter.get_radius(), scale * cutter.get_radius() * flat_epsilon_factor);
+		for (const auto& loop : envelope.get_loops())
+			zigzag.add_line(loop, true);
+		const float angle = flat_angle_search ? zigzag.find_best_angle_outside_loops(min - cutter_offset, max + cutter_offset, radius, radius * flat_epsilon_factor) : flat_zig_zag_angle;
+		auto paths = zigzag.generate_paths_outside_loops(min - cutter_offset, max + cutter_offset, radius, radius * flat_epsilon_factor, angle);
 
-		std::vector<Vector3> points = link_flat_paths(paths);
+		std::optional<ClearanceMap> clearance_map = std::nullopt;
+		if (stay_down_links)
+		{
+			progress.set_stage(GenerationProgress::Stage::Rendering);
+			clearance_map.emplace(render_clearance_map(cutter, backend));
+		}
+		progress.set_stage(GenerationProgress::Stage::Linking);
+		std::vector<Vector3> points = link_flat_paths(paths, clearance_map.has_value() ? &clearance_map.value() : nullptr);
 		points = compact_path(points);
+		points = CornerSmoothing::smooth(points, corner_tolerance, CORNER_CHORD_TOLERANCE);
 
-		generated_program = MillingProgram{ "Flat plane" };
+		MillingProgram program{ "Flat plane" };
 		for (int i = 0; i < points.size() - 1; ++i)
-			generated_program.value().add_move({ i + 3,false,points[i],points[i + 1] });
+			program.add_move({ i + 3,false,points[i],points[i + 1] });
+		return program;
 	}
 
-	void Prototype::generate_envelope_program(const Cutter& cutter)
+	std::optional<MillingProgram> Prototype::generate_envelope_program(const Cutter& cutter, GenerationProgress& progress)
 	{
 		const Vector2 min = { view_boundary_points[0].x, view_boundary_points[0].z },
 			max = { view_boundary_points[2].x, view_boundary_points[2].z },
@@ -394,8 +614,11 @@ namespace ManualCAD
 
 		const float radius = scale * cutter.get_radius();
 
-		for (const auto* surf : surfaces)
+		progress.set_stage(GenerationProgress::Stage::Intersecting);
+		int surfaces_done = 0;
+		for (const auto* surf : generation_surfaces)
 		{
+			progress.set_progress(static_cast<float>(surfaces_done++) / generation_surfaces.size());
 			OffsetSurface offset_surf{ *surf, radius };
 			try
 			{
@@ -410,15 +633,18 @@ namespace ManualCAD
 		auto envelope = envelope_builder.build();
 		//envelope.expand(scale * cutter.get_radius()); we do not expane if we use offset surfaces
 
+		progress.set_stage(GenerationProgress::Stage::Linking);
 		std::vector<Vector3> points = link_single_flat_loop(envelope.get_points());
 		points = compact_path(points);
+		points = CornerSmoothing::smooth(points, corner_tolerance, CORNER_CHORD_TOLERANCE);
 
-		generated_program = MillingProgram{ "Envelope" };
+		MillingProgram program{ "Envelope" };
 		for (int i = 0; i < points.size() - 1; ++i)
-			generated_program.value().add_move({ i + 3,false,points[i],points[i + 1] });
+			program.add_move({ i + 3,false,points[i],points[i + 1] });
+		return program;
 	}
 
-	void Prototype::generate_detailed_program(const Cutter& cutter)
+	std::optional<MillingProgram> Prototype::generate_detailed_program(const Cutter& cutter, HeightMapRenderer::Backend backend, GenerationProgress& progress)
 	{
 		const Vector2 min = { view_boundary_points[0].x, view_boundary_points[0].z },
 			max = { view_boundary_points[2].x, view_boundary_points[2].z };
@@ -426,35 +652,107 @@ namespace ManualCAD
 		const float radius = scale * cutter.get_radius();
 		PlaneXZ plane{ min, max, height + radius }; // we offset plane by radius (because cutter must not cut the flat plane)
 
-		auto lines = SurfacePath{ surfaces }.generate_paths(plane, radius, radius * detailed_epsilon_factor, scale * mill_height, size);
-		auto points = link_surface_ball_cutter_paths(lines, radius, plane);
+		auto lines = SurfacePath{ generation_surfaces, scale * detailed_scallop_height }.generate_paths(plane, radius, radius * detailed_epsilon_factor, scale * mill_height, size, backend, &progress, generation_cache());
+		progress.set_stage(GenerationProgress::Stage::Rendering);
+		// links run through stock left by rough milling, which is above the model; it is known only from a bound workpiece,
+		// otherwise links lift to height after rough milling
+		std::optional<ClearanceMap> clearance_map;
+		if (stock_map.has_value())
+			clearance_map.emplace(make_stock_clearance_map(stock_map.value(), cutter));
+		progress.set_stage(GenerationProgress::Stage::Linking);
+		auto points = link_cutter_tip_paths(sample_surface_ball_cutter_paths(lines, radius, plane), clearance_map.has_value() ? &clearance_map.value() : nullptr);
 
 		points = compact_path(points);
-		generated_program = MillingProgram{ "Detailed" };
+		MillingProgram program{ "Detailed" };
 		for (int i = 0; i < points.size() - 1; ++i)
-			generated_program.value().add_move({ i + 3,false,points[i],points[i + 1] });
+			program.add_move({ i + 3,false,points[i],points[i + 1] });
+		return program;
 	}
 
-	void Prototype::generate_signature_program(const Cutter& cutter)
+	std::optional<MillingProgram> Prototype::generate_signature_program(const Cutter& cutter, GenerationProgress& progress)
 	{
-		if (signature_curves.size() == 0)
-			return;
+		if (signature_beziers.size() == 0)
+			return std::nullopt;
+
+		progress.set_stage(GenerationProgress::Stage::Linking);
 
 		CurvePath path;
 
-		for (const auto* curve : signature_curves)
-			path.add_curve_bezier_points(curve->get_bezier_points());
+		for (const auto& bezier : signature_beziers)
+			path.add_curve_bezier_points(bezier);
 
 		const float base_height = view_boundary_points[0].y - scale * signature_depth;
 
 		path.project_curves(base_height);
 
-		auto lines = path.generate_paths();
+		auto lines = path.generate_paths(scale * SIGNATURE_CHORD_TOLERANCE);
 		auto points = link_paths(lines);
 
-		generated_program = MillingProgram{ "Signature" };
+		MillingProgram program{ "Signature" };
 		for (int i = 0; i < points.size() - 1; ++i)
-			generated_program.value().add_move({ i + 3,false,points[i],points[i + 1] });
+			program.add_move({ i + 3,false,points[i],points[i + 1] });
+		return program;
+	}
+
+	std::optional<MillingProgram> Prototype::generate_rest_program(const Cutter& cutter, HeightMapRenderer::Backend backend, GenerationProgress& progress)
+	{
+		if (!stock_map.has_value())
+		{
+			Logger::log_warning("[WARNING] Rest program needs a workpiece bound to the prototype\n");
+			return std::nullopt;
+		}
+
+		const Vector2 min = { view_boundary_points[0].x, view_boundary_points[0].z },
+			max = { view_boundary_points[2].x, view_boundary_points[2].z };
+		const float height = view_boundary_points[0].y;
+		const float radius = scale * cutter.get_radius();
+		PlaneXZ plane{ min, max, height + radius };
+
+		auto lines = SurfacePath{ generation_surfaces, scale * detailed_scallop_height }.generate_paths(plane, radius, radius * detailed_epsilon_factor, scale * mill_height, size, backend, &progress, generation_cache());
+		progress.set_stage(GenerationProgress::Stage::Rendering);
+		// stock is never below the model, thus links which clear the stock also clear the model
+		const auto stock_clearance_map = make_stock_clearance_map(stock_map.value(), cutter);
+		progress.set_stage(GenerationProgress::Stage::Linking);
+		const auto paths = clip_to_rest_material(sample_surface_ball_cutter_paths(lines, radius, plane), stock_clearance_map.map);
+		if (paths.empty())
+		{
+			Logger::log_warning("[WARNING] No material above rest tolerance is left on the workpiece\n");
+			return std::nullopt;
+		}
+		auto points = link_cutter_tip_paths(paths, &stock_clearance_map);
+
+		points = compact_path(points);
+		MillingProgram program{ "Rest" };
+		for (int i = 0; i < points.size() - 1; ++i)
+			program.add_move({ i + 3,false,points[i],points[i + 1] });
+		return program;
+	}
+
+	std::optional<MillingProgram> Prototype::generate_waterline_program(const Cutter& cutter, HeightMapRenderer::Backend backend, GenerationProgress& progress)
+	{
+		progress.set_stage(GenerationProgress::Stage::Rendering);
+		const auto clearance_map = render_clearance_map(cutter, backend, WATERLINE_MAP_POOLING);
+		progress.set_stage(GenerationProgress::Stage::Contouring);
+		auto paths = WaterlinePath{ clearance_map.map }.generate_paths(waterline_step, tanf(waterline_min_wall_angle));
+		if (paths.empty())
+		{
+			Logger::log_warning("[WARNING] No walls steeper than minimal angle were found\n");
+			return std::nullopt;
+		}
+
+		// contours are given in workpiece units above base of the model, relative to center of the workpiece
+		const float base = size.y - mill_height;
+		for (auto& path : paths)
+			for (auto& p : path)
+				p = scale * Vector3{ p.x, base + p.y, p.z } + center;
+		progress.set_stage(GenerationProgress::Stage::Linking);
+		auto points = link_cutter_tip_paths(paths, &clearance_map);
+
+		points = compact_path(points);
+		MillingProgram program{ "Waterline" };
+		for (int i = 0; i < points.size() - 1; ++i)
+			program.add_move({ i + 3,false,points[i],points[i + 1] });
+		return program;
 	}
 
 	void Prototype::update_view()
@@ -497,33 +795,150 @@ namespace ManualCAD
 		view.set_data(view_boundary_points);
 	}
 
-	void Prototype::generate_program(ProgramType type, std::unique_ptr<Cutter>&& cutter)
+	std::optional<MillingProgram> Prototype::make_program(ProgramType type, const Cutter& cutter, HeightMapRenderer::Backend backend, GenerationProgress& progress)
 	{
 		switch (type)
 		{
 		case ProgramType::Rough:
-			generate_rough_program(*cutter);
-			break;
+			return generate_rough_program(cutter, backend, progress);
 		case ProgramType::FlatPlane:
-			generate_flat_plane_program(*cutter);
-			break;
+			return generate_flat_plane_program(cutter, backend, progress);
 		case ProgramType::Envelope:
-			generate_envelope_program(*cutter);
-			break;
+			return generate_envelope_program(cutter, progress);
 		case ProgramType::Detailed:
-			generate_detailed_program(*cutter);
-			break;
+			return generate_detailed_program(cutter, backend, progress);
 		case ProgramType::Signature:
-			generate_signature_program(*cutter);
-			break;
+			return generate_signature_program(cutter, progress);
+		case ProgramType::Rest:
+			return generate_rest_program(cutter, backend, progress);
+		case ProgramType::Waterline:
+			return generate_waterline_program(cutter, backend, progress);
+		case ProgramType::AdaptiveRough:
+			return generate_adaptive_rough_program(cutter, backend, progress);
 		default:
 			throw std::runtime_error("Invalid cutter type");
 		}
+	}
+
+	void Prototype::capture_generation_input(ProgramType type)
+	{
+		stock_map = std::nullopt;
+		if ((type == ProgramType::Rest || type == ProgramType::Detailed) && stock_workpiece != nullptr)
+		{
+			if (stock_workpiece->height_map.size.x != size.x || stock_workpiece->height_map.size.z != size.z)
+				Logger::log_warning("[WARNING] Size of the workpiece differs from size of the prototype\n");
+			stock_map = stock_workpiece->height_map;
+		}
 
+		// worker must not read objects edited in the main thread, thus it reads copies
+		release_generation_input();
+		GenerationCache::Key key;
+		for (const auto* surf : surfaces)
+		{
+			key.add(*surf);
+			for (auto& copy : surf->clone())
+			{
+				if (const auto* copied_surf = dynamic_cast<const ParametricSurfaceObject*>(copy.get()))
+					generation_surfaces.push_back(copied_surf);
+				surface_copies.push_back(std::move(copy));
+			}
+		}
+		surfaces_key = key.get();
+		for (const auto* curve : signature_curves)
+			signature_beziers.push_back(curve->get_bezier_points());
+	}
+
+	void Prototype::release_generation_input()
+	{
+		generation_surfaces.clear();
+		surface_copies.clear();
+		signature_beziers.clear();
+	}
+
+	bool Prototype::surfaces_changed() const
+	{
+		GenerationCache::Key key;
+		for (const auto* surf : surfaces)
+			key.add(*surf);
+		return key.get() != surfaces_key;
+	}
+
+	void Prototype::set_generated_program(MillingProgram&& program, std::unique_ptr<Cutter>&& cutter)
+	{
+		generated_program = std::move(program);
 		generated_program->set_cutter(std::move(cutter));
 		view.set_data(generated_program.value().get_cutter_positions());
 	}
 
+	void Prototype::generate_program(ProgramType type, std::unique_ptr<Cutter>&& cutter)
+	{
+		stop_generation();
+		capture_generation_input(type);
+		GenerationProgress progress;
+		auto program = make_program(type, *cutter, map_backend, progress);
+		release_generation_input();
+		if (program.has_value())
+			set_generated_program(std::move(program.value()), std::move(cutter));
+	}
+
+	void Prototype::generate_program_in_background(ProgramType type, std::unique_ptr<Cutter>&& cutter)
+	{
+		stop_generation();
+		capture_generation_input(type);
+		generation = std::make_shared<ProgramGeneration>();
+		generation->cutter = std::move(cutter);
+		generation->result = generation_pool().submit([this, type, state = generation]() {
+			// OpenGL context belongs to the main thread, so maps are rendered on CPU
+			return make_program(type, *state->cutter, HeightMapRenderer::Backend::CPU, state->progress);
+		});
+
+		Task task(generation->task_ended);
+		task.add_step<ProgramGenerationTaskStep>(*this, generation);
+		generation_task = &task_manager.add_task(std::move(task));
+	}
+
+	void Prototype::finish_generation()
+	{
+		auto finished = std::move(generation);
+		generation_task = nullptr;
+		const bool changed = surfaces_changed();
+		release_generation_input();
+		try
+		{
+			auto program = finished->result.get();
+			if (changed)
+			{
+				Logger::log_warning("[WARNING] Surfaces were modified during generation, generated program is discarded\n");
+				invalidate();
+			}
+			else if (program.has_value())
+				set_generated_program(std::move(program.value()), std::move(finished->cutter));
+		}
+		catch (const GenerationCancelledException&)
+		{
+			invalidate(); // view was not updated during generation
+		}
+		catch (const std::exception& e)
+		{
+			Logger::log_error("[ERROR] Generating program: %s\n", e.what());
+			invalidate();
+		}
+	}
+
+	void Prototype::stop_generation()
+	{
+		if (!is_generating())
+			return;
+
+		generation->progress.cancel();
+		generation->result.wait();
+		generation_task->terminate();
+		generation_task = nullptr;
+		generation = nullptr;
+		release_generation_input();
+		invalidate();
+	}
+
 	std::vector<ObjectHandle> Prototype::clone() const
 	{
 		return std::vector<ObjectHandle>(); // Prototype is a special object and thus can't be cloned
@@ -4,6 +4,12 @@
 #include "milling_program.h"
 #include "plane_xz.h"
 #include "cutter.h"
+#include "height_map_renderer.h"
+#include "generation_progress.h"
+#include "generation_cache.h"
+#include "workpiece.h"
+#include "task.h"
+#include <future>
 #include <memory>
 #include <optional>
 #include <vector>
@@ -14,13 +20,40 @@ namespace ManualCAD
 	class Prototype : public Object {
 
 		enum class ProgramType {
-			Rough, FlatPlane, Envelope, Detailed, Signature
+			Rough, FlatPlane, Envelope, Detailed, Signature, Rest, Waterline, AdaptiveRough
+		};
+
+		// Pooled map of the lowest cutter tip heights together with the unpooled map it was dilated from (both above base of the model);
+		// the pooled map overestimates clearance by up to its cell, e.g. around walls of the model, where the unpooled one is sampled exactly.
+		struct ClearanceMap {
+			HeightMap map;
+			HeightMap source;
+			const Cutter& cutter;
+		};
+
+		// Program generated on a worker thread; it is shared with the task step which hands the result over to the prototype on the main thread.
+		struct ProgramGeneration {
+			GenerationProgress progress;
+			std::unique_ptr<Cutter> cutter;
+			std::future<std::optional<MillingProgram>> result;
+			bool task_ended = true;
 		};
 
 		friend class ObjectSettings;
+		friend class ProgramGenerationTaskStep;
 
 		static int counter;
 
+		static constexpr float LINK_ORDER_TIME_BUDGET = 0.5f; // seconds spent on ordering paths of a program
+		static constexpr int CLEARANCE_MAP_POOLING = 4;
+		static constexpr int WATERLINE_MAP_POOLING = 2; // waterline paths follow contours of clearance map, thus it is finer
+		static constexpr float LINK_TOLERANCE = 0.01f; // cutter may link straight if it stays at most that much below clearance map, unless it descends
+		static constexpr float LINK_CLEARANCE = 0.05f; // lifted links go that much above clearance map
+		static constexpr float SURFACE_PATH_CHORD_TOLERANCE = 0.002f; // paths on surfaces deviate from them at most that much
+		static constexpr float SURFACE_PATH_MAX_SEGMENT_LENGTH = 0.5f;
+		static constexpr float SIGNATURE_CHORD_TOLERANCE = 0.002f; // signature paths deviate from curves at most that much
+		static constexpr float CORNER_CHORD_TOLERANCE = 0.0005f; // blends of corners are sampled finer than junction deviation of machines
+
 		Line view;
 		std::vector<Vector3> view_boundary_points;
 		Vector3 center;
@@ -29,9 +62,22 @@ namespace ManualCAD
 		Vector3 size = { 15, 5, 15 };
 		std::list<const ParametricSurfaceObject*> surfaces;
 		std::list<const ParametricCurveObject*> signature_curves;
+		const Workpiece* stock_workpiece = nullptr; // its simulated material is milled by rest program and cleared by links of detailed program
+		std::optional<HeightMap> stock_map = std::nullopt; // copy of workpiece's height map taken when generation starts (of rest and detailed programs)
+		std::vector<ObjectHandle> surface_copies; // copies of surfaces (with their control points) taken when generation starts
+		std::list<const ParametricSurfaceObject*> generation_surfaces; // surfaces among copies, in order of surfaces; generators read only them
+		uint64_t surfaces_key = 0; // hash of geometry of surfaces when generation starts
+		std::vector<std::vector<Vector3>> signature_beziers; // Bezier points of signature curves taken when generation starts
 
 		std::optional<MillingProgram> generated_program = std::nullopt;
 
+		TaskManager& task_manager;
+		Task* generation_task = nullptr;
+		std::shared_ptr<ProgramGeneration> generation;
+		bool generate_in_background = true;
+		bool use_generation_cache = true; // intersections and index maps are reused between generations
+		bool stay_down_links = true; // links between paths stay at cutting height or lift only above clearance map instead of retracting (to safe height in flat programs, to height after rough milling in others)
+
 		Box bounding_box = Box::degenerate();
 		bool box_valid = false;
 
@@ -39,8 +85,18 @@ namespace ManualCAD
 		float rough_epsilon_factor = 1.0f;
 		float rough_height_offset = 0.2f;
 		float flat_epsilon_factor = 0.5f;
+		float corner_tolerance = 0.02f; // corners of flat, envelope and rough paths are rounded, deviating at most that much; 0 keeps them sharp
+		bool flat_angle_search = true; // rows of flat plane paths go in the direction which needs the fewest links
+		float flat_zig_zag_angle = 0.0f; // direction of rows of flat plane paths when angle isn't searched
 		float detailed_epsilon_factor = 1.81f;
+		float detailed_scallop_height = 0.0f; // when positive, rows of detailed paths are spaced to leave scallops of that height instead of by epsilon
 		float signature_depth = 0.1f;
+		float rest_tolerance = 0.02f; // rest program mills only where more material is left
+		float waterline_step = 0.1f;
+		int adaptive_levels = 1; // engagement of adaptive rough paths is bounded by stepover, thus they may go deeper than rough rows
+		float adaptive_stepover_factor = 0.3f; // fraction of cutter diameter
+		float waterline_min_wall_angle = PI / 6.0f; // waterline program leaves flatter regions (e.g. to zig-zag paths); 0 mills whole model
+		HeightMapRenderer::Backend map_backend = HeightMapRenderer::Backend::GPU;
 
 		void generate_renderable() override;
 		void build_specific_settings(ObjectSettingsWindow& parent) override;
@@ -49,6 +105,7 @@ namespace ManualCAD
 		Vector3 to_workpiece_coords(const Vector3& model_coords) { return (1.0f / scale) * (model_coords - center); }
 		float safe_height_unscaled() const { return size.y + 1.0f; }
 		float safe_height() const { return scale * safe_height_unscaled() + center.y; }
+		GenerationCache* generation_cache() const { return use_generation_cache ? &GenerationCache::session() : nullptr; }
 		float height_after_rough_unscaled() const { return size.y + rough_height_offset; }
 		float height_after_rough() const { return scale * height_after_rough_unscaled() + center.y; }
 
@@ -57,21 +114,52 @@ namespace ManualCAD
 		Vector3 elevate_to(const Vector3& point, const float h);
 		Vector3 elevate_to_rough(const Vector3& point);
 		Vector3 elevate(const Vector2& point);
-		std::vector<Vector3> link_flat_paths(const std::vector<std::vector<Vector2>>& paths);
+		// Without clearance map paths are linked through safe height.
+		std::vector<Vector3> link_flat_paths(const std::vector<std::vector<Vector2>>& paths, const ClearanceMap* clearance_map = nullptr);
 		std::vector<Vector3> link_paths(const std::vector<std::vector<Vector3>>& paths);
-		std::vector<Vector3> link_surface_ball_cutter_paths(const std::vector<std::vector<std::vector<Vector2>>>& paths, const float radius, const PlaneXZ& plane);
+		// Returns paths of ball cutter's tip (in model coordinates) along given paths on offset surfaces and the plane.
+		std::vector<std::vector<Vector3>> sample_surface_ball_cutter_paths(const std::vector<std::vector<std::vector<Vector2>>>& paths, const float radius, const PlaneXZ& plane);
+		// Without clearance map paths are linked through height after rough milling.
+		std::vector<Vector3> link_cutter_tip_paths(const std::vector<std::vector<Vector3>>& unordered_paths, const ClearanceMap* clearance_map);
+		// Returns map of the lowest cutter tip heights over the model (in workpiece units, above base of the model).
+		ClearanceMap render_clearance_map(const Cutter& cutter, HeightMapRenderer::Backend backend, int pooling = CLEARANCE_MAP_POOLING);
+		// Returns map of the lowest cutter tip heights over material of the workpiece (given by its height map), in the same form as clearance map.
+		ClearanceMap make_stock_clearance_map(const HeightMap& stock, const Cutter& cutter);
+		// Splits paths into parts on which cutter removes more material than rest tolerance (parts start and end at segments of paths).
+		std::vector<std::vector<Vector3>> clip_to_rest_material(const std::vector<std::vector<Vector3>>& paths, const HeightMap& stock_clearance_map);
+		// Appends moves between from and to (without them) which keep cutter above clearance map: a straight move if it is clear,
+		// otherwise a move lifted to the lowest clear height, but not higher than height after rough milling. Without stay-down links
+		// cutter always lifts to height after rough milling.
+		void append_link(const Vector3& from, const Vector3& to, const ClearanceMap& clearance_map, std::vector<Vector3>& result);
 		std::vector<Vector3> link_single_flat_loop(const std::vector<Vector2>& loop);
 		std::vector<Vector3> compact_path(const std::vector<Vector3>& path);
 		void to_workpiece_coords(std::vector<Vector3>& model_coords) { for (auto& c : model_coords) c = to_workpiece_coords(c); }
 
 		void show_envelope_experimental();
-		void generate_rough_program(const Cutter& cutter);
-		void generate_flat_plane_program(const Cutter& cutter);
-		void generate_envelope_program(const Cutter& cutter);
-		void generate_detailed_program(const Cutter& cutter);
-		void generate_signature_program(const Cutter& cutter);
+		// Generators only read parameters of the prototype, thus they may run on a worker thread (with CPU height map backend).
+		std::optional<MillingProgram> generate_rough_program(const Cutter& cutter, HeightMapRenderer::Backend backend, GenerationProgress& progress);
+		std::optional<MillingProgram> generate_adaptive_rough_program(const Cutter& cutter, HeightMapRenderer::Backend backend, GenerationProgress& progress);
+		std::optional<MillingProgram> generate_flat_plane_program(const Cutter& cutter, HeightMapRenderer::Backend backend, GenerationProgress& progress);
+		std::optional<MillingProgram> generate_envelope_program(const Cutter& cutter, GenerationProgress& progress);
+		std::optional<MillingProgram> generate_detailed_program(const Cutter& cutter, HeightMapRenderer::Backend backend, GenerationProgress& progress);
+		std::optional<MillingProgram> generate_signature_program(const Cutter& cutter, GenerationProgress& progress);
+		// Mills material left on the bound workpiece (e.g. after rough and detailed programs with a larger cutter) with paths of detailed program.
+		std::optional<MillingProgram> generate_rest_program(const Cutter& cutter, HeightMapRenderer::Backend backend, GenerationProgress& progress);
+		// Mills steep walls of the model along contours of clearance map at levels spaced by waterline step.
+		std::optional<MillingProgram> generate_waterline_program(const Cutter& cutter, HeightMapRenderer::Backend backend, GenerationProgress& progress);
+		std::optional<MillingProgram> make_program(ProgramType type, const Cutter& cutter, HeightMapRenderer::Backend backend, GenerationProgress& progress);
+
+		// Copies data that may change during generation and are read by generator of given type.
+		void capture_generation_input(ProgramType type);
+		void release_generation_input();
+		// Checks whether geometry of surfaces differs from the copies read by generators.
+		bool surfaces_changed() const;
+		void set_generated_program(MillingProgram&& program, std::unique_ptr<Cutter>&& cutter);
+		void finish_generation();
+		// Cancels background generation and blocks until the worker stops.
+		void stop_generation();
 	public:
-		Prototype(const std::list<const ParametricSurfaceObject*> surfaces) : Object(view), view(), surfaces(surfaces) {
+		Prototype(const std::list<const ParametricSurfaceObject*> surfaces, TaskManager& task_manager) : Object(view), view(), surfaces(surfaces), task_manager(task_manager) {
 			name = "Milling prototype " + std::to_string(counter++);
 			view.looped = true;
 		}
@@ -80,6 +168,7 @@ namespace ManualCAD
 			const ParametricSurfaceObject* surf = dynamic_cast<ParametricSurfaceObject*>(&object);
 			if (surf != nullptr)
 			{
+				stop_generation();
 				surfaces.push_back(surf);
 				box_valid = false;
 				invalidate();
@@ -87,13 +176,18 @@ namespace ManualCAD
 			const ParametricCurveObject* curve = dynamic_cast<ParametricCurveObject*>(&object);
 			if (curve != nullptr)
 			{
+				stop_generation();
 				signature_curves.push_back(curve);
 			}
+			const Workpiece* workpiece = dynamic_cast<Workpiece*>(&object);
+			if (workpiece != nullptr)
+				stock_workpiece = workpiece;
 		}
 		void remove_binding_with(Object& object) override {
 			const ParametricSurfaceObject* surf = dynamic_cast<ParametricSurfaceObject*>(&object);
 			if (surf != nullptr)
 			{
+				stop_generation();
 				surfaces.remove(surf);
 				box_valid = false;
 				invalidate();
@@ -101,8 +195,11 @@ namespace ManualCAD
 			const ParametricCurveObject* curve = dynamic_cast<ParametricCurveObject*>(&object);
 			if (curve != nullptr)
 			{
+				stop_generation();
 				signature_curves.remove(curve);
 			}
+			if (&object == stock_workpiece)
+				stock_workpiece = nullptr;
 		}
 
 		void update_view();
@@ -120,12 +217,27 @@ namespace ManualCAD
 		bool is_inside_screen_rectangle(const Rectangle& rect, const Matrix4x4& transformation) const override { return false; }
 
 		void generate_program(ProgramType type, std::unique_ptr<Cutter>&& cutter);
+		// Generates program on a worker thread; result replaces current program when ready (in the main thread, thus it may be observed in next frames).
+		void generate_program_in_background(ProgramType type, std::unique_ptr<Cutter>&& cutter);
+		// Requests cancellation of background generation; current program is kept.
+		void cancel_generation() { if (generation) generation->progress.cancel(); }
+		bool is_generating() const { return generation != nullptr; }
+		const GenerationProgress& get_generation_progress() const { return generation->progress; }
 		void remove_program() { generated_program = std::nullopt; }
 
 		void replace_child_by(Object& child, Object& other) override {}
 
 		std::vector<ObjectHandle> clone() const override;
 
-		void dispose() override { Object::dispose(); }
+		void dispose() override {
+			if (generation) // worker must not outlive surfaces it reads
+			{
+				generation->progress.cancel();
+				generation->result.wait();
+			}
+			release_generation_input();
+			Object::dispose();
+		}
+		void on_delete() override { stop_generation(); }
 	};
 }
\ No newline at end of file
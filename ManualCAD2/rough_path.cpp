@@ -3,13 +3,14 @@
 #include "shader_library.h"
 #include "height_map.h"
 #include "height_map_renderer.h"
+#include "height_map_dilation.h"
 
 namespace ManualCAD
 {
-	HeightMap RoughPath::render_height_map(const Vector3& size)
+	HeightMap RoughPath::render_height_map(const Vector3& size, HeightMapRenderer::Backend backend)
 	{
 		HeightMapRenderer r{ surfaces, box }; // TODO add offset = radius + epsilon and remove weird algorithms!
-		return r.render_height_map(size);
+		return r.render_height_map(size, backend);
 	}
 
 	RoughPath::RoughPath(const std::list<const ParametricSurfaceObject*>& surfaces, const Vector3& center, const Vector2& min, const Vector2& max, const float bottom_height, const float height, const float scale) : surfaces(surfaces), bottom_height(bottom_height)
@@ -22,31 +23,45 @@ namespace ManualCAD
 		box.y_max = center.y + scale * height;
 	}
 
-	float max_sample(const HeightMap& map, const Vector2& v, const float radius)
+	// Appends vertices of a polyline which stays between profile and profile + tolerance at every sample. Vertex is emitted only when slope
+	// of the profile changes so much that no line from the previous vertex fits all samples (intersection of slope intervals, linear time).
+	void emit_row_vertices(const Vector2& start, const Vector2& end, const std::vector<float>& profile, const float tolerance, std::vector<Vector3>& path)
 	{
-		float result = 0;
-		const float radius45deg = sqrtf(0.5f) * radius;
-		const Vector2 offsets[] = {
-			{0.0f,0.0f},
-			{radius, 0.0f},
-			{radius45deg, radius45deg},
-			{0.0f, radius},
-			{-radius45deg, radius45deg},
-			{-radius, 0.0f},
-			{-radius45deg,-radius45deg},
-			{0.0f, -radius},
-			{radius45deg, -radius45deg}
+		const int samples = profile.size();
+		auto emit = [&](int p, float height) {
+			const auto v = lerp(start, end, static_cast<float>(p) / (samples - 1));
+			path.push_back({ v.x, height, v.y });
 		};
-		for (int i = 0; i < sizeof(offsets) / sizeof(Vector2); ++i)
+
+		int anchor = 0;
+		float anchor_height = profile[0], low = -INFINITY, high = INFINITY;
+		emit(0, anchor_height);
+		for (int p = 1; p < samples; ++p)
 		{
-			const auto coords = map.position_to_pixel(v + offsets[i]);
-			result = std::max(result, map.get_pixel(coords.y, coords.x));
+			const float distance = static_cast<float>(p - anchor);
+			const float sample_low = (profile[p] - anchor_height) / distance,
+				sample_high = (profile[p] + tolerance - anchor_height) / distance;
+			if (std::max(low, sample_low) > std::min(high, sample_high))
+			{
+				// the lowest feasible slope keeps the new vertex within tolerance over (p - 1)-th sample
+				anchor_height += low * (p - 1 - anchor);
+				anchor = p - 1;
+				emit(anchor, anchor_height);
+				low = profile[p] - anchor_height;
+				high = low + tolerance;
+			}
+			else
+			{
+				low = std::max(low, sample_low);
+				high = std::min(high, sample_high);
+			}
 		}
-		return result;
+		emit(samples - 1, anchor_height + low * (samples - 1 - anchor));
 	}
 
-	std::vector<Vector3> RoughPath::generate_path(int levels, const Vector3& size, const float radius, const float r_epsilon, const float h_epsilon)
+	std::vector<Vector3> RoughPath::generate_path(int levels, const Vector3& size, const Cutter& cutter, const float r_epsilon, const float h_epsilon, HeightMapRenderer::Backend backend, GenerationProgress* progress)
 	{
+		const float radius = cutter.get_radius();
 		const float level_height = (size.y - bottom_height) / levels;
 		Vector2 min = { -0.5f * size.x - radius - r_epsilon, -0.5f * size.z - radius - r_epsilon },
 			max = -min;
@@ -55,14 +70,30 @@ namespace ManualCAD
 		int rows = static_cast<int>((max.y - min.y) / row_width) + 1;
 
 		Vector3 map_size = { size.x, size.y - bottom_height, size.z };
-		auto height_map = render_height_map(map_size);
+		if (progress != nullptr)
+			progress->set_stage(GenerationProgress::Stage::Rendering);
+		auto height_map = render_height_map(map_size, backend);
+
+		// map is max-pooled to the resolution at which the path is sampled and then dilated by cutter, so every sample is a single lookup
+		// (rendered map is transposed: first index goes along Z, second along X)
+		const float sample_spacing = (max.x - min.x) / (TEX_DIM - 1);
+		const int pool_factor = std::max(1, static_cast<int>(sample_spacing / (size.x / height_map.height)));
+		const auto pooled_map = HeightMapDilation::max_pool(height_map, pool_factor);
+		const auto dilated_map = HeightMapDilation::dilate_by_cutter(pooled_map, cutter, pooled_map.size.z / pooled_map.height, pooled_map.size.x / pooled_map.width);
+
+		if (progress != nullptr)
+			progress->set_stage(GenerationProgress::Stage::ZigZag);
 
-		std::list<Vector3> path;
+		std::vector<Vector3> path;
+		path.reserve(static_cast<size_t>(levels) * rows * TEX_DIM); // upper bound, thus path is never reallocated
+		std::vector<float> profile(TEX_DIM);
 		for (int i = levels - 1; i >= 0; --i)
 		{
 			const float h = bottom_height + i * level_height;
 			for (int j = 0; j < rows; ++j)
 			{
+				if (progress != nullptr)
+					progress->set_progress(static_cast<float>((levels - 1 - i) * rows + j) / (levels * rows));
 				Vector2 start, end;
 				int real_j = (i & 1) ? (rows - j - 1) : j;
 				if ((i + real_j) & 1) // non-parite
@@ -79,27 +110,17 @@ namespace ManualCAD
 					start = { min.x, min.y + real_j * row_width };
 					end = { max.x, min.y + real_j * row_width };
 				}
-				int last_p_on_h = 0;
 				for (int p = 0; p < TEX_DIM; ++p)
 				{
 					const auto v = lerp(start, end, static_cast<float>(p) / (TEX_DIM - 1));
-					const auto coords = height_map.position_to_pixel(v);
-					//const float map_h = bottom_height + height_map.get_pixel(coords.y, coords.x);
-					const float map_h = bottom_height + max_sample(height_map, v, radius);
-					if (h >= map_h)
-					{
-						if (last_p_on_h != p - 1 || p == TEX_DIM - 1)
-							path.push_back({ v.x, h + h_epsilon, v.y });
-						last_p_on_h = p;
-					}
-					else
-					{
-						path.push_back({ v.x, map_h + h_epsilon, v.y });
-					}
+					const auto coords = dilated_map.position_to_pixel(v);
+					const float map_h = bottom_height + dilated_map.get_pixel(coords.y, coords.x);
+					profile[p] = std::max(h, map_h) + h_epsilon;
 				}
+				emit_row_vertices(start, end, profile, PROFILE_TOLERANCE, path);
 			}
 		}
 
-		return { path.begin(),path.end() };
+		return path;
 	}
 }
@@ -5,21 +5,25 @@
 #include "frame_buffer.h"
 #include "object.h"
 #include "renderer.h"
+#include "height_map_renderer.h"
+#include "cutter.h"
+#include "generation_progress.h"
 #include <list>
 
 namespace ManualCAD
 {
 	class RoughPath {
 		static constexpr int TEX_DIM = 300;
+		static constexpr float PROFILE_TOLERANCE = 0.01f; // path may go above the dilated profile at most that much
 
 		Box box;
 		float bottom_height;
 
 		const std::list<const ParametricSurfaceObject*>& surfaces;
-		HeightMap render_height_map(const Vector3& size);
+		HeightMap render_height_map(const Vector3& size, HeightMapRenderer::Backend backend);
 	public:
 		RoughPath(const std::list<const ParametricSurfaceObject*>& surfaces, const Vector3& center, const Vector2& min, const Vector2& max, const float bottom_height, const float height, const float scale);
 
-		std::vector<Vector3> generate_path(int levels, const Vector3& size, const float radius, const float r_epsilon, const float h_epsilon);
+		std::vector<Vector3> generate_path(int levels, const Vector3& size, const Cutter& cutter, const float r_epsilon, const float h_epsilon, HeightMapRenderer::Backend backend = HeightMapRenderer::Backend::GPU, GenerationProgress* progress = nullptr);
 	};
 }
\ No newline at end of file
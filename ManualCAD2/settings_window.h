@@ -92,8 +92,8 @@ namespace ManualCAD
 		}
 	};
 
-	template <class T, template <class P> class Container>
-	std::optional<T*> try_create_object_from_surfaces(ObjectController& controller, bool& not_surf)
+	template <class T, template <class P> class Container, class... Args>
+	std::optional<T*> try_create_object_from_surfaces(ObjectController& controller, bool& not_surf, Args&&... args)
 	{
 		using SurfT = const ParametricSurfaceObject*;
 		auto& selected = controller.get_selected_objects();
@@ -113,7 +113,7 @@ namespace ManualCAD
 		}
 		if (!not_surf)
 		{
-			auto h = Object::create<T>(surfs);
+			auto h = Object::create<T>(surfs, std::forward<Args>(args)...);
 			T* ptr = h.get();
 			controller.add_object(std::move(h));
 			return ptr;
@@ -292,7 +292,7 @@ namespace ManualCAD
 					}
 					if (ImGui::MenuItem("Milling prototype"))
 					{
-						try_create_object_from_surfaces<Prototype, std::list>(controller, not_param_surface);
+						try_create_object_from_surfaces<Prototype, std::list>(controller, not_param_surface, task_manager);
 					}
 					ImGui::EndMenu();
 				}
@@ -1,7 +1,11 @@
 #pragma once
 #include "parametric_surface.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <future>
 #include <tuple>
 #include <stack>
+#include <vector>
 
 namespace ManualCAD
 {
@@ -11,40 +15,208 @@ namespace ManualCAD
 			return pixel * (range.to - range.from) / dim + range.from;
 		}
 
+		// whether u wraps at every row and v wraps at every column of the map; evaluated once, not at every visit of an edge pixel
+		static void compute_wrap_flags(const ParametricSurface& surf, int width, int height, std::vector<char>& u_wraps, std::vector<char>& v_wraps)
+		{
+			const auto urange = surf.get_u_range(), vrange = surf.get_v_range();
+			u_wraps.resize(height);
+			for (int y = 0; y < height; ++y)
+				u_wraps[y] = surf.u_wraps_at_v(pix_to_coord(vrange, y, height));
+			v_wraps.resize(width);
+			for (int x = 0; x < width; ++x)
+				v_wraps[x] = surf.v_wraps_at_u(pix_to_coord(urange, x, width));
+		}
+
+		// union-find over pixel indices; root of a set is its smallest index
+		static int find_root(std::vector<int>& parent, int i)
+		{
+			while (parent[i] != i)
+			{
+				parent[i] = parent[parent[i]];
+				i = parent[i];
+			}
+			return i;
+		}
+		static void unite(std::vector<int>& parent, int a, int b)
+		{
+			a = find_root(parent, a);
+			b = find_root(parent, b);
+			if (a < b)
+				parent[b] = a;
+			else if (b < a)
+				parent[a] = b;
+		}
+
+		// shared by all labelings; bands never wait for each other, so they cannot block the pool
+		static ThreadPool& labeling_pool()
+		{
+			static ThreadPool pool;
+			return pool;
+		}
+
+		// calls function(band, first_row, end_row) for consecutive bands of rows in parallel
+		template <class Function>
+		static void for_each_band_parallel(int bands, int height, Function function)
+		{
+			std::vector<std::future<void>> futures;
+			for (int b = 0; b < bands; ++b)
+				futures.push_back(labeling_pool().submit([&function, b, bands, height]() {
+					function(b, static_cast<int>(static_cast<long long>(height) * b / bands), static_cast<int>(static_cast<long long>(height) * (b + 1) / bands));
+				}));
+			for (auto& future : futures)
+				future.get();
+		}
+
 	public:
-		template <class SqMap, class T> 
+		// Scanline fill: a seed fills the whole run of old pixels in its row and pushes one seed per run of old pixels adjacent to it
+		// in neighbouring rows (and across wrapped edges of the surface).
+		template <class SqMap, class T>
 		inline static void flood_fill(SqMap& map, int x, int y, const T& value, const ParametricSurface& surf) {
 			const auto old = map.get_pixel(x, y);
 			if (value == old) return;
 
-			const auto urange = surf.get_u_range(), vrange = surf.get_v_range();
+			std::vector<char> u_wraps, v_wraps;
+			compute_wrap_flags(surf, map.width, map.height, u_wraps, v_wraps);
 
 			std::stack<std::pair<int, int>> stack;
+			// pushes runs of old pixels in given row between columns from and to; across wrapped edge only columns where v wraps are adjacent
+			auto push_runs = [&](int from, int to, int row, bool wrapped) {
+				bool in_run = false;
+				for (int i = from; i <= to; ++i)
+				{
+					const bool matches = (!wrapped || v_wraps[i]) && map.get_pixel(i, row) == old;
+					if (matches && !in_run)
+						stack.push({ i, row });
+					in_run = matches;
+				}
+			};
+
 			stack.push({ x, y });
 			while (!stack.empty())
 			{
 				const auto coords = stack.top();
 				stack.pop();
-				map.set_pixel(coords.first, coords.second, value);
-				if (coords.first > 0 && map.get_pixel(coords.first - 1, coords.second) == old)
-					stack.push({ coords.first - 1, coords.second });
-				if (coords.first < map.width - 1 && map.get_pixel(coords.first + 1, coords.second) == old)
-					stack.push({ coords.first + 1, coords.second });
-				if (coords.second > 0 && map.get_pixel(coords.first, coords.second - 1) == old)
-					stack.push({ coords.first, coords.second - 1 });
-				if (coords.second < map.height - 1 && map.get_pixel(coords.first, coords.second + 1) == old)
-					stack.push({ coords.first, coords.second + 1 });
-
-				if (coords.first == 0 && surf.u_wraps_at_v(pix_to_coord(vrange, coords.second, map.height)) && map.get_pixel(map.width - 1, coords.second) == old)
-					stack.push({ map.width - 1, coords.second });
-				if (coords.first == map.width - 1 && surf.u_wraps_at_v(pix_to_coord(vrange, coords.second, map.height)) && map.get_pixel(0, coords.second) == old)
-					stack.push({ 0, coords.second });
-
-				if (coords.second == 0 && surf.v_wraps_at_u(pix_to_coord(urange, coords.first, map.width)) && map.get_pixel(coords.first, map.height - 1) == old)
-					stack.push({ coords.first, map.height - 1 });
-				if (coords.second == map.height - 1 && surf.v_wraps_at_u(pix_to_coord(urange, coords.first, map.width)) && map.get_pixel(coords.first, 0) == old)
-					stack.push({ coords.first, 0 });
+				const int row = coords.second;
+				if (!(map.get_pixel(coords.first, row) == old))
+					continue; // already filled from another seed
+
+				int left = coords.first, right = coords.first;
+				while (left > 0 && map.get_pixel(left - 1, row) == old)
+					--left;
+				while (right < map.width - 1 && map.get_pixel(right + 1, row) == old)
+					++right;
+				for (int i = left; i <= right; ++i)
+					map.set_pixel(i, row, value);
+
+				if (row > 0)
+					push_runs(left, right, row - 1, false);
+				if (row < map.height - 1)
+					push_runs(left, right, row + 1, false);
+				if (row == 0)
+					push_runs(left, right, map.height - 1, true);
+				if (row == map.height - 1)
+					push_runs(left, right, 0, true);
+
+				if (u_wraps[row] && left == 0 && map.get_pixel(map.width - 1, row) == old)
+					stack.push({ map.width - 1, row });
+				if (u_wraps[row] && right == map.width - 1 && map.get_pixel(0, row) == old)
+					stack.push({ 0, row });
+			}
+		}
+
+		// Labels 4-connected regions of the map (also across wrapped edges of the surface), where neighbouring pixels belong to one region
+		// if connected(a, b) holds for their values. Returns label of every pixel (at x + y * width); labels are consecutive, in order of
+		// the first pixels of regions. Two-pass union-find: bands of rows are labeled in parallel, then merged along their borders and
+		// wrapped edges, then roots are numbered in parallel.
+		template <class SqMap, class Connected>
+		static std::vector<int> label_regions(const SqMap& map, const ParametricSurface& surf, Connected connected, int* region_count = nullptr)
+		{
+			const int width = map.width, height = map.height;
+			const size_t pixel_count = static_cast<size_t>(width) * height;
+			if (pixel_count == 0)
+			{
+				if (region_count != nullptr)
+					*region_count = 0;
+				return {};
 			}
+
+			std::vector<char> u_wraps, v_wraps;
+			compute_wrap_flags(surf, width, height, u_wraps, v_wraps);
+
+			const int bands = std::max(1, std::min(static_cast<int>(labeling_pool().get_thread_count()), height));
+			std::vector<int> parent(pixel_count);
+
+			// first pass: sets never leave their bands, thus bands are independent
+			for_each_band_parallel(bands, height, [&](int, int first_row, int end_row) {
+				for (int y = first_row; y < end_row; ++y)
+					for (int x = 0; x < width; ++x)
+					{
+						const int i = x + y * width;
+						parent[i] = i;
+						if (x > 0 && connected(map.get_pixel(x - 1, y), map.get_pixel(x, y)))
+							unite(parent, i - 1, i);
+						if (y > first_row && connected(map.get_pixel(x, y - 1), map.get_pixel(x, y)))
+							unite(parent, i - width, i);
+					}
+				// parents precede their children, so a pass in order points every pixel directly at its root
+				for (int i = first_row * width; i < end_row * width; ++i)
+					parent[i] = parent[parent[i]];
+			});
+
+			for (int b = 1; b < bands; ++b)
+			{
+				const int y = static_cast<int>(static_cast<long long>(height) * b / bands);
+				for (int x = 0; x < width; ++x)
+					if (connected(map.get_pixel(x, y - 1), map.get_pixel(x, y)))
+						unite(parent, x + (y - 1) * width, x + y * width);
+			}
+			for (int y = 0; y < height; ++y)
+				if (u_wraps[y] && width > 1 && connected(map.get_pixel(width - 1, y), map.get_pixel(0, y)))
+					unite(parent, width - 1 + y * width, y * width);
+			for (int x = 0; x < width; ++x)
+				if (v_wraps[x] && height > 1 && connected(map.get_pixel(x, height - 1), map.get_pixel(x, 0)))
+					unite(parent, x + (height - 1) * width, x);
+
+			// second pass: roots are resolved without modifying parents, roots of every band get consecutive labels
+			std::vector<int> roots(pixel_count), labels(pixel_count), band_region_counts(bands);
+			for_each_band_parallel(bands, height, [&](int band, int first_row, int end_row) {
+				int count = 0;
+				for (int i = first_row * width; i < end_row * width; ++i)
+				{
+					int root = i;
+					while (parent[root] != root)
+						root = parent[root];
+					roots[i] = root;
+					if (root == i)
+						++count;
+				}
+				band_region_counts[band] = count;
+			});
+			std::vector<int> first_labels(bands + 1, 0);
+			for (int b = 0; b < bands; ++b)
+				first_labels[b + 1] = first_labels[b] + band_region_counts[b];
+			for_each_band_parallel(bands, height, [&](int band, int first_row, int end_row) {
+				int label = first_labels[band];
+				for (int i = first_row * width; i < end_row * width; ++i)
+					if (roots[i] == i)
+						labels[i] = label++;
+			});
+			for_each_band_parallel(bands, height, [&](int, int first_row, int end_row) {
+				for (int i = first_row * width; i < end_row * width; ++i)
+					if (roots[i] != i)
+						labels[i] = labels[roots[i]];
+			});
+
+			if (region_count != nullptr)
+				*region_count = first_labels[bands];
+			return labels;
+		}
+
+		// Labels regions of equal values.
+		template <class SqMap>
+		static std::vector<int> label_regions(const SqMap& map, const ParametricSurface& surf, int* region_count = nullptr)
+		{
+			return label_regions(map, surf, [](const auto& a, const auto& b) { return a == b; }, region_count);
 		}
 	};
 }
\ No newline at end of file
@@ -3,22 +3,92 @@
 #include "parametric_surface_intersection.h"
 #include "zig_zag_path.h"
 #include "height_map_renderer.h"
-#include "square_map_algorithms.h"
-#include "uv_switched_surface.h"
+#include "thread_pool.h"
+#include "generation_cache.h"
+#include <algorithm>
+#include <future>
 
 namespace ManualCAD
 {
-	std::vector<Vector2> swap_coords(const std::vector<Vector2> coords) {
-		std::vector<Vector2> result(coords.size());
-		for (int i = 0; i < coords.size(); ++i)
-			result[i] = { coords[i].y, coords[i].x };
-		return result;
+	namespace
+	{
+		// separate from pools that run whole generations, since these wait for intersections
+		ThreadPool& intersection_pool()
+		{
+			static ThreadPool pool;
+			return pool;
+		}
+	}
+
+	namespace
+	{
+		constexpr int MAX_SUBDIVISION_DEPTH = 16;
+
+		// appends points of surface between uv_a and uv_b (without a, which is already appended)
+		void subdivide(const ParametricSurface& surface, const Vector2& uv_a, const Vector3& a, const Vector2& uv_b, const Vector3& b, float chord_tolerance, float max_length, int depth, std::vector<Vector3>& points)
+		{
+			const auto chord = b - a;
+			const float chord_length = chord.length();
+			const auto uv_middle = 0.5f * (uv_a + uv_b);
+			const auto middle = surface.evaluate(uv_middle.x, uv_middle.y);
+			const float deviation = chord_length > 0.0f ? cross(middle - a, chord).length() / chord_length : (middle - a).length();
+			if (depth < MAX_SUBDIVISION_DEPTH && (chord_length > max_length || deviation > chord_tolerance))
+			{
+				subdivide(surface, uv_a, a, uv_middle, middle, chord_tolerance, max_length, depth + 1, points);
+				subdivide(surface, uv_middle, middle, uv_b, b, chord_tolerance, max_length, depth + 1, points);
+			}
+			else
+				points.push_back(b);
+		}
+	}
+
+	void SurfacePath::sample_path(const ParametricSurface& surface, const std::vector<Vector2>& uv_path, float chord_tolerance, float max_length, std::vector<Vector3>& points)
+	{
+		if (uv_path.empty())
+			return;
+
+		Vector3 previous = surface.evaluate(uv_path.front().x, uv_path.front().y);
+		points.push_back(previous);
+		for (size_t j = 1; j < uv_path.size(); ++j)
+		{
+			const auto current = surface.evaluate(uv_path[j].x, uv_path[j].y);
+			subdivide(surface, uv_path[j - 1], previous, uv_path[j], current, chord_tolerance, max_length, 0, points);
+			previous = current;
+		}
+	}
+
+	float SurfacePath::scallop_row_spacing(const ParametricSurface& surface, float v, float radius, float scallop_height, float fallback_spacing)
+	{
+		constexpr float MIN_CURVATURE_FACTOR = 0.1f; // bounds effective radius in concave regions
+		const auto u_range = surface.get_u_range();
+		float spacing = INFINITY;
+		for (int i = 0; i < ROW_SPACING_SAMPLES; ++i)
+		{
+			const float u = lerp(u_range.from, u_range.to, (i + 0.5f) / ROW_SPACING_SAMPLES);
+			const auto d = surface.evaluate_all(u, v, 2);
+
+			// direction across rows: dv without its component along the row
+			const float du_sq = dot(d.du, d.du);
+			const float a = du_sq > 0.0f ? -dot(d.du, d.dv) / du_sq : 0.0f;
+			const auto across = a * d.du + d.dv;
+			const float across_sq = dot(across, across);
+			if (across_sq <= 0.0f)
+				continue;
+
+			const auto cr = cross(d.du, d.dv);
+			const float cr_length = cr.length();
+			const float curvature = cr_length > 0.0f ? -dot(cr, a * a * d.duu + 2.0f * a * d.duv + d.dvv) / (cr_length * across_sq) : 0.0f;
+			const float effective_radius = radius / std::max(1.0f + radius * curvature, MIN_CURVATURE_FACTOR);
+			const float width = scallop_height < effective_radius ? 2.0f * sqrtf(scallop_height * (2.0f * effective_radius - scallop_height)) : 2.0f * effective_radius;
+			spacing = std::min(spacing, std::min(width, 2.0f * radius) / sqrtf(across_sq));
+		}
+		return spacing < INFINITY ? spacing : fallback_spacing;
 	}
 
 	template <class T, class U>
 	int get_idx(const std::vector<T>& container, const U& elem) { return dynamic_cast<const T*>(&elem) - container.data(); }
 
-	std::vector<std::vector<std::vector<Vector2>>> SurfacePath::generate_paths(const PlaneXZ& plane, const float radius, const float epsilon, const float mill_height, const Vector3& real_workpiece_size) const
+	std::vector<std::vector<std::vector<Vector2>>> SurfacePath::generate_paths(const PlaneXZ& plane, const float radius, const float epsilon, const float mill_height, const Vector3& real_workpiece_size, HeightMapRenderer::Backend backend, GenerationProgress* progress, GenerationCache* cache) const
 	{
 		std::vector<OffsetSurface> offset_surfs;
 		offset_surfs.reserve(surfaces.size());
@@ -26,18 +96,88 @@ namespace ManualCAD
 		for (const auto* s : surfaces)
 			offset_surfs.push_back(OffsetSurface{ *s, radius });
 
-		std::list<ParametricSurfaceIntersection> intersections;
+		// progress is reported (and cancellation checked) only between the steps, since a single step is not interruptible
+		auto report = [progress](GenerationProgress::Stage stage, int done, int count) {
+			if (progress == nullptr)
+				return;
+			if (done == 0)
+				progress->set_stage(stage);
+			progress->set_progress(static_cast<float>(done) / count);
+		};
+
+		// broad phase: surfaces with disjoint bounding boxes can't intersect; jobs are kept in order of pairs, then surfaces with plane
+		struct IntersectionJob {
+			const ParametricSurface& surf1;
+			const ParametricSurface& surf2;
+			uint64_t key;
+		};
+		constexpr float STEP = 0.01f;
+		constexpr size_t MAX_STEPS = 2000, SAMPLES = 29;
+		// cache keys depend on geometry of offset surfaces (thus also on radius) and parameters of intersection search
+		std::vector<uint64_t> hashes;
+		uint64_t plane_hash = 0;
+		if (cache != nullptr)
+		{
+			for (const auto& surf : offset_surfs)
+				hashes.push_back(GenerationCache::Key().add(surf).get());
+			plane_hash = GenerationCache::Key().add(plane).get();
+		}
+		auto job_key = [](uint64_t hash1, uint64_t hash2) {
+			return GenerationCache::Key().add(hash1).add(hash2).add(STEP).add(MAX_STEPS).add(SAMPLES).get();
+		};
+		auto hash_of = [&hashes](int i) { return hashes.empty() ? 0 : hashes[i]; };
+
+		std::vector<Box> boxes;
+		boxes.reserve(offset_surfs.size());
+		for (const auto& surf : offset_surfs)
+			boxes.push_back(surf.get_bounding_box());
+		auto overlaps = [](const Box& b1, const Box& b2) { return !Box::intersect(b1, b2).is_empty(); };
+
+		std::vector<IntersectionJob> jobs;
 		for (int i = 0; i < offset_surfs.size(); ++i)
 			for (int j = i + 1; j < offset_surfs.size(); ++j)
-			{
-				auto pair_intersections = ParametricSurfaceIntersection::find_many_intersections(offset_surfs[i], offset_surfs[j], 0.01f, 2000, 29, 29);
-				intersections.insert(intersections.end(), pair_intersections.begin(), pair_intersections.end());
+				if (overlaps(boxes[i], boxes[j]))
+					jobs.push_back({ offset_surfs[i], offset_surfs[j], job_key(hash_of(i), hash_of(j)) });
+		const Box plane_box = plane.get_bounding_box();
+		for (int i = 0; i < offset_surfs.size(); ++i)
+			if (overlaps(boxes[i], plane_box))
+				jobs.push_back({ offset_surfs[i], plane, job_key(hash_of(i), plane_hash) }); // TODO offset plane
+
+		// jobs reference local surfaces, so all of them have to finish before leaving the scope (also when cancelled)
+		std::vector<std::future<std::list<ParametricSurfaceIntersection>>> job_results;
+		struct WaitForJobs {
+			std::vector<std::future<std::list<ParametricSurfaceIntersection>>>& futures;
+			~WaitForJobs() {
+				for (auto& future : futures)
+					if (future.valid())
+						future.wait();
 			}
+		} wait_for_jobs{ job_results };
 
-		for (int i = 0; i < offset_surfs.size(); ++i)
+		report(GenerationProgress::Stage::Intersecting, 0, std::max<int>(jobs.size(), 1));
+		for (const auto& job : jobs)
+			job_results.push_back(intersection_pool().submit([job, progress, cache]() {
+				if (progress != nullptr && progress->is_cancelled())
+					return std::list<ParametricSurfaceIntersection>();
+				if (cache != nullptr)
+				{
+					if (auto cached = cache->find_intersections(job.key, job.surf1, job.surf2))
+						return std::move(cached.value());
+				}
+				// jobs already run on all threads of the pool, thus a job seeds its pairs of boxes alone
+				auto result = ParametricSurfaceIntersection::find_many_intersections(job.surf1, job.surf2, STEP, MAX_STEPS, SAMPLES, SAMPLES, false, 1);
+				if (cache != nullptr)
+					cache->store_intersections(job.key, result);
+				return result;
+			}));
+
+		// results are merged in order of jobs, thus independently of the order in which they finish
+		std::list<ParametricSurfaceIntersection> intersections;
+		for (int k = 0; k < job_results.size(); ++k)
 		{
-			auto plane_intersections = ParametricSurfaceIntersection::find_many_intersections(offset_surfs[i], plane, 0.01f, 2000, 29, 29); // TODO offset plane
-			intersections.insert(intersections.end(), plane_intersections.begin(), plane_intersections.end());
+			auto pair_intersections = job_results[k].get();
+			intersections.splice(intersections.end(), pair_intersections);
+			report(GenerationProgress::Stage::Intersecting, k + 1, job_results.size());
 		}
 
 		std::vector<std::list<std::pair<std::vector<Vector2>, bool>>> intersection_curves_for_surfs(offset_surfs.size());
@@ -66,7 +206,21 @@ namespace ManualCAD
 		Box box = plane.get_bounding_box();
 		box.y_max += mill_height;
 		Vector3 map_size = { box.x_max - box.x_min, box.y_max - box.y_min,box.z_max - box.z_min };
-		auto height_map = HeightMapRenderer{ surfaces, box, radius }.render_index_map(map_size);
+		report(GenerationProgress::Stage::Rendering, 0, 1);
+		uint64_t map_key = 0;
+		std::optional<OwnershipMap> cached_map;
+		if (cache != nullptr)
+		{
+			GenerationCache::Key key;
+			for (const auto* s : surfaces)
+				key.add(*s);
+			map_key = key.add(box.x_min).add(box.x_max).add(box.y_min).add(box.y_max).add(box.z_min).add(box.z_max)
+				.add(radius).add(map_size).add(static_cast<int>(backend)).get();
+			cached_map = cache->find_ownership_map(map_key);
+		}
+		auto ownership_map = cached_map.has_value() ? std::move(cached_map.value()) : HeightMapRenderer{ surfaces, box, radius }.render_ownership_map(map_size, backend);
+		if (cache != nullptr && !cached_map.has_value())
+			cache->store_ownership_map(map_key, ownership_map);
 
 		auto box_center3 = box.center();
 		Vector2 box_center = { box_center3.x, box_center3.z };
@@ -74,36 +228,50 @@ namespace ManualCAD
 		
 		std::vector<std::vector<std::vector<Vector2>>> result(offset_surfs.size() + 1); // plus 1 because last is for plane
 
+		// with scallop height, spacing is estimated at the row and at the next row (on the base surface, which has the same parametrization)
+		auto generate_zig_zag = [&](const ZigZagPath& path, const ParametricSurface& surface, const ParametricSurface& base_surface, const auto& check) {
+			if (scallop_height <= 0.0f)
+				return path.generate_paths_excluding_segments(surface.get_u_range(), surface.get_v_range(), radius, epsilon, check);
+			return path.generate_paths_excluding_segments(surface.get_u_range(), surface.get_v_range(), [&](float v) {
+				const float spacing = scallop_row_spacing(base_surface, v, radius, scallop_height, 2.0f * radius - epsilon);
+				return std::min(spacing, scallop_row_spacing(base_surface, std::min(v + spacing, surface.get_v_range().to), radius, scallop_height, 2.0f * radius - epsilon));
+			}, check);
+		};
+		const std::vector<const ParametricSurfaceObject*> base_surfs(surfaces.begin(), surfaces.end());
+
 		// generate paths for surfaces
+		const int zig_zag_count = offset_surfs.size() + 1;
 		for (int i = 0; i < offset_surfs.size(); ++i)
 		{
+			report(GenerationProgress::Stage::ZigZag, i, zig_zag_count);
 			ZigZagPath path;
 			for (const auto& line : intersection_curves_for_surfs[i])
 				path.add_line(line.first, line.second);
 
-			auto result2 = path.generate_paths_excluding_segments(offset_surfs[i].get_u_range(), offset_surfs[i].get_v_range(), radius, epsilon, [&offset_surfs, i, &height_map, box_center](const Vector2& start, const Vector2& end) {
+			auto result2 = generate_zig_zag(path, offset_surfs[i], *base_surfs[i], [&offset_surfs, i, &ownership_map, box_center](const Vector2& start, const Vector2& end) {
 				auto middle = 0.5f * (start + end);
 				const auto& surf = offset_surfs[i];
-				if (dot(surf.normal(middle.x, middle.y), { 0.0f,1.0f,0.0f }) <= 0)
+				const auto derivatives = surf.evaluate_all(middle.x, middle.y, 1);
+				if (dot(normalize(cross(derivatives.du, derivatives.dv)), { 0.0f,1.0f,0.0f }) <= 0)
 					return false;
 
-				auto point3 = surf.evaluate(middle.x, middle.y);
+				auto point3 = derivatives.point;
 				Vector2 point = { point3.x,point3.z };
-				const auto coords = height_map.position_to_pixel(point - box_center);
+				const auto coords = ownership_map.position_to_pixel(point - box_center);
 
-				int idx = lroundf(height_map.get_pixel(lroundf(coords.y), lroundf(coords.x)));
-				/* int idxpx = lroundf(height_map.get_pixel(lroundf(coords.y), lroundf(coords.x) + 1));
-				 int idxmx = lroundf(height_map.get_pixel(lroundf(coords.y), lroundf(coords.x) - 1));
-				 int idxpy = lroundf(height_map.get_pixel(lroundf(coords.y) + 1, lroundf(coords.x)));
-				 int idxmy = lroundf(height_map.get_pixel(lroundf(coords.y) - 1, lroundf(coords.x)));
+				int idx = ownership_map.get_pixel(lroundf(coords.y), lroundf(coords.x));
+				/* int idxpx = lroundf(ownership_map.get_pixel(lroundf(coords.y), lroundf(coords.x) + 1));
+				 int idxmx = lroundf(ownership_map.get_pixel(lroundf(coords.y), lroundf(coords.x) - 1));
+				 int idxpy = lroundf(ownership_map.get_pixel(lroundf(coords.y) + 1, lroundf(coords.x)));
+				 int idxmy = lroundf(ownership_map.get_pixel(lroundf(coords.y) - 1, lroundf(coords.x)));
 
 				 if (idx != idxpx || idx != idxmx || idx != idxpy || idx != idxmy)
 				 {
 					 auto other = 0.25f * start + 0.75f * end;
 					 point3 = surf.evaluate(other.x, other.y);
 					 point = { point3.x,point3.z };
-					 const auto coords2 = height_map.position_to_pixel(point - box_center);
-					 idx = lroundf(height_map.get_pixel(lroundf(coords2.y), lroundf(coords2.x)));
+					 const auto coords2 = ownership_map.position_to_pixel(point - box_center);
+					 idx = lroundf(ownership_map.get_pixel(lroundf(coords2.y), lroundf(coords2.x)));
 				 }*/
 				return idx == (i + 1);
 				/*if ((i + 1) != idx)
@@ -116,52 +284,39 @@ namespace ManualCAD
 		}
 
 		// generate paths for plane
+		report(GenerationProgress::Stage::ZigZag, offset_surfs.size(), zig_zag_count);
 		auto& plane_result = result.back();
 		ZigZagPath path;
 		for (const auto& line : intersection_curves_for_plane)
 			path.add_line(line.first, line.second);
 
-		// flood fill index map from corner and then make path (grid) on non-filled regions (=0)
-		SquareMapAlgorithms::flood_fill(height_map, 0, 0, -1.0f, plane);
-		plane_result = path.generate_paths_excluding_segments(plane.get_u_range(), plane.get_v_range(), radius, epsilon, [&plane, &height_map, box_center](const Vector2& start, const Vector2& end) {
+		// flood fill ownership map from corner and then make path (grid) on non-filled empty regions (which are enclosed by the model)
+		ownership_map.flood_fill(0, 0, OwnershipMap::OUTSIDE);
+		auto is_enclosed = [&ownership_map, box_center](const Vector3& point3) {
+			Vector2 point = { point3.x,point3.z };
+			const auto coords = ownership_map.position_to_pixel(point - box_center);
+			return ownership_map.get_pixel(lroundf(coords.y), lroundf(coords.x)) == OwnershipMap::NONE;
+		};
+		plane_result = generate_zig_zag(path, plane, plane, [&plane, &is_enclosed](const Vector2& start, const Vector2& end) {
 			if ((start - end).length() < 0.15f)
 				return false; // remove very small segments (which we assume they do not appear in our model)
 			
 			auto middle = 0.5f * (start + end);
 			// normal of a plane if always {0,1,0}, so there is no need to check it
 
-			auto point3 = plane.evaluate(middle.x, middle.y);
-			Vector2 point = { point3.x,point3.z };
-			const auto coords = height_map.position_to_pixel(point - box_center);
-
-			int idx = lroundf(height_map.get_pixel(lroundf(coords.y), lroundf(coords.x)));
-			return idx == 0;
+			return is_enclosed(plane.evaluate(middle.x, middle.y));
 		});
 
-		ZigZagPath vu_path;
-		for (const auto& line : intersection_curves_for_plane)
-			vu_path.add_line(swap_coords(line.first), line.second);
-
-		UVSwitchedSurface vu_plane{ plane };
-		auto vu_plane_result = vu_path.generate_paths_excluding_segments(vu_plane.get_u_range(), vu_plane.get_v_range(), radius, epsilon, [&vu_plane, &height_map, box_center](const Vector2& start, const Vector2& end) {
+		// second pass goes across the first one; parameters of the plane are X and Z, so rows are rotated by a right angle in them
+		// (with scallop height spacing doesn't depend on direction on a plane, thus it is turned into equivalent epsilon)
+		const float plane_epsilon = scallop_height <= 0.0f ? epsilon : 2.0f * radius - scallop_row_spacing(plane, plane.get_v_range().from, radius, scallop_height, 2.0f * radius - epsilon);
+		auto vu_plane_result = path.generate_paths_excluding_segments(Vector2{ plane.get_u_range().from, plane.get_v_range().from }, Vector2{ plane.get_u_range().to, plane.get_v_range().to }, radius, plane_epsilon, [&plane, &is_enclosed](const Vector2& start, const Vector2& end) {
 			if ((start - end).length() < 0.15f)
 				return false; // remove very small segments (which we assume they do not appear in our model)
-			
-			auto middle = 0.5f * (start + end);
-			// normal of a plane if always {0,1,0}, so there is no need to check it
 
-			auto point3 = vu_plane.evaluate(middle.x, middle.y);
-			Vector2 point = { point3.x,point3.z };
-			const auto coords = height_map.position_to_pixel(point - box_center);
-
-			int idx = lroundf(height_map.get_pixel(lroundf(coords.y), lroundf(coords.x)));
-			return idx == 0;
-		});
-		for (auto& path : vu_plane_result)
-		{
-			for (auto& p : path)
-				std::swap(p.x, p.y);
-		}
+			auto middle = 0.5f * (start + end);
+			return is_enclosed(plane.evaluate(middle.x, middle.y));
+		}, HALF_PI);
 		plane_result.insert(plane_result.end(), vu_plane_result.begin(), vu_plane_result.end());
 
 		return result;
@@ -6,14 +6,33 @@
 #include <list>
 #include <vector>
 #include "plane_xz.h"
+#include "height_map_renderer.h"
+#include "generation_progress.h"
+#include "generation_cache.h"
 
 namespace ManualCAD
 {
 	class SurfacePath {
+		static constexpr int ROW_SPACING_SAMPLES = 32; // points of a row at which spacing to the next row is estimated
+
 		const std::list<const ParametricSurfaceObject*>& surfaces;
+		float scallop_height;
 	public:
-		SurfacePath(const std::list<const ParametricSurfaceObject*>& surfaces) : surfaces(surfaces) {}
+		// With positive scallop height rows of zig-zag paths are spaced to keep scallops of that height, otherwise they are spaced evenly
+		// in parameter space by 2 * radius - epsilon.
+		SurfacePath(const std::list<const ParametricSurfaceObject*>& surfaces, float scallop_height = 0.0f) : surfaces(surfaces), scallop_height(scallop_height) {}
+
+		std::vector<std::vector<std::vector<Vector2>>> generate_paths(const PlaneXZ& plane, const float radius, const float epsilon, const float mill_height, const Vector3& real_workpiece_size, HeightMapRenderer::Backend backend = HeightMapRenderer::Backend::GPU, GenerationProgress* progress = nullptr, GenerationCache* cache = nullptr) const;
+
+		// Appends points of surface along a polyline in its parameter space. Every segment is subdivided until the middle of each piece
+		// is at most chord_tolerance away from its chord and pieces are at most max_length long (both measured on the surface).
+		static void sample_path(const ParametricSurface& surface, const std::vector<Vector2>& uv_path, float chord_tolerance, float max_length, std::vector<Vector3>& points);
 
-		std::vector<std::vector<std::vector<Vector2>>> generate_paths(const PlaneXZ& plane, const float radius, const float epsilon, const float mill_height, const Vector3& real_workpiece_size) const;
+		// Returns distance in v from row of constant v to the next one, such that ball cutter of given radius going along both rows leaves
+		// scallops at most scallop_height high. Distance between rows on the surface is w = 2 * sqrt(h * (2 * R' - h)), where effective
+		// radius R' = R / (1 + R * k) accounts for normal curvature k across rows (positive where surface is convex); it is taken as the
+		// minimum over samples of the row and is converted to v with length of dv orthogonalized to du. If no sample gives a direction
+		// across the row (e.g. at a pole, where dv vanishes), fallback spacing is returned.
+		static float scallop_row_spacing(const ParametricSurface& surface, float v, float radius, float scallop_height, float fallback_spacing);
 	};
 }
\ No newline at end of file
@@ -0,0 +1,39 @@
+#include "thread_pool.h"
+
+namespace ManualCAD
+{
+	ThreadPool::ThreadPool(size_t thread_count)
+	{
+		workers.reserve(thread_count);
+		for (size_t i = 0; i < thread_count; ++i)
+			workers.emplace_back([this]() { work(); });
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		condition.notify_all();
+		for (auto& worker : workers)
+			worker.join();
+	}
+
+	void ThreadPool::work()
+	{
+		while (true)
+		{
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				condition.wait(lock, [this]() { return stopping || !tasks.empty(); });
+				if (tasks.empty()) // stopping and nothing left
+					return;
+				task = std::move(tasks.front());
+				tasks.pop();
+			}
+			task();
+		}
+	}
+}
\ No newline at end of file
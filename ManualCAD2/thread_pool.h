@@ -0,0 +1,50 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace ManualCAD
+{
+	// Fixed set of worker threads executing submitted functions in FIFO order.
+	// A function must not wait for other functions of the same pool (it may deadlock if all workers wait).
+	class ThreadPool {
+		std::vector<std::thread> workers;
+		std::queue<std::function<void()>> tasks;
+		std::mutex mutex;
+		std::condition_variable condition;
+		bool stopping = false;
+
+		void work();
+	public:
+		explicit ThreadPool(size_t thread_count = std::max(1u, std::thread::hardware_concurrency()));
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+		// Finishes all submitted functions and joins workers.
+		~ThreadPool();
+
+		size_t get_thread_count() const { return workers.size(); }
+
+		// Schedules function; its result (or thrown exception) is available through returned future.
+		template <class Function>
+		std::future<std::invoke_result_t<std::decay_t<Function>>> submit(Function&& function)
+		{
+			using Result = std::invoke_result_t<std::decay_t<Function>>;
+			auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<Function>(function));
+			auto future = task->get_future();
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				tasks.push([task]() { (*task)(); });
+			}
+			condition.notify_one();
+			return future;
+		}
+	};
+}
\ No newline at end of file
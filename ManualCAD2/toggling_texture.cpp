@@ -62,6 +62,7 @@ namespace ManualCAD
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 		fbo.unbind();
 		glViewport(old_viewport[0], old_viewport[1], old_viewport[2], old_viewport[3]);
+		region_labels.clear();
 	}
 
 	void TogglingTexture::add_line(const Line2D& line)
@@ -98,6 +99,7 @@ namespace ManualCAD
 			line->render(renderer, tex_width, tex_height);
 		fbo.unbind();
 		glViewport(old_viewport[0], old_viewport[1], old_viewport[2], old_viewport[3]);
+		region_labels.clear();
 		valid = true;
 	}
 
@@ -113,7 +115,13 @@ namespace ManualCAD
 			new_color = { 0.0f, 0.0f, 0.0f, 0.0f };
 		else
 			new_color = { 0.0f, 0.0f, 1.0f, 1.0f };
-		SquareMapAlgorithms::flood_fill(image, x, y, new_color, surf);
+		// toggling does not move lines, so all regions are labeled at once and following toggles only look up their labels
+		if (region_labels.empty())
+			region_labels = SquareMapAlgorithms::label_regions(image, surf, [](const Vector4& a, const Vector4& b) { return a.x != 1.0f && b.x != 1.0f; });
+		const int label = region_labels[x + y * tex_width];
+		for (size_t i = 0; i < image.pixels.size(); ++i)
+			if (region_labels[i] == label)
+				image.pixels[i] = new_color;
 		texture.set_image(tex_width, tex_height, image.pixels.data());
 	}
 }
\ No newline at end of file
@@ -18,6 +18,7 @@ namespace ManualCAD
 		int tex_width = 0, tex_height = 0;
 		bool valid = false;
 		std::list<const Line2D*> lines;
+		std::vector<int> region_labels; // of regions bounded by lines (at x + y * width); empty until the first toggle after lines change
 		const ParametricSurfaceObject& surf;
 	public:
 		TogglingTexture(int width, int height, const ParametricSurfaceObject& surf) : tex_width(width), tex_height(height), surf(surf)
@@ -25,6 +25,11 @@ namespace ManualCAD
 			return du(v, u);
 		}
 
+		SurfaceDerivatives evaluate_all(float u, float v, int order) const override {
+			const auto switched = surf.evaluate_all(v, u, order);
+			return { switched.point, switched.dv, switched.du, switched.dvv, switched.duv, switched.duu };
+		}
+
 		Box get_bounding_box() const override {
 			return surf.get_bounding_box();
 		}
@@ -0,0 +1,90 @@
+#include "waterline_path.h"
+#include "map_contours.h"
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <thread>
+
+namespace ManualCAD
+{
+	float WaterlinePath::slope(const Vector2& pixel) const
+	{
+		const int i = static_cast<int>(floorf(pixel.x)), j = static_cast<int>(floorf(pixel.y));
+		const float cell_a = map.size.z / map.height, cell_b = map.size.x / map.width;
+		const float da = (map.get_pixel(i + 1, j) - map.get_pixel(i - 1, j)) / (2.0f * cell_a),
+			db = (map.get_pixel(i, j + 1) - map.get_pixel(i, j - 1)) / (2.0f * cell_b);
+		return sqrtf(da * da + db * db);
+	}
+
+	std::vector<std::vector<Vector3>> WaterlinePath::generate_paths(float step, float min_slope) const
+	{
+		if (step <= 0.0f)
+			return {};
+		float top = 0.0f;
+		for (int j = 0; j < map.height; ++j)
+			for (int i = 0; i < map.width; ++i)
+				top = std::max(top, map.get_pixel(i, j));
+		const int levels = std::max(0, static_cast<int>(ceilf(top / step)) - 1);
+
+		// levels are independent, thus they are split among hardware threads; level k is at height (levels - k) * step
+		std::vector<std::vector<std::vector<Vector3>>> level_paths(levels);
+		auto trace_level = [&](int k) {
+			const float level = (levels - k) * step;
+			for (const auto& contour : MapContours::trace(map, level))
+			{
+				auto to_path_point = [&](const Vector2& pixel) {
+					const auto position = map.pixel_to_position({ pixel.y, pixel.x }); // map is transposed
+					return Vector3{ position.x, level, position.y };
+				};
+				const bool closed = contour.size() > 2 && contour.front().x == contour.back().x && contour.front().y == contour.back().y;
+				const int n = static_cast<int>(contour.size()) - (closed ? 1 : 0);
+				std::vector<char> steep(n, true);
+				int first_flat = -1;
+				if (min_slope > 0.0f)
+					for (int p = 0; p < n; ++p)
+						if (!(steep[p] = slope(contour[p]) >= min_slope) && first_flat < 0)
+							first_flat = p;
+
+				if (first_flat < 0)
+				{
+					std::vector<Vector3> path;
+					for (const auto& pixel : contour)
+						path.push_back(to_path_point(pixel));
+					level_paths[k].push_back(std::move(path));
+					continue;
+				}
+				// runs of steep points become paths; a closed contour is traversed from its flat point, so runs don't wrap around
+				std::vector<Vector3> path;
+				const int start = closed ? first_flat : 0;
+				for (int m = 0; m <= n; ++m)
+				{
+					const int p = (start + m) % n;
+					if (m < n && steep[p])
+						path.push_back(to_path_point(contour[p]));
+					else
+					{
+						if (path.size() >= 2)
+							level_paths[k].push_back(std::move(path));
+						path.clear();
+					}
+				}
+			}
+		};
+
+		const int workers = std::max(1, std::min(static_cast<int>(std::thread::hardware_concurrency()), levels));
+		std::vector<std::future<void>> futures;
+		for (int w = 0; w < workers; ++w)
+			futures.push_back(std::async(std::launch::async, [&trace_level, w, workers, levels]() {
+				for (int k = w; k < levels; k += workers)
+					trace_level(k);
+			}));
+		for (auto& future : futures)
+			future.get();
+
+		std::vector<std::vector<Vector3>> paths;
+		for (auto& level : level_paths)
+			for (auto& path : level)
+				paths.push_back(std::move(path));
+		return paths;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "algebra.h"
+#include "height_map.h"
+#include <vector>
+
+namespace ManualCAD
+{
+	// Waterline (Z-level) paths: contours of a clearance map (the lowest cutter tip heights, i.e. model's height map dilated by cutter)
+	// at constant heights. Cutter moving along a contour touches the model without gouging it, thus contours finish steep walls, where
+	// rows of zig-zag paths are far apart. Map is transposed as rendered maps (the first index of get_pixel goes along Z).
+	class WaterlinePath {
+		const HeightMap& map;
+
+		float slope(const Vector2& pixel) const;
+	public:
+		WaterlinePath(const HeightMap& map) : map(map) {}
+
+		// Returns contours at levels step, 2 * step, ... below the highest pixel of the map, from the top, as paths of cutter's tip
+		// (x, height above base, z, in units of the map, x and z relative to its center). Parts of contours where slope of the map
+		// is lower than min_slope are left out. Levels are traced in parallel with marching squares.
+		std::vector<std::vector<Vector3>> generate_paths(float step, float min_slope = 0.0f) const;
+	};
+}
\ No newline at end of file
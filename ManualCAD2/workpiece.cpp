@@ -1,11 +1,44 @@
 #include "workpiece.h"
 #include "object_settings.h"
+#include "thread_pool.h"
+#include "logger.h"
 
 namespace ManualCAD {
 	int Workpiece::counter = 0;
 
+	namespace
+	{
+		// jobs of all workpieces are simulated one at a time; every simulation already holds a few full height maps
+		ThreadPool& simulation_pool()
+		{
+			static ThreadPool pool(1);
+			return pool;
+		}
+	}
+
+	// Waits (without blocking a frame) for the state of the workpiece after a job simulated on a worker thread.
+	class JobSimulationTaskStep : public SingleTaskStep
+	{
+		Workpiece& workpiece;
+	public:
+		JobSimulationTaskStep(Workpiece& workpiece) : workpiece(workpiece) {}
+
+		bool execute(const TaskParameters&) override {
+			if (workpiece.job_simulation.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+				return true;
+			workpiece.finish_job_simulation();
+			return false;
+		}
+
+		void execute_immediately(const TaskParameters&) override {
+			workpiece.finish_job_simulation();
+		}
+	};
+
 	void Workpiece::generate_renderable()
 	{
+		if (model == Model::Dexel)
+			dexel_map.to_height_map(height_map);
 		renderable.set_data_from_map(height_map);
 		renderable.color = color;
 	}
@@ -62,6 +95,54 @@ namespace ManualCAD {
 		}
 	}
 
+	void Workpiece::set_model(Model model)
+	{
+		this->model = model;
+		if (model == Model::Dexel)
+			dexel_map.resize(dexel_divisions_x, dexel_divisions_y, size);
+		else
+			dexel_map = DexelMap(); // release segment pool
+		height_map.fill(size);
+		invalidate();
+	}
+
+	void Workpiece::simulate_milling_job()
+	{
+		if (!can_execute_milling_program())
+			return;
+		if (model == Model::Dexel) // states of dexel model are not memoized, so the whole job is simulated
+		{
+			dexel_map.fill(size);
+			for (size_t i = 0; i < job.size(); ++i)
+				job.get_program(i).execute_on(dexel_map, max_cutter_depth);
+			invalidate();
+			return;
+		}
+
+		job_simulation = simulation_pool().submit([this, initial_state = HeightMap{ divisions_x, divisions_y, size }, max_cutter_depth = max_cutter_depth]() {
+			return job.simulate(initial_state, max_cutter_depth);
+		});
+
+		Task task(active_task_ended);
+		task.add_step<JobSimulationTaskStep>(*this);
+		active_task = &task_manager.add_task(std::move(task));
+	}
+
+	void Workpiece::finish_job_simulation()
+	{
+		try
+		{
+			auto state = job_simulation.get();
+			if (model == Model::HeightMap) // otherwise height map is a view of dexel map
+				height_map = *state;
+		}
+		catch (const std::exception& e)
+		{
+			Logger::log_error("[ERROR] Simulating milling job: %s\n", e.what());
+		}
+		invalidate();
+	}
+
 	std::vector<ObjectHandle> Workpiece::clone() const
 	{
 		return std::vector<ObjectHandle>(); // Workpiece is a special object and thus can't be cloned
@@ -71,5 +152,7 @@ namespace ManualCAD {
 	{
 		if (active_task != nullptr && !active_task_ended)
 			active_task->terminate();
+		if (job_simulation.valid()) // worker reads the job
+			job_simulation.wait();
 	}
 }
\ No newline at end of file
@@ -2,16 +2,23 @@
 
 #include "object.h"
 #include "height_map.h"
+#include "dexel_map.h"
 #include "workpiece_renderable.h"
 #include "task.h"
 #include "milling_program.h"
+#include "milling_job.h"
 #include <optional>
+#include <future>
 #include "triangle_mesh.h"
 
 namespace ManualCAD
 {
 	class Workpiece : public Object {
 		friend class ObjectSettings;
+		friend class JobSimulationTaskStep;
+	public:
+		enum class Model { HeightMap, Dexel };
+	private:
 
 		static int counter;
 		WorkpieceRenderable renderable;
@@ -23,14 +30,21 @@ namespace ManualCAD
 		float max_cutter_depth = 10.0f;
 
 		std::optional<MillingProgram> program;
+		MillingJob job;
+		std::future<std::shared_ptr<const HeightMap>> job_simulation; // valid from start of simulation until its result is taken
+
+		void finish_job_simulation();
 
+		Model model = Model::HeightMap;
 		int divisions_x = 1500, divisions_y = 1500;
+		int dexel_divisions_x = 500, dexel_divisions_y = 500;
 		Vector3 size = { 15, 5, 15 };
 
 		void generate_renderable() override;
 		void build_specific_settings(ObjectSettingsWindow& parent) override;
 	public:
-		HeightMap height_map;
+		HeightMap height_map; // in dexel model it is only a view of dexel map, refreshed when rendering
+		DexelMap dexel_map;
 
 		Workpiece(TaskManager& task_manager) : Object(renderable), path(), cylinder(), renderable(size, path, cylinder), task_manager(task_manager), program(std::nullopt) {
 			height_map = { divisions_x, divisions_y, size };
@@ -49,8 +63,19 @@ namespace ManualCAD
 
 		void recreate_height_map() {
 			height_map.resize(divisions_x, divisions_y, size);
+			if (model == Model::Dexel)
+				dexel_map.resize(dexel_divisions_x, dexel_divisions_y, size);
+		}
+		void reset_material() {
+			height_map.fill(size);
+			if (model == Model::Dexel)
+				dexel_map.fill(size);
 		}
 
+		Model get_model() const { return model; }
+		// Switching the model resets the workpiece to full stock.
+		void set_model(Model model);
+
 		void set_milling_program(MillingProgram&& milling_program);
 		void delete_milling_program();
 		bool has_milling_program() const;
@@ -60,6 +85,13 @@ namespace ManualCAD
 		MillingProgram& get_milling_program() { return program.value(); }
 		const MillingProgram& get_milling_program() const { return program.value(); }
 
+		MillingJob& get_milling_job() { return job; }
+		const MillingJob& get_milling_job() const { return job; }
+		// Replaces height map with the state after all programs of the job, starting from a full (not milled) workpiece.
+		// Height map model is simulated on a worker thread (and the job must not change until it ends); dexel model immediately.
+		void simulate_milling_job();
+		bool is_simulating_job() const { return job_simulation.valid(); }
+
 		void set_cutter_mesh_position(const Vector3& pos) { cylinder.set_model_matrix(Matrix4x4::translation(pos)); }
 
 		float get_max_cutter_depth() const { return max_cutter_depth; }
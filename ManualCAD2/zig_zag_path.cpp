@@ -1,52 +1,74 @@
 #include "zig_zag_path.h"
 #include "planimetrics.h"
 #include "logger.h"
+#include "exception.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <future>
 
 namespace ManualCAD
 {
-	std::vector<std::list<ZigZagPath::LoopIntersection>> ZigZagPath::calculate_intersection_of_loops_with_rows(const int& rows, const Vector2& min, const Vector2& max, const float& row_width) const
+	std::vector<float> ZigZagPath::make_rows(const Vector2& min, const Vector2& max, const float row_width)
 	{
-		std::vector<std::list<LoopIntersection>> intersections(rows);
-		// calculate intersections of loops with rows
-		for (int i = 0; i < rows; ++i)
-		{
-			const Vector2 seg1start{ min.x, min.y + i * row_width },
-				seg1end{ max.x, min.y + i * row_width };
-			for (const auto& line : lines)
+		const int count = static_cast<int>((max.y - min.y) / row_width) + 1;
+		std::vector<float> rows(count);
+		for (int i = 0; i < count; ++i)
+			rows[i] = min.y + i * row_width;
+		return rows;
+	}
+
+	std::vector<float> ZigZagPath::make_rows(const Vector2& min, const Vector2& max, const RowSpacing& row_spacing)
+	{
+		const float min_spacing = std::max(1e-4f * (max.y - min.y), 1e-6f); // guards against degenerate spacing
+		std::vector<float> rows;
+		for (float y = min.y; y <= max.y; y += std::max(row_spacing(y), min_spacing))
+			rows.push_back(y);
+		return rows;
+	}
+
+	std::vector<std::vector<ZigZagPath::LoopIntersection>> ZigZagPath::calculate_intersection_of_loops_with_rows(const std::vector<float>& rows, const Vector2& min, const Vector2& max) const
+	{
+		std::vector<std::vector<LoopIntersection>> intersections(rows.size());
+
+		// rows are horizontal, so every segment is intersected only with rows within its y-range (half-open, so that a vertex lying
+		// on a row is counted once); total cost is linear in number of segments and intersections (plus a binary search per segment)
+		const auto intersect_segment = [&](const Vector2& start, const Vector2& end, const PathLine& line, int idx) {
+			const float y_min = std::min(start.y, end.y), y_max = std::max(start.y, end.y);
+			if (y_min == y_max)
+				return;
+			for (auto it = std::lower_bound(rows.begin(), rows.end(), y_min); it != rows.end() && *it < y_max; ++it)
 			{
-				for (int j = 0; j < line.points.size() - 1; ++j)
-				{
-					const auto& seg2start = line.points[j];
-					//const auto& seg2end = j == loop.size() - 1 ? loop[0] : loop[j + 1];
-					const auto& seg2end = line.points[j + 1];
-					Vector2 intersection;
-					if (Planimetrics::intersect(seg1start, seg1end, seg2start, seg2end, intersection)) { // TODO optimize for special case: zigzags are horizontal lines
-						intersections[i].push_back({ intersection.x, &line, j });
-					}
-				}
-				if (line.looped)
-				{
-					const auto& seg2start = line.points.back();
-					const auto& seg2end = line.points.front();
-					Vector2 intersection;
-					if (Planimetrics::intersect(seg1start, seg1end, seg2start, seg2end, intersection)) { // TODO optimize for special case: zigzags are horizontal lines
-						intersections[i].push_back({ intersection.x, &line, static_cast<int>(line.points.size() - 1) });
-					}
-				}
+				const float y = *it;
+				const int i = static_cast<int>(it - rows.begin());
+				const float x = start.x + (y - start.y) * (end.x - start.x) / (end.y - start.y);
+				if (x >= min.x && x <= max.x)
+					intersections[i].push_back({ x, &line, idx });
 			}
-			intersections[i].sort([](const auto& a, const auto& b) { return a.x < b.x; });
+		};
+
+		for (const auto& line : lines)
+		{
+			for (int j = 0; j < static_cast<int>(line.points.size()) - 1; ++j)
+				intersect_segment(line.points[j], line.points[j + 1], line, j);
+			if (line.looped)
+				intersect_segment(line.points.back(), line.points.front(), line, static_cast<int>(line.points.size() - 1));
 		}
 
+		for (auto& row : intersections)
+			std::stable_sort(row.begin(), row.end(), [](const auto& a, const auto& b) { return a.x < b.x; });
+
 		return intersections;
 	}
 
-	std::vector<std::vector<ZigZagPath::PathSegment>> ZigZagPath::make_segment_list_outside_loops(const std::vector<std::list<LoopIntersection>>& intersections, const Vector2& min, const Vector2& max, const float& row_width) const
+	std::vector<std::vector<ZigZagPath::PathSegment>> ZigZagPath::make_segment_list_outside_loops(const std::vector<std::vector<LoopIntersection>>& intersections, const std::vector<float>& rows, const Vector2& min, const Vector2& max) const
 	{
 		std::vector<std::vector<PathSegment>> zigzag_segments(intersections.size());
 		for (int i = 0; i < intersections.size(); ++i)
 		{
 			PathSegment s;
-			s.y = min.y + i * row_width;
+			s.y = rows[i];
 			s.start = { min.x, nullptr, -1 };
 			bool complete = false;
 			for (const auto& isec : intersections[i])
@@ -73,13 +95,13 @@ namespace ManualCAD
 		return zigzag_segments;
 	}
 
-	std::vector<std::vector<ZigZagPath::PathSegment>> ZigZagPath::make_segment_list_with_check(const std::vector<std::list<LoopIntersection>>& intersections, const SegmentCheck& check, const Vector2& min, const Vector2& max, const float& row_width) const
+	std::vector<std::vector<ZigZagPath::PathSegment>> ZigZagPath::make_segment_list_with_check(const std::vector<std::vector<LoopIntersection>>& intersections, const SegmentCheck& check, const std::vector<float>& rows, const Vector2& min, const Vector2& max) const
 	{
 		std::vector<std::vector<PathSegment>> zigzag_segments(intersections.size());
 		for (int i = 0; i < intersections.size(); ++i)
 		{
 			PathSegment s;
-			s.y = min.y + i * row_width;
+			s.y = rows[i];
 			s.start = { min.x, nullptr, -1 };
 			bool prev_check_successful = false; // we use this flag to discard false-positives after intersection
 
@@ -103,7 +125,7 @@ namespace ManualCAD
 		return zigzag_segments;
 	}
 
-	std::vector<std::vector<Vector2>> ZigZagPath::link_segments_and_create_paths(std::vector<std::vector<PathSegment>>& zigzag_segments, const Vector2& min, const Vector2& max, const float& row_width) const
+	std::vector<std::vector<Vector2>> ZigZagPath::link_segments_and_create_paths(std::vector<std::vector<PathSegment>>& zigzag_segments, const std::vector<float>& row_ys, int& failed_links) const
 	{
 		constexpr float EPS = 10e-3;
 
@@ -125,7 +147,7 @@ namespace ManualCAD
 			bool early_break = false;
 			for (; i < rows - 1; ++i)
 			{
-				const float next_ycoord = min.y + (i + 1) * row_width;
+				const float next_ycoord = row_ys[i + 1];
 				const PathSegment seg = zigzag_segments[i][next_idx];
 				zigzag_segments[i].erase(zigzag_segments[i].begin() + next_idx);
 				while (first_not_empty < rows && zigzag_segments[first_not_empty].empty())
@@ -214,7 +236,7 @@ namespace ManualCAD
 						else if (first_x > nearest_x && nearest_x - target_x > EPS)
 							while (nearest_x - current_list.back().x > EPS)
 								current_list.pop_back();
-						else*/ if (std::abs(target_x - nearest_x) > EPS)
+						else*/ if (std::abs(target_x - nearest_x) > EPS && zigzag_segments[i + 1][next_idx].end.line != &line) // along the same line there is nothing to intersect
 						{
 							// intersect fragment of created line with other line and combine them
 							const auto* line2 = zigzag_segments[i + 1][next_idx].end.line;
@@ -226,7 +248,7 @@ namespace ManualCAD
 							}
 							catch (const CommonIntersectionPointNotFoundException&)
 							{
-								Logger::log_warning("[WARNING] Intersection of overlapping paths not found; maybe because of ill-formed segment pass conditions? Paths may not be accurate. Please contact with a helpdesk\n");
+								++failed_links; // reported by caller
 							}
 							
 							// we should now go along second line but wait, this will work in our model XD
@@ -318,13 +340,20 @@ namespace ManualCAD
 						else if (first_x > nearest_x && nearest_x - target_x > EPS)
 							while (nearest_x - current_list.back().x > EPS)
 								current_list.pop_back();
-						else*/ if (std::abs(target_x - nearest_x) > EPS)
+						else*/ if (std::abs(target_x - nearest_x) > EPS && zigzag_segments[i + 1][next_idx].start.line != &line) // along the same line there is nothing to intersect
 						{
 							// intersect fragment of created line with other line and combine them
 							const auto* line2 = zigzag_segments[i + 1][next_idx].start.line;
-							auto intersection = Planimetrics::find_first_intersection(line.points, first_idx, idx, line.looped, dir, line2->points, line2->looped);
-							while (current_list.back().y - intersection.y > 0.0f)
-								current_list.pop_back(); // discard line fragments after intersection
+							try
+							{
+								auto intersection = Planimetrics::find_first_intersection(line.points, first_idx, idx, line.looped, dir, line2->points, line2->looped);
+								while (current_list.back().y - intersection.y > 0.0f)
+									current_list.pop_back(); // discard line fragments after intersection
+							}
+							catch (const CommonIntersectionPointNotFoundException&)
+							{
+								++failed_links; // reported by caller
+							}
 							// we should now go along second line but wait, this will work in our model XD
 							// TODO of course
 						}
@@ -361,33 +390,196 @@ namespace ManualCAD
 		return lists;
 	}
 
-	std::vector<std::vector<Vector2>> ZigZagPath::generate_paths_outside_loops(const Vector2& min, const Vector2& max, const float radius, const float epsilon) const
+	std::vector<std::vector<Vector2>> ZigZagPath::generate_paths_outside_loops(const std::vector<float>& rows, const Vector2& min, const Vector2& max, int& failed_links) const
 	{
-		const float row_width = 2.0f * radius - epsilon;
-		int rows = static_cast<int>((max.y - min.y) / row_width) + 1;
-
 		// calculate intersections of loops with rows
-		auto intersections = calculate_intersection_of_loops_with_rows(rows, min, max, row_width);
+		auto intersections = calculate_intersection_of_loops_with_rows(rows, min, max);
 
 		// make segments lists from left to right
-		auto zigzag_segments = make_segment_list_outside_loops(intersections, min, max, row_width);
+		auto zigzag_segments = make_segment_list_outside_loops(intersections, rows, min, max);
 
 		// link segments and create paths
-		return link_segments_and_create_paths(zigzag_segments, min, max, row_width);
+		return link_segments_and_create_paths(zigzag_segments, rows, failed_links);
+	}
+
+	std::vector<std::vector<Vector2>> ZigZagPath::generate_paths_outside_loops(const Vector2& min, const Vector2& max, const float radius, const float epsilon) const
+	{
+		int failed_links = 0;
+		auto paths = generate_paths_outside_loops(make_rows(min, max, 2.0f * radius - epsilon), min, max, failed_links);
+		warn_about_failed_links(failed_links);
+		return paths;
 	}
 
 	std::vector<std::vector<Vector2>> ZigZagPath::generate_paths_excluding_segments(const Vector2& min, const Vector2& max, const float radius, const float epsilon, const SegmentCheck& check) const
 	{
-		const float row_width = 2.0f * radius - epsilon;
-		int rows = static_cast<int>((max.y - min.y) / row_width) + 1;
+		int failed_links = 0;
+		auto paths = generate_paths_excluding_segments(make_rows(min, max, 2.0f * radius - epsilon), min, max, check, failed_links);
+		warn_about_failed_links(failed_links);
+		return paths;
+	}
 
+	std::vector<std::vector<Vector2>> ZigZagPath::generate_paths_excluding_segments(const std::vector<float>& rows, const Vector2& min, const Vector2& max, const SegmentCheck& check, int& failed_links) const
+	{
 		// calculate intersections of loops with rows
-		auto intersections = calculate_intersection_of_loops_with_rows(rows, min, max, row_width);
+		auto intersections = calculate_intersection_of_loops_with_rows(rows, min, max);
 
 		// make segments lists from left to right
-		auto zigzag_segments = make_segment_list_with_check(intersections, check, min, max, row_width);
+		auto zigzag_segments = make_segment_list_with_check(intersections, check, rows, min, max);
 
 		// link segments and create paths
-		return link_segments_and_create_paths(zigzag_segments, min, max, row_width);
+		return link_segments_and_create_paths(zigzag_segments, rows, failed_links);
+	}
+
+	std::vector<std::vector<Vector2>> ZigZagPath::generate_paths_excluding_segments(const Vector2& min, const Vector2& max, const RowSpacing& row_spacing, const SegmentCheck& check) const
+	{
+		int failed_links = 0;
+		auto paths = generate_paths_excluding_segments(make_rows(min, max, row_spacing), min, max, check, failed_links);
+		warn_about_failed_links(failed_links);
+		return paths;
+	}
+
+	std::vector<std::vector<Vector2>> ZigZagPath::generate_paths_excluding_segments(const Vector2& min, const Vector2& max, const float radius, const float epsilon, const SegmentCheck& check, float angle) const
+	{
+		if (angle == 0.0f)
+			return generate_paths_excluding_segments(min, max, radius, epsilon, check);
+		int failed_links = 0;
+		auto paths = generate_rotated_paths(min, max, 2.0f * radius - epsilon, check, angle, failed_links);
+		warn_about_failed_links(failed_links);
+		return paths;
+	}
+
+	std::vector<std::vector<Vector2>> ZigZagPath::generate_paths_outside_loops(const Vector2& min, const Vector2& max, const float radius, const float epsilon, float angle) const
+	{
+		if (angle == 0.0f)
+			return generate_paths_outside_loops(min, max, radius, epsilon);
+		int failed_links = 0;
+		auto paths = generate_rotated_paths(min, max, 2.0f * radius - epsilon, [this](const Vector2& start, const Vector2& end) { return is_outside_loops(0.5f * (start + end)); }, angle, failed_links);
+		warn_about_failed_links(failed_links);
+		return paths;
+	}
+
+	void ZigZagPath::warn_about_failed_links(int failed_links)
+	{
+		if (failed_links > 0)
+			Logger::log_warning("[WARNING] Intersection of overlapping paths not found %d times; maybe because of ill-formed segment pass conditions? Paths may not be accurate. Please contact with a helpdesk\n", failed_links);
+	}
+
+	bool ZigZagPath::is_outside_loops(const Vector2& point) const
+	{
+		bool outside = true;
+		for (const auto& line : lines)
+		{
+			if (!line.looped)
+				continue;
+			// crossings of ray going from point along X axis
+			for (int j = 0, k = static_cast<int>(line.points.size()) - 1; j < line.points.size(); k = j++)
+			{
+				const auto& a = line.points[j], & b = line.points[k];
+				if ((a.y > point.y) != (b.y > point.y) && point.x < a.x + (point.y - a.y) * (b.x - a.x) / (b.y - a.y))
+					outside = !outside;
+			}
+		}
+		return outside;
+	}
+
+	std::vector<std::vector<Vector2>> ZigZagPath::generate_rotated_paths(const Vector2& min, const Vector2& max, const float row_width, const SegmentCheck& check, float angle, int& failed_links) const
+	{
+		const Vector2 center = 0.5f * (min + max);
+		// exact zeros keep edges of the rectangle exactly parallel or perpendicular to rows for right angles
+		float c = cosf(angle), s = sinf(angle);
+		if (std::abs(c) < 1e-6f)
+			c = 0.0f;
+		if (std::abs(s) < 1e-6f)
+			s = 0.0f;
+		auto to_rows = [&](const Vector2& p) { const auto d = p - center; return Vector2{ c * d.x + s * d.y, -s * d.x + c * d.y }; };
+		auto from_rows = [&](const Vector2& p) { return center + Vector2{ c * p.x - s * p.y, s * p.x + c * p.y }; };
+
+		ZigZagPath rotated;
+		for (const auto& line : lines)
+		{
+			std::vector<Vector2> points(line.points.size());
+			std::transform(line.points.begin(), line.points.end(), points.begin(), to_rows);
+			rotated.add_line(points, line.looped);
+		}
+		const std::vector<Vector2> corners = { to_rows(min), to_rows({ max.x, min.y }), to_rows(max), to_rows({ min.x, max.y }) };
+		// linking walks along loops up to their first point past the next row, so edges are split finer than rows
+		std::vector<Vector2> rectangle;
+		for (int k = 0; k < 4; ++k)
+		{
+			const auto& a = corners[k], & b = corners[(k + 1) % 4];
+			const int pieces = static_cast<int>(ceilf(2.0f * (b - a).length() / row_width));
+			for (int p = 0; p < pieces; ++p)
+				rectangle.push_back(lerp(a, b, static_cast<float>(p) / pieces));
+		}
+		rotated.add_line(rectangle, true);
+		Vector2 rotated_min = corners[0], rotated_max = corners[0];
+		for (const auto& corner : corners)
+		{
+			rotated_min = ManualCAD::min(rotated_min, corner);
+			rotated_max = ManualCAD::max(rotated_max, corner);
+		}
+
+		// segments which only touch the rectangle (e.g. along its edge) are rejected too
+		const Vector2 margin = 1e-5f * (max - min);
+		auto paths = rotated.generate_paths_excluding_segments(make_rows(rotated_min, rotated_max, row_width), rotated_min, rotated_max, [&](const Vector2& start, const Vector2& end) {
+			const auto a = from_rows(start), b = from_rows(end), middle = 0.5f * (a + b);
+			if (middle.x <= min.x + margin.x || middle.x >= max.x - margin.x || middle.y <= min.y + margin.y || middle.y >= max.y - margin.y)
+				return false;
+			return check(a, b);
+		}, failed_links);
+		for (auto& path : paths)
+			for (auto& p : path)
+				p = from_rows(p);
+		return paths;
+	}
+
+	float ZigZagPath::find_best_angle(const std::function<std::vector<std::vector<Vector2>>(float, int&)>& generate, int candidates)
+	{
+		// score is (failed links, paths, vertices)
+		std::vector<std::future<std::tuple<int, size_t, size_t>>> futures;
+		for (int k = 0; k < candidates; ++k)
+			futures.push_back(std::async(std::launch::async, [&generate, k, candidates]() {
+				int failed_links = 0;
+				const auto paths = generate(PI * k / candidates, failed_links);
+				size_t vertices = 0;
+				for (const auto& path : paths)
+					vertices += path.size();
+				return std::make_tuple(failed_links, paths.size(), vertices);
+			}));
+
+		int best = 0;
+		std::tuple<int, size_t, size_t> best_score = { INT_MAX, SIZE_MAX, SIZE_MAX };
+		for (int k = 0; k < candidates; ++k)
+		{
+			const auto score = futures[k].get();
+			if (score < best_score)
+			{
+				best_score = score;
+				best = k;
+			}
+		}
+		if (std::get<0>(best_score) > 0)
+			Logger::log_warning("[WARNING] Linking of zig-zag paths fails in every direction of rows\n");
+		return PI * best / candidates;
+	}
+
+	float ZigZagPath::find_best_angle(const Vector2& min, const Vector2& max, const float radius, const float epsilon, const SegmentCheck& check, int candidates) const
+	{
+		const float row_width = 2.0f * radius - epsilon;
+		return find_best_angle([&](float angle, int& failed_links) {
+			if (angle == 0.0f)
+				return generate_paths_excluding_segments(make_rows(min, max, row_width), min, max, check, failed_links);
+			return generate_rotated_paths(min, max, row_width, check, angle, failed_links);
+		}, candidates);
+	}
+
+	float ZigZagPath::find_best_angle_outside_loops(const Vector2& min, const Vector2& max, const float radius, const float epsilon, int candidates) const
+	{
+		const float row_width = 2.0f * radius - epsilon;
+		return find_best_angle([&](float angle, int& failed_links) {
+			if (angle == 0.0f)
+				return generate_paths_outside_loops(make_rows(min, max, row_width), min, max, failed_links);
+			return generate_rotated_paths(min, max, row_width, [this](const Vector2& start, const Vector2& end) { return is_outside_loops(0.5f * (start + end)); }, angle, failed_links);
+		}, candidates);
 	}
 }
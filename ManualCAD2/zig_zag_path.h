@@ -9,6 +9,8 @@
 namespace ManualCAD 
 {
 	class ZigZagPath {
+		static constexpr int ANGLE_CANDIDATES = 12; // directions of rows evaluated by angle search, evenly spaced in [0, pi)
+
 		struct PathLine {
 			std::vector<Vector2> points;
 			bool looped;
@@ -17,6 +19,7 @@ namespace ManualCAD
 		std::list<PathLine> lines;
 
 		using SegmentCheck = std::function<bool(const Vector2&, const Vector2&)>;
+		using RowSpacing = std::function<float(float)>; // returns distance from row at given y to the next row
 		struct LoopIntersection {
 			float x;
 			const PathLine* line;
@@ -28,10 +31,25 @@ namespace ManualCAD
 			LoopIntersection start, end;
 		};
 
-		std::vector<std::list<LoopIntersection>> calculate_intersection_of_loops_with_rows(const int& rows, const Vector2& min, const Vector2& max, const float& row_width) const;
-		std::vector<std::vector<PathSegment>> make_segment_list_outside_loops(const std::vector<std::list<LoopIntersection>>& intersections, const Vector2& min, const Vector2& max, const float& row_width) const;
-		std::vector<std::vector<PathSegment>> make_segment_list_with_check(const std::vector<std::list<LoopIntersection>>& intersections, const SegmentCheck& check, const Vector2& min, const Vector2& max, const float& row_width) const;
-		std::vector<std::vector<Vector2>> link_segments_and_create_paths(std::vector<std::vector<PathSegment>>& zigzag_segments, const Vector2& min, const Vector2& max, const float& row_width) const;
+		// rows are given by their (increasing) y coordinates
+		static std::vector<float> make_rows(const Vector2& min, const Vector2& max, const float row_width);
+		static std::vector<float> make_rows(const Vector2& min, const Vector2& max, const RowSpacing& row_spacing);
+		std::vector<std::vector<LoopIntersection>> calculate_intersection_of_loops_with_rows(const std::vector<float>& rows, const Vector2& min, const Vector2& max) const;
+		std::vector<std::vector<PathSegment>> make_segment_list_outside_loops(const std::vector<std::vector<LoopIntersection>>& intersections, const std::vector<float>& rows, const Vector2& min, const Vector2& max) const;
+		std::vector<std::vector<PathSegment>> make_segment_list_with_check(const std::vector<std::vector<LoopIntersection>>& intersections, const SegmentCheck& check, const std::vector<float>& rows, const Vector2& min, const Vector2& max) const;
+		// Links which need an intersection of two loops that isn't found are counted in failed_links (such paths may be inaccurate).
+		std::vector<std::vector<Vector2>> link_segments_and_create_paths(std::vector<std::vector<PathSegment>>& zigzag_segments, const std::vector<float>& rows, int& failed_links) const;
+		std::vector<std::vector<Vector2>> generate_paths_excluding_segments(const std::vector<float>& rows, const Vector2& min, const Vector2& max, const SegmentCheck& check, int& failed_links) const;
+		std::vector<std::vector<Vector2>> generate_paths_outside_loops(const std::vector<float>& rows, const Vector2& min, const Vector2& max, int& failed_links) const;
+		// whether point is outside of all looped lines (even-odd rule)
+		bool is_outside_loops(const Vector2& point) const;
+		// Generates rows along direction (cos(angle), sin(angle)) in a copy with lines rotated to horizontal rows; rectangle [min, max]
+		// is added there as a loop, thus rows are split at its edges, and segments outside of it are rejected before check.
+		std::vector<std::vector<Vector2>> generate_rotated_paths(const Vector2& min, const Vector2& max, const float row_width, const SegmentCheck& check, float angle, int& failed_links) const;
+		static void warn_about_failed_links(int failed_links);
+		// Returns the candidate angle with the fewest failed links, then the fewest paths (each needs a link), then the fewest path vertices;
+		// thus candidates with failed links are chosen only if all of them fail. Angles are evaluated in parallel.
+		static float find_best_angle(const std::function<std::vector<std::vector<Vector2>>(float, int&)>& generate, int candidates);
 	public:
 		void add_line(const std::vector<Vector2>& line, bool looped) { lines.push_back({ line, looped }); }
 		std::vector<std::vector<Vector2>> generate_paths_outside_loops(const Vector2& min, const Vector2& max, const float radius, const float epsilon) const;
@@ -39,8 +57,19 @@ namespace ManualCAD
 			return generate_paths_outside_loops(Vector2{ urange.from, vrange.from }, Vector2{ urange.to, vrange.to }, radius, epsilon);
 		}
 		std::vector<std::vector<Vector2>> generate_paths_excluding_segments(const Vector2& min, const Vector2& max, const float radius, const float epsilon, const SegmentCheck& check) const;
+		// Rows go along direction (cos(angle), sin(angle)) instead of X axis and are clipped to rectangle [min, max].
+		std::vector<std::vector<Vector2>> generate_paths_excluding_segments(const Vector2& min, const Vector2& max, const float radius, const float epsilon, const SegmentCheck& check, float angle) const;
+		std::vector<std::vector<Vector2>> generate_paths_outside_loops(const Vector2& min, const Vector2& max, const float radius, const float epsilon, float angle) const;
+		// Search for direction of rows which needs the fewest links between paths, then the fewest segments.
+		float find_best_angle(const Vector2& min, const Vector2& max, const float radius, const float epsilon, const SegmentCheck& check, int candidates = ANGLE_CANDIDATES) const;
+		float find_best_angle_outside_loops(const Vector2& min, const Vector2& max, const float radius, const float epsilon, int candidates = ANGLE_CANDIDATES) const;
 		std::vector<std::vector<Vector2>> generate_paths_excluding_segments(const Range<float>& urange, const Range<float>& vrange, const float radius, const float epsilon, const SegmentCheck& check) const {
 			return generate_paths_excluding_segments(Vector2{ urange.from, vrange.from }, Vector2{ urange.to, vrange.to }, radius, epsilon, check);
 		}
+		// Rows are spaced by given function instead of constant width (e.g. to keep constant scallop height on a surface).
+		std::vector<std::vector<Vector2>> generate_paths_excluding_segments(const Vector2& min, const Vector2& max, const RowSpacing& row_spacing, const SegmentCheck& check) const;
+		std::vector<std::vector<Vector2>> generate_paths_excluding_segments(const Range<float>& urange, const Range<float>& vrange, const RowSpacing& row_spacing, const SegmentCheck& check) const {
+			return generate_paths_excluding_segments(Vector2{ urange.from, vrange.from }, Vector2{ urange.to, vrange.to }, row_spacing, check);
+		}
 	};
 }
\ No newline at end of file